@@ -1,368 +1,127 @@
-#include <torch/script.h>  // For TorchScript model loading
-#include <torch/torch.h>
 #include <iostream>
 #include <iomanip>  // For formatted output
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <he/he.h>
-#include <convolution/convolution.h>
-#include <linear/linear.h>
-#include <functions/square.h>
-#include <pooling/avgPooling.h>
-// Structure for convolutional layer weights
-struct ConvLayerWeights {
-    std::vector<std::vector<std::vector<std::vector<float>>>> weights;
-};
-
-// Structure for linear layer weights
-struct LinearLayerWeights {
-    std::vector<std::vector<float>> weights;
-};
-
-// A structure to hold both weight and bias for one layer.
-struct LayerParameters {
-    std::string layerId;
-    std::vector<int64_t> weightShape;
-    std::vector<int64_t> biasShape;
-    bool isConv;
-    ConvLayerWeights conv;
-    LinearLayerWeights linear;
-    std::vector<float> bias;
-};
-
-// Extract layer ID from parameter name.
-std::string extractLayerId(const std::string &paramName) {
-    size_t pos = paramName.find('.');
-    return (pos != std::string::npos) ? paramName.substr(0, pos) : paramName;
-}
-
-// Function to extract weights and biases from a TorchScript model
-std::unordered_map<std::string, LayerParameters> extractWeightsAndBiases(const std::string& modelPath) {
-    std::unordered_map<std::string, LayerParameters> layerMap;
-    
-    try {
-        torch::jit::Module module = torch::jit::load(modelPath);
-        
-        for (const auto& param : module.named_parameters()) {
-            std::string fullName = param.name;
-            torch::Tensor tensor = param.value;
-            std::vector<int64_t> shape = tensor.sizes().vec();
-            bool isWeight = (fullName.find("weight") != std::string::npos);
-            bool isBias = (fullName.find("bias") != std::string::npos);
-            std::string layerId = extractLayerId(fullName);
-            
-            if (layerMap.find(layerId) == layerMap.end()) {
-                layerMap[layerId] = {layerId, {}, {}, false, {}, {}, {}};
-            }
-            LayerParameters &layer = layerMap[layerId];
-            
-            if (isWeight) {
-                layer.weightShape = shape;
-                if (tensor.dim() == 4) {
-                    layer.isConv = true;
-                    int channels = tensor.size(0), filters = tensor.size(1);
-                    int height = tensor.size(2), width = tensor.size(3);
-                    layer.conv.weights.resize(channels);
-                    auto data = tensor.accessor<float, 4>();
-                    for (int i = 0; i < channels; ++i) {
-                        layer.conv.weights[i].resize(filters);
-                        for (int j = 0; j < filters; ++j) {
-                            layer.conv.weights[i][j].resize(height);
-                            for (int k = 0; k < height; ++k) {
-                                layer.conv.weights[i][j][k].resize(width);
-                                for (int l = 0; l < width; ++l) {
-                                    layer.conv.weights[i][j][k][l] = data[i][j][k][l];
-                                }
-                            }
-                        }
-                    }
-                } else if (tensor.dim() == 2) {
-                    layer.isConv = false;
-                    int rows = tensor.size(0), cols = tensor.size(1);
-                    layer.linear.weights.resize(rows);
-                    auto data = tensor.accessor<float, 2>();
-                    for (int i = 0; i < rows; ++i) {
-                        layer.linear.weights[i].resize(cols);
-                        for (int j = 0; j < cols; ++j) {
-                            layer.linear.weights[i][j] = data[i][j];
-                        }
-                    }
-                }
-            } else if (isBias) {
-                layer.biasShape = shape;
-                layer.bias.resize(tensor.numel());
-                auto data = tensor.accessor<float, 1>();
-                for (size_t i = 0; i < layer.bias.size(); ++i) {
-                    layer.bias[i] = data[i];
-                }
-            }
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "Error loading model: " << e.what() << std::endl;
+#include <plan/modelPlan.h>
+#include <sequential/sequential.h>
+
+// Read image `index` of an MNIST idx3 file as a normalized 4D vector [1][1][rows][cols]
+// (same normalization as the training transform: mean 0.1307, std 0.3081)
+std::vector<std::vector<std::vector<std::vector<double>>>> loadMnistImage(const std::string &path, size_t index) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
     }
-    
-    return layerMap;
-}
 
-// Convert a single MNIST image tensor to a 4D std::vector<double>
-std::vector<std::vector<std::vector<std::vector<double>>>> tensorTo4DVector(torch::Tensor tensor) {
-    tensor = tensor.squeeze().to(torch::kDouble); // Convert [1, 28, 28] -> [28, 28]
-
-    int height = tensor.size(0);
-    int width = tensor.size(1);
+    // Header: magic 0x00000803, image count, rows, columns (big-endian 32-bit)
+    auto readBigEndian = [&file]() {
+        unsigned char bytes[4];
+        file.read(reinterpret_cast<char *>(bytes), 4);
+        return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+    };
+    uint32_t magic = readBigEndian(), count = readBigEndian(), rows = readBigEndian(), cols = readBigEndian();
+    if (!file || magic != 0x00000803 || index >= count) {
+        throw std::runtime_error(path + " is not an MNIST image file with image " + std::to_string(index));
+    }
 
-    std::vector<std::vector<std::vector<std::vector<double>>>> image(1, std::vector<std::vector<std::vector<double>>>(1, std::vector<std::vector<double>>(height, std::vector<double>(width))));
+    std::vector<unsigned char> pixels(rows * cols);
+    file.seekg(16 + static_cast<std::streamoff>(index) * rows * cols);
+    file.read(reinterpret_cast<char *>(pixels.data()), pixels.size());
+    if (!file) {
+        throw std::runtime_error("Truncated image in " + path);
+    }
 
-    for (int r = 0; r < height; r++) {
-        for (int c = 0; c < width; c++) {
-            image[0][0][r][c] = tensor[r][c].item<double>();
+    std::vector<std::vector<std::vector<std::vector<double>>>> image(1, std::vector<std::vector<std::vector<double>>>(1, std::vector<std::vector<double>>(rows, std::vector<double>(cols))));
+    for (uint32_t r = 0; r < rows; r++) {
+        for (uint32_t c = 0; c < cols; c++) {
+            image[0][0][r][c] = (pixels[r * cols + c] / 255.0 - 0.1307) / 0.3081;
         }
     }
     return image;
 }
 
-
 int main() {
-    const std::string MODEL_PATH = "/home/oussama/Documents/PFE/Implementations/NativeSEAL/models/Lenet1_traced.pt";
-    
-    // Extract layer weights
-    std::unordered_map<std::string, LayerParameters> layerMap = extractWeightsAndBiases(MODEL_PATH);
-
-    // Initialize CKKS encryption
-    CKKSPyfhel he;
+    // Compiled offline from Lenet1_traced.pt by NativeSealCompile (tools/compileModel.cpp)
+    const std::string PLAN_PATH = "/home/oussama/Documents/PFE/Implementations/NativeSEAL/models/Lenet1.heplan";
+    const std::string MNIST_PATH = "/home/oussama/Documents/PFE/Implementations/NativeSEAL/data/MNIST/raw/train-images-idx3-ubyte";
+
+    // Load the plan: layer graph, schedule and pre-encoded weights in one mapping, no re-encoding
+    auto startPlan = std::chrono::high_resolution_clock::now();
+    ModelPlan plan = ModelPlan::load(PLAN_PATH);
+    auto endPlan = std::chrono::high_resolution_clock::now();
+    std::cout << "Time taken for plan loading: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(endPlan - startPlan).count() << " milliseconds" << std::endl;
+
+    // Initialize CKKS encryption with the plan's parameters (context, keys and ciphertexts on huge
+    // pages when the kernel allows)
+    CKKSPyfhel he(plan.poly_modulus_degree(), plan.scale(), plan.bit_sizes(), HugePageMemoryPool::available());
     he.generate_keys();
     he.generate_relin_keys();
-    
-    // 2) Load a real MNIST image
-    std::string dataset_path = "/home/oussama/Documents/PFE/Implementations/NativeSEAL/data/MNIST/raw";
-    auto train_dataset = torch::data::datasets::MNIST(dataset_path)
-        .map(torch::data::transforms::Normalize<>(0.1307, 0.3081))  // Normalize
-        .map(torch::data::transforms::Stack<>());
-    
-    auto train_loader = torch::data::make_data_loader(
-        std::move(train_dataset),
-        torch::data::DataLoaderOptions().batch_size(1));
 
-    torch::Tensor image_tensor;
-    for (auto& batch : *train_loader) {
-        image_tensor = batch.data[0]; // Get first image
-        break;
-    }
+    // Load a real MNIST image (the first training image)
+    auto inputDouble = loadMnistImage(MNIST_PATH, 0);
 
-    // Convert to 4D vector
-    auto inputDouble = tensorTo4DVector(image_tensor);
-    
-    // Clear the tensor and other unused variables
-    // image_tensor.reset();  // Frees the memory used by image_tensor
-    // train_loader.reset();  // Frees memory used by train_loader
-
-    // Encrypt the input image
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> inputEnc(1);
-    inputEnc[0].resize(1);
+    // Offline phase: one encryption of zero per pixel ciphertext, made before the image is known,
+    // so encrypting it below only adds each pixel to one of them
+    he.start_encryption_pool(inputDouble.size() * inputDouble[0].size() * inputDouble[0][0].size() * inputDouble[0][0][0].size(),
+                            false);
+    he.fill_encryption_pool();
 
     // duration measurement
     auto startImg = std::chrono::high_resolution_clock::now();
     
-    //  Encrypt the MNIST image
-    inputEnc[0][0] = he.encryptMatrix2D(inputDouble[0][0]); // Encrypt the MNIST image
+    //  Encrypt the MNIST image: CipherTensor [1, 1, 28, 28]
+    CipherTensor inputEnc = he.encryptTensor(inputDouble);
 
     auto endImg = std::chrono::high_resolution_clock::now();
 
     // For milliseconds:
     auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(endImg - startImg);
     std::cout << "Time taken for image encryption is: " << duration_ms.count() << " milliseconds" << std::endl;
-    
-
-    // free memory of vectors
-    // inputDouble.clear();
-    // inputDouble.shrink_to_fit();
-    
-    // Retrieve convolutional and linear layer parameters by index
-    std::string convLayerId = "0";  // First convolutional layer
-    std::string convLayer2ID = "3";  // Square layer
-    std::string linearLayerId = "7";  // Fully connected layer
-
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> outputEnc1;
-    // **Step 1: Initialize Convolutional Layer**
-    if (layerMap.find(convLayerId) != layerMap.end()) {
-        LayerParameters& convLayerParams = layerMap[convLayerId];
-
-        if (convLayerParams.isConv) {
-            std::vector<std::vector<std::vector<std::vector<double>>>> convertedWeights(
-                convLayerParams.conv.weights.size()
-            );
-
-            for (size_t i = 0; i < convLayerParams.conv.weights.size(); i++) {
-                convertedWeights[i].resize(convLayerParams.conv.weights[i].size());
-                for (size_t j = 0; j < convLayerParams.conv.weights[i].size(); j++) {
-                    convertedWeights[i][j].resize(convLayerParams.conv.weights[i][j].size());
-                    for (size_t k = 0; k < convLayerParams.conv.weights[i][j].size(); k++) {
-                        convertedWeights[i][j][k].resize(convLayerParams.conv.weights[i][j][k].size());
-                        for (size_t l = 0; l < convLayerParams.conv.weights[i][j][k].size(); l++) {
-                            convertedWeights[i][j][k][l] = static_cast<double>(convLayerParams.conv.weights[i][j][k][l]);
-                        }
-                    }
-                }
-            }
-            std::vector<double> convertedBias(convLayerParams.bias.begin(), convLayerParams.bias.end());
-
-            // Create convolutional layer
-            Conv2d convLayer(
-                he, convertedWeights, 
-                std::make_pair(1, 1),  // Stride
-                std::make_pair(0, 0),  // Padding
-                convertedBias
-            );
-
-            std::cout << "Initialized Conv Layer 0!" << std::endl;
 
-            // duration measurement
-            auto start = std::chrono::high_resolution_clock::now();
-    
-            //  Apply first convolution layer
-            outputEnc1 = convLayer(inputEnc);
-
-            auto end = std::chrono::high_resolution_clock::now();
-
-            // For milliseconds:
-            auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-            std::cout << "Time taken: " << duration_ms.count() << " milliseconds" << std::endl;
-            
-            // 8) Decrypt and print the final convolution result
-            // auto &out2D = outputEnc1[0][0];
-            // int outHeight = static_cast<int>(out2D.size());
-            // int outWidth  = (outHeight > 0) ? static_cast<int>(out2D[0].size()) : 0;
-
-            // std::cout << "\n First Decrypted Convolution Output:\n";
-            // for (int y = 0; y < outHeight; y++) {
-            //     for (int x = 0; x < outWidth; x++) {
-            //         double val = he.decrypt(out2D[y][x]);
-            //         std::cout << std::setw(6) << val << " ";
-            //     }
-            //     std::cout << std::endl;
-            // }
-        }
+    // **Initialize the layers** from the plan's pre-encoded weights
+    Sequential model(he);
+    for (const auto &layer : plan.build(he)) {
+        model.addLayer(layer);
     }
+    std::cout << "Initialized " << plan.layers().size() << " layers from the plan!" << std::endl;
 
-    //Apply SquareLayer after the first convolution
-    auto squareLayer = SquareLayer(he);
-
-    squareLayer(outputEnc1);
-    
-    
-    std::cout << "AvgPooling Layer !" << std::endl;
+    // Consecutive Conv2d / Square / AvgPool layers run as one dataflow pipeline: each layer starts
+    // on the rows of its input that are ready while the previous layer is still computing the rest
+    model.setPipelined(true);
+    // Every tensor keeps only the primes the remaining layers need (the plan's level schedule)
+    model.setLevelDropping(true);
 
     // duration measurement
-    auto startPooling = std::chrono::high_resolution_clock::now();
+    auto start = std::chrono::high_resolution_clock::now();
 
-    // Define Avg Pooling Layer (2x2 kernel, stride=2, padding=0)
-    AvgPoolLayer avgPool(he, {2, 2}, {2, 2}, {0, 0});
-    
-    // Apply Avg Pooling on First  convolution output
-    outputEnc1 = avgPool(outputEnc1);
+    // The encrypted input is handed over, so its rows are freed as the first convolution consumes them
+    CipherTensor outputEnc1 = model(std::move(inputEnc));
 
-    auto endPooling = std::chrono::high_resolution_clock::now();
+    auto end = std::chrono::high_resolution_clock::now();
 
     // For milliseconds:
-    duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(endPooling - startPooling);
-    std::cout << "Time taken for the AvgPooling Layer: " << duration_ms.count() << " milliseconds" << std::endl;
-    
-
-    // **Initialize Convolutional Layer 2**
-    if (layerMap.find(convLayer2ID) != layerMap.end()) {
-        LayerParameters& convLayerParams = layerMap[convLayer2ID];
-
-        if (convLayerParams.isConv) {
-            std::vector<std::vector<std::vector<std::vector<double>>>> convertedWeights(
-                convLayerParams.conv.weights.size()
-            );
-
-            for (size_t i = 0; i < convLayerParams.conv.weights.size(); i++) {
-                convertedWeights[i].resize(convLayerParams.conv.weights[i].size());
-                for (size_t j = 0; j < convLayerParams.conv.weights[i].size(); j++) {
-                    convertedWeights[i][j].resize(convLayerParams.conv.weights[i][j].size());
-                    for (size_t k = 0; k < convLayerParams.conv.weights[i][j].size(); k++) {
-                        convertedWeights[i][j][k].resize(convLayerParams.conv.weights[i][j][k].size());
-                        for (size_t l = 0; l < convLayerParams.conv.weights[i][j][k].size(); l++) {
-                            convertedWeights[i][j][k][l] = static_cast<double>(convLayerParams.conv.weights[i][j][k][l]);
-                        }
-                    }
-                }
-            }
-            std::vector<double> convertedBias(convLayerParams.bias.begin(), convLayerParams.bias.end());
-
-            // Create convolutional layer
-            Conv2d convLayer(
-                he, convertedWeights, 
-                std::make_pair(1, 1),  // Stride
-                std::make_pair(0, 0),  // Padding
-                convertedBias
-            );
-
-            std::cout << "Initialized Conv Layer 3!" << std::endl;
-
-            // duration measurement
-            auto start = std::chrono::high_resolution_clock::now();
-    
-            //  Apply first convolution layer
-            outputEnc1 = convLayer(outputEnc1);
-
-            auto end = std::chrono::high_resolution_clock::now();
-
-            // For milliseconds:
-            auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-            std::cout << "Time taken for the second conv Layer: " << duration_ms.count() << " milliseconds" << std::endl;
-            
-            // 8) Decrypt and print the final convolution result
-            // auto &out2D = outputEnc1[0][0];
-            // int outHeight = static_cast<int>(out2D.size());
-            // int outWidth  = (outHeight > 0) ? static_cast<int>(out2D[0].size()) : 0;
-
-            // std::cout << "\n First Decrypted Convolution Output:\n";
-            // for (int y = 0; y < outHeight; y++) {
-            //     for (int x = 0; x < outWidth; x++) {
-            //         double val = he.decrypt(out2D[y][x]);
-            //         std::cout << std::setw(6) << val << " ";
-            //     }
-            //     std::cout << std::endl;
-            // }
-        }
+    duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    std::cout << "Time taken for the encrypted forward pass: " << duration_ms.count() << " milliseconds" << std::endl;
+
+    HugePageStats hugeStats = he.huge_page_stats();
+    std::cout << "Huge pages: " << hugeStats.buffers_advised << " buffers advised, "
+              << (hugeStats.bytes_huge_eligible >> 20) << " MB eligible, "
+              << (hugeStats.process_huge_bytes >> 20) << " MB resident on huge pages" << std::endl;
+
+    // Decrypted output of the first image
+    std::cout << "\nDecrypted output (scale 2^" << std::log2(outputEnc1[0].scale())
+              << ", planned 2^" << std::log2(plan.output_scale()) << "):\n";
+    for (size_t i = 0; i < outputEnc1.size() / outputEnc1.dim(0); i++) {
+        std::cout << std::setw(10) << he.decrypt(outputEnc1[i]) << " ";
     }
-
-    // auto &out2D = outputEnc1[0][0];
-    // int outHeight = static_cast<int>(out2D.size());
-    // int outWidth  = (outHeight > 0) ? static_cast<int>(out2D[0].size()) : 0;
-
-    // std::cout << "\nFirst Decrypted Square Output:\n";
-    // for (int y = 0; y < outHeight; y++) {
-    //     for (int x = 0; x < outWidth; x++) {
-    //         double val = he.decrypt(out2D[y][x]);
-    //         std::cout << std::setw(6) << val << " ";
-    //     }
-    //     std::cout << std::endl;
-    // }
-
-
-    // **Step 2: Initialize Fully Connected (Linear) Layer**
-    // if (layerMap.find(linearLayerId) != layerMap.end()) {
-    //     LayerParameters& linearLayerParams = layerMap[linearLayerId];
-
-    //     if (!linearLayerParams.isConv) {
-    //         std::vector<std::vector<double>> convertedWeights(linearLayerParams.linear.weights.size());
-    //         for (size_t i = 0; i < linearLayerParams.linear.weights.size(); i++) {
-    //             convertedWeights[i].resize(linearLayerParams.linear.weights[i].size());
-    //             for (size_t j = 0; j < linearLayerParams.linear.weights[i].size(); j++) {
-    //                 convertedWeights[i][j] = static_cast<double>(linearLayerParams.linear.weights[i][j]);
-    //             }
-    //         }
-    //         std::vector<double> convertedBias(linearLayerParams.bias.begin(), linearLayerParams.bias.end());
-
-    //         // Create linear layer
-    //         LinearLayer linearLayer(he, convertedWeights, convertedBias);
-    //         std::cout << "Initialized Linear Layer 3!" << std::endl;
-    //     }
-    // }
+    std::cout << std::endl;
 
     return 0;
 }
@@ -1,89 +1,45 @@
 #include "convolution.h"
 #include <stdexcept>   // for exceptions
+#include <algorithm>
 #include <iostream>    // for debug prints (optional)
 #include <chrono>
-#include <omp.h>
-
-// Helper: multiply ciphertext by plaintext, returning a new ciphertext.
-// Multiply a batch of ciphertexts by a batch of plaintexts in parallel
-static std::vector<seal::Ciphertext> multiply_ciphertext_plain_batch(
-    CKKSPyfhel &he,
-    const std::vector<seal::Ciphertext> &ct_vec,
-    const std::vector<seal::Plaintext> &pt_vec)
-{
-    if (ct_vec.size() != pt_vec.size())
-        throw std::invalid_argument("Mismatched sizes for ciphertext and plaintext vectors.");
-
-    std::vector<seal::Ciphertext> result(ct_vec.size());
-
-    // Process in parallel
-    #pragma omp parallel for
-    for (int i = 0; i < ct_vec.size(); i++)
-    {
-        seal::Plaintext pt_aligned = pt_vec[i];
-        he.evaluator_->mod_switch_to_inplace(pt_aligned, ct_vec[i].parms_id());
-        pt_aligned.scale() = ct_vec[i].scale();
-        he.evaluator_->multiply_plain(ct_vec[i], pt_aligned, result[i]);
-        he.evaluator_->rescale_to_next_inplace(result[i]);
-    }
-
-    return result;
-}
+#include "runtime/taskScheduler.h"
+#include "runtime/recycler.h"
+#include "runtime/rowPipeline.h"
 
 /*************************************************************
  * Conv2d Implementation
  *************************************************************/
 Conv2d::Conv2d(
-    CKKSPyfhel &he,
+    const CKKSPyfhel &he,
     const std::vector<std::vector<std::vector<std::vector<double>>>> &weights,
     std::pair<int,int> stride,
     std::pair<int,int> padding,
     const std::vector<double> &bias
 )
-  : he_(he), stride_(stride), padding_(padding)
+  : he_(he), stride_(stride), padding_(padding), raw_weights_(weights), raw_bias_(bias)
 {
-    // Encode the 4D weights as Plaintext.
+    // Encode the 4D weights as scalar constants (per-prime residues, no Plaintext).
     // Expected shape: [n_filters][n_input_channels][kernel_height][kernel_width]
 
     // duration measurement
     auto start = std::chrono::high_resolution_clock::now();
 
-    // Perform resizing before parallel execution
     weights_.resize(weights.size());
-    #pragma omp parallel for
-    for (size_t f = 0; f < weights.size(); f++) {
+    TaskScheduler::instance().parallel_for(weights.size(), [&](size_t f) {
         weights_[f].resize(weights[f].size());
         for (size_t in_c = 0; in_c < weights[f].size(); in_c++) {
             weights_[f][in_c].resize(weights[f][in_c].size());
             for (size_t y = 0; y < weights[f][in_c].size(); y++) {
-                weights_[f][in_c][y].resize(weights[f][in_c][y].size());
-            }
-        }
-    }
-
-    //the parallel loop to encode the weights
-    #pragma omp parallel for collapse(4)
-    for (size_t f = 0; f < weights.size(); f++) {
-        for (size_t in_c = 0; in_c < weights[f].size(); in_c++) {
-            for (size_t y = 0; y < weights[f][in_c].size(); y++) {
-                for (size_t x = 0; x < weights[f][in_c][y].size(); x++) {
-                    double w = weights[f][in_c][y][x];
-                    weights_[f][in_c][y][x] = he_.encode(w);
+                weights_[f][in_c][y].reserve(weights[f][in_c][y].size());
+                for (double w : weights[f][in_c][y]) {
+                    weights_[f][in_c][y].push_back(he_.encodeScalar(w));
                 }
             }
         }
-    }
+    });
 
-    // Encode the bias if provided (assume bias.size() == n_filters)
-    if (!bias.empty())
-    {
-        bias_.resize(bias.size());
-        #pragma omp parallel for
-        for (size_t i = 0; i < bias.size(); i++)
-        {
-            bias_[i] = he_.encode(bias[i]);
-        }
-    }
+    // The bias (raw_bias_, one value per filter) is encoded per input level, at the product scale
 
     auto end = std::chrono::high_resolution_clock::now();
 
@@ -93,222 +49,545 @@ Conv2d::Conv2d(
 
 }
 
-std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>
-Conv2d::operator()(const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input)
+Conv2d::Conv2d(
+    const CKKSPyfhel &he,
+    std::vector<std::vector<std::vector<std::vector<ScalarConstant>>>> encoded_weights,
+    const std::vector<std::vector<std::vector<std::vector<double>>>> &weights,
+    std::pair<int,int> stride,
+    std::pair<int,int> padding,
+    const std::vector<double> &bias
+)
+  : he_(he), weights_(std::move(encoded_weights)), stride_(stride), padding_(padding),
+    raw_weights_(weights), raw_bias_(bias)
+{
+    bool same_shape = weights_.size() == raw_weights_.size();
+    for (size_t f = 0; same_shape && f < weights_.size(); f++) {
+        same_shape = weights_[f].size() == raw_weights_[f].size();
+        for (size_t in_c = 0; same_shape && in_c < weights_[f].size(); in_c++) {
+            same_shape = weights_[f][in_c].size() == raw_weights_[f][in_c].size();
+            for (size_t y = 0; same_shape && y < weights_[f][in_c].size(); y++) {
+                same_shape = weights_[f][in_c][y].size() == raw_weights_[f][in_c][y].size();
+            }
+        }
+    }
+    if (!same_shape || weights_.empty()) {
+        throw std::invalid_argument("Conv2d: encoded weights do not match the raw weights.");
+    }
+}
+
+CipherTensor Conv2d::operator()(const CipherTensor &input) const
+{
+    CipherTensor result(infer_shape(input.shape()));
+    forward(input, result);
+    return result;
+}
+
+void Conv2d::forward(const CipherTensor &input, CipherTensor &result) const
 {
     // input shape = [n_images, n_input_channels, height, width]
     // weights_ shape = [n_filters][n_input_channels][kernel_height][kernel_width]
-
-    auto padded_input = apply_padding(input, padding_, he_);
-    size_t n_images = padded_input.size();
-    size_t n_input_channels = (n_images > 0) ? padded_input[0].size() : 0;
+    // Padding is virtual: convolute2d skips taps that fall on the zero border
+    if (result.shape() != infer_shape(input.shape())) {
+        throw std::runtime_error("Conv2d: output tensor does not match the inferred output shape.");
+    }
+    size_t n_images = input.dim(0);
     size_t n_filters = weights_.size(); // Number of output channels
+    const std::vector<ScalarConstant> *bias = input.empty() ? nullptr : bias_at(input[0].parms_id(), input[0].scale());
+
+    // One task per (image, filter); convolute2d splits each into per-pixel tasks, which idle
+    // threads steal, so small batches still fill the machine.
+    // For each output channel f: all input channels, all taps and the bias are accumulated
+    // at the product scale, then rescaled once per output pixel.
+    TaskScheduler::instance().parallel_for(n_images, n_filters, [&](size_t img, size_t f) {
+        CipherTensor channel_out = result.slice(img).slice(f);
+        convolute2d(input.slice(img), weights_[f], stride_, padding_, he_, channel_out, bias ? &(*bias)[f] : nullptr);
+    });
+}
 
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> result;
-    result.resize(n_images); // Number of images
-
-    for (size_t img = 0; img < n_images; img++) { // Loop over images
-        result[img].resize(n_filters); // Number of output channels
-
-        // For each output channel f
-        for (size_t f = 0; f < n_filters; f++) {
-            std::vector<std::vector<seal::Ciphertext>> filter_sum_2d;
-
-            // For each input channel in_c, apply the corresponding filter weights_[f][in_c]
-            for (size_t in_c = 0; in_c < n_input_channels; in_c++) {
-                // Use the weight corresponding to output channel f and input channel in_c.
-                // Note: weights_[f][in_c] is a 2D vector of Plaintext.
-                auto conv_layer = convolute2d(padded_input[img][in_c], weights_[f][in_c], stride_, he_); 
-                if (in_c == 0) {
-                    filter_sum_2d = conv_layer; 
-                } else {
-                    // Ensure dimensions match before summing.
-                    if (filter_sum_2d.size() != conv_layer.size() || 
-                        (filter_sum_2d.size() > 0 && filter_sum_2d[0].size() != conv_layer[0].size())) {
-                        throw std::runtime_error("Mismatch in output size while summing channels.");
-                    }
-                    // Sum contributions from each input channel.
-                    for (size_t yy = 0; yy < filter_sum_2d.size(); yy++) {
-                        for (size_t xx = 0; xx < filter_sum_2d[yy].size(); xx++) {
-                            he_.evaluator_->add_inplace(filter_sum_2d[yy][xx], conv_layer[yy][xx]); 
+void Conv2d::prepare(const seal::parms_id_type &parms_id, double scale) const
+{
+    bias_at(parms_id, scale);
+}
+
+const std::vector<ScalarConstant> *Conv2d::bias_at(const seal::parms_id_type &parms_id, double scale) const
+{
+    if (raw_bias_.empty()) {
+        return nullptr;
+    }
+    // The bias joins the fused sum before the rescale: at the input level and the product scale
+    double product_scale = scale * weights_[0][0][0][0].scale;
+    return &bias_bank_.get(parms_id, scale, [&] {
+        std::vector<ScalarConstant> bias;
+        for (double b : raw_bias_) {
+            bias.push_back(he_.encodeScalar(b, parms_id, product_scale));
+        }
+        return bias;
+    });
+}
+
+CipherTensor Conv2d::operator()(CipherTensor &&input) const
+{
+    // A one-stage row pipeline: each output row runs once its window is complete, and input rows
+    // above the lowest pending window are freed
+    return run_row_pipeline({ make_row_stage(this) }, std::move(input)).back();
+}
+
+std::vector<size_t> Conv2d::output_shape(const std::vector<size_t> &input_shape) const
+{
+    if (input_shape.size() != 3 || input_shape[0] != raw_weights_[0].size()) {
+        throw std::runtime_error("Conv2d: input channels do not match the filters.");
+    }
+    int y_f = static_cast<int>(raw_weights_[0][0].size());
+    int x_f = static_cast<int>(raw_weights_[0][0][0].size());
+    if (padding_.first < 0 || padding_.second < 0 || padding_.first >= y_f || padding_.second >= x_f) {
+        throw std::runtime_error("Padding must be non-negative and smaller than the kernel.");
+    }
+    return { raw_weights_.size(),
+             sliding_window_output_size(input_shape[1], y_f, stride_.first, padding_.first),
+             sliding_window_output_size(input_shape[2], x_f, stride_.second, padding_.second) };
+}
+
+std::pair<size_t, size_t> Conv2d::input_rows(size_t out_row, size_t in_height) const
+{
+    return sliding_window_input_rows(out_row, in_height, raw_weights_[0][0].size(), stride_.first, padding_.first);
+}
+
+void Conv2d::forward_row(const CipherTensor &image, CipherTensor &output, size_t out_row) const
+{
+    // Only the rows under this output row's window have to be complete (and aligned)
+    std::pair<size_t, size_t> rows = input_rows(out_row, image.dim(1));
+    std::vector<const seal::Ciphertext *> window;
+    for (size_t c = 0; c < image.dim(0); c++)
+        for (size_t y = rows.first; y < rows.second; y++)
+            for (size_t x = 0; x < image.dim(2); x++) window.push_back(&image(c, y, x));
+    he_.check_aligned(window);
+    const std::vector<ScalarConstant> *bias = bias_at(window[0]->parms_id(), window[0]->scale());
+
+    // One task per (filter, output column) of the row
+    TaskScheduler::instance().parallel_for(weights_.size(), output.dim(2), [&](size_t f, size_t ox) {
+        output(f, out_row, ox) = convolute2d_pixel(
+            image, weights_[f], stride_, padding_, he_, static_cast<int>(out_row), static_cast<int>(ox),
+            bias ? &(*bias)[f] : nullptr);
+    });
+}
+
+/*************************************************************
+ * Packed (rotation-based) convolution
+ *************************************************************/
+PackedLayout Conv2d::output_layout(const PackedLayout &layout) const
+{
+    std::pair<int,int> kernel_size = {
+        static_cast<int>(raw_weights_[0][0].size()), static_cast<int>(raw_weights_[0][0][0].size()) };
+    return packed_window_layout(layout, kernel_size, stride_, padding_, raw_weights_.size());
+}
+
+std::vector<int> Conv2d::rotation_steps(const PackedLayout &layout) const
+{
+    int y_f = static_cast<int>(raw_weights_[0][0].size());
+    int x_f = static_cast<int>(raw_weights_[0][0][0].size());
+
+    std::vector<int> steps;
+    for (int fx = 0; fx < x_f; fx++) {
+        steps.push_back(packed_col_step(layout, padding_, fx));
+    }
+    for (int k = 0; k < static_cast<int>(layout.channels_per_ct); k++) {
+        for (int fy = 0; fy < y_f; fy++) {
+            steps.push_back(k * static_cast<int>(layout.channel_stride) + packed_row_step(layout, padding_, fy));
+        }
+    }
+    return steps;
+}
+
+std::shared_ptr<const Conv2d::PackedPlan> Conv2d::packed_plan(const PackedLayout &layout) const
+{
+    std::shared_ptr<const PackedPlan> current = std::atomic_load(&packed_plan_);
+    if (current && current->layout == layout) {
+        return current;
+    }
+
+    size_t n_filters = raw_weights_.size();
+    size_t n_input_channels = raw_weights_[0].size();
+    int y_f = static_cast<int>(raw_weights_[0][0].size());
+    int x_f = static_cast<int>(raw_weights_[0][0][0].size());
+    int slots = static_cast<int>(he_.slot_count());
+
+    if (layout.channels != n_input_channels)
+        throw std::runtime_error("Packed Conv2d: input channels do not match the filter bank.");
+    if (layout.channels_per_ct * layout.channel_stride != static_cast<size_t>(slots))
+        throw std::runtime_error("Packed Conv2d: channel blocks must tile all slots.");
+
+    PackedLayout out = output_layout(layout);
+    if (out.span() > layout.channel_stride)
+        throw std::runtime_error("Packed Conv2d: output does not fit in its slot block.");
+
+    int n = static_cast<int>(layout.channels_per_ct);
+    int block = static_cast<int>(layout.channel_stride);
+    size_t n_in_cts = layout.n_ciphertexts();
+    size_t n_out_cts = out.n_ciphertexts();
+
+    auto plan = std::make_shared<PackedPlan>();
+    plan->layout = layout;
+    plan->weights.assign(n_out_cts, std::vector<std::vector<std::vector<std::vector<seal::Plaintext>>>>(
+        n_in_cts, std::vector<std::vector<std::vector<seal::Plaintext>>>(
+            n, std::vector<std::vector<seal::Plaintext>>(y_f, std::vector<seal::Plaintext>(x_f)))));
+    plan->tap_used.assign(n_out_cts, std::vector<std::vector<std::vector<std::vector<char>>>>(
+        n_in_cts, std::vector<std::vector<std::vector<char>>>(
+            n, std::vector<std::vector<char>>(y_f, std::vector<char>(x_f, 0)))));
+
+    TaskScheduler::instance().parallel_for(y_f, x_f, [&](int fy, int fx) {
+        std::vector<size_t> hits = packed_tap_slots(layout, out, stride_, padding_, fy, fx);
+        if (hits.empty()) return;
+        int row_step = packed_row_step(layout, padding_, fy);
+
+        for (size_t o = 0; o < n_out_cts; o++) {
+            for (size_t i = 0; i < n_in_cts; i++) {
+                for (int k = 0; k < n; k++) {
+                    // Block c of diagonal k carries input channel i*n + c into output filter o*n + (c - k).
+                    // The giant step rotates by k blocks plus row_step, so block c's taps sit at
+                    // c*block + hit + row_step (the k block shift cancels out).
+                    std::vector<double> mask(slots, 0.0);
+                    bool used = false;
+                    for (int c = 0; c < n; c++) {
+                        size_t in_c = i * n + c;
+                        size_t f = o * n + ((c - k) % n + n) % n;
+                        if (in_c >= n_input_channels || f >= n_filters) continue;
+
+                        double w = raw_weights_[f][in_c][fy][fx];
+                        if (w == 0.0) continue;
+                        for (size_t hit : hits) {
+                            int slot = c * block + static_cast<int>(hit) + row_step;
+                            mask[((slot % slots) + slots) % slots] = w;
                         }
+                        used = true;
                     }
-                }
+                    if (!used) continue;
 
-                // conv_layer.clear();
-                // conv_layer.shrink_to_fit();
+                    plan->weights[o][i][k][fy][fx] = he_.encodeVectorPacked(mask);
+                    plan->tap_used[o][i][k][fy][fx] = true;
+                }
             }
+        }
+    });
+
+    // Publish with a compare-and-swap, never under a lock: the build waits on parallel_for, whose
+    // waiting thread may run another packed pass of this layer. A pass that lost the race to a plan
+    // for the same layout drops its own copy.
+    std::shared_ptr<const PackedPlan> built = plan;
+    while (!std::atomic_compare_exchange_weak(&packed_plan_, &current, built)) {
+        if (current && current->layout == layout) {
+            return current;
+        }
+    }
+    return built;
+}
+
+const std::vector<seal::Plaintext> *Conv2d::packed_bias(
+    const PackedPlan &plan, seal::parms_id_type parms_id, double scale) const
+{
+    if (raw_bias_.empty()) {
+        return nullptr;
+    }
 
-            // Add bias for this output channel if provided.
-            if (!bias_.empty()) {
-                auto &bias_pt = bias_[f];
-            
-                // Parallelize the nested loops
-                #pragma omp parallel for collapse(2)
-                for (size_t i = 0; i < filter_sum_2d.size(); ++i) {
-                    for (size_t j = 0; j < filter_sum_2d[i].size(); ++j) {
-                        auto &ciph = filter_sum_2d[i][j];
-            
-                        // OpenMP threads may cause race conditions if bias_pt is modified in place
-                        // Ensure thread safety by working on a thread-local copy
-                        auto bias_pt_local = bias_pt;
-            
-                        he_.evaluator_->mod_switch_to_inplace(bias_pt_local, ciph.parms_id());
-                        bias_pt_local.scale() = ciph.scale();
-                        he_.evaluator_->add_plain_inplace(ciph, bias_pt_local);
+    // Bias only on the output pixels, so the remaining slots stay zero. It is encoded at the level and
+    // scale of the un-rescaled products, so it joins the sum before the single rescale.
+    return &plan.bias.get(parms_id, scale, [&] {
+        PackedLayout out = output_layout(plan.layout);
+        size_t n = plan.layout.channels_per_ct;
+        size_t n_filters = raw_weights_.size();
+        size_t n_out_cts = out.n_ciphertexts();
+
+        std::vector<seal::Plaintext> encoded(n_out_cts);
+        for (size_t o = 0; o < n_out_cts; o++) {
+            std::vector<double> bias(he_.slot_count(), 0.0);
+            for (size_t f = o * n; f < std::min((o + 1) * n, n_filters); f++) {
+                for (size_t oy = 0; oy < out.height; oy++) {
+                    for (size_t ox = 0; ox < out.width; ox++) {
+                        bias[out.slot(f, oy, ox)] = raw_bias_[f];
                     }
                 }
             }
-
-            std::cout << "Done \n" ;
-            // Store the result for this output channel.
-            result[img][f] = filter_sum_2d;
-
-            // Free memory
-            // for (auto& row : filter_sum_2d) {
-            //     row.clear();  // Clear each inner vector
-            //     row.shrink_to_fit();  // Free inner memory
-            // }
-            // filter_sum_2d.clear();  // Clear the outer vector
-            // filter_sum_2d.shrink_to_fit();  // Free outer memory
+            encoded[o] = he_.encodeVectorPacked(bias, parms_id, scale);
         }
-    }
+        return encoded;
+    });
+}
+
+PackedTensor Conv2d::operator()(const PackedTensor &input) const
+{
+    std::shared_ptr<const PackedPlan> plan = packed_plan(input.layout);
 
+    PackedTensor result;
+    result.layout = output_layout(input.layout);
+    result.data = CipherTensor({ input.n_images(), result.layout.n_ciphertexts() });
 
-    // padded_input.clear();
-    // padded_input.shrink_to_fit();
+    for (size_t img = 0; img < input.n_images(); img++) {
+        CipherTensor image_out = result.data.slice(img);
+        convolute2d_packed(
+            input.data.slice(img), plan->weights, plan->tap_used, input.layout, padding_, he_, image_out);
+
+        // Products are at input scale * mask scale: add the bias there, then rescale once
+        const seal::Ciphertext &ref = image_out[0];
+        const std::vector<seal::Plaintext> *bias = packed_bias(*plan, ref.parms_id(), ref.scale());
+
+        TaskScheduler::instance().parallel_for(image_out.size(), [&](size_t o) {
+            auto &ciph = image_out[o];
+            if (bias) {
+                he_.evaluator().add_plain_inplace(ciph, (*bias)[o]);
+            }
+            he_.evaluator().rescale_to_next_inplace(ciph, he_.pool());
+        });
+    }
     return result;
 }
 
 /*************************************************************
- * apply_padding
+ * convolute2d_packed
  *************************************************************/
-std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>
-apply_padding(
-    const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input,
-    std::pair<int,int> padding,
-    CKKSPyfhel &he
-)
+void convolute2d_packed(
+    const CipherTensor &image,
+    const std::vector<std::vector<std::vector<std::vector<std::vector<seal::Plaintext>>>>> &masks,
+    const std::vector<std::vector<std::vector<std::vector<std::vector<char>>>>> &tap_used,
+    const PackedLayout &layout,
+    std::pair<int, int> padding,
+    const CKKSPyfhel &he,
+    CipherTensor &output)
 {
-    int y_pad = padding.first;
-    int x_pad = padding.second;
+    int n_out_cts = static_cast<int>(masks.size());
+    int n_in_cts = static_cast<int>(image.size());
+    int n_diagonals = static_cast<int>(masks[0][0].size());
+    int y_f = static_cast<int>(masks[0][0][0].size());
+    int x_f = static_cast<int>(masks[0][0][0][0].size());
+    const seal::GaloisKeys &galois_keys = he.get_galois_keys();
+
+    if (n_in_cts != static_cast<int>(masks[0].size()))
+        throw std::runtime_error("Packed convolution: input ciphertexts do not match the filter bank.");
+    if (output.size() != static_cast<size_t>(n_out_cts))
+        throw std::runtime_error("Packed convolution: output does not match the filter bank.");
+
+    // Checked once up front rather than in every task (a task's exception would still reach the
+    // caller: TaskGroup::wait rethrows the first one)
+    std::vector<const seal::Ciphertext *> inputs;
+    for (const auto &ct : image) inputs.push_back(&ct);
+    he.check_aligned(inputs);
+    for (int o = 0; o < n_out_cts; o++) {
+        bool any_tap = false;
+        for (const auto &in_ct : tap_used[o])
+            for (const auto &diagonal : in_ct)
+                for (const auto &row : diagonal)
+                    for (bool used : row) any_tap = any_tap || used;
+        if (!any_tap)
+            throw std::runtime_error("Packed convolution: output channels have no non-zero weights.");
+    }
 
-    if (y_pad == 0 && x_pad == 0)
-    {
-        return input;
+    // Rotations need size-2 ciphertexts: relinearize lazily squared inputs once, up front
+    std::vector<seal::Ciphertext> relinearized(n_in_cts);
+    std::vector<const seal::Ciphertext *> sources(n_in_cts);
+    for (int i = 0; i < n_in_cts; i++) {
+        sources[i] = &image[i];
+        if (image[i].size() > 2) {
+            relinearized[i] = seal::Ciphertext(he.pool());
+            relinearized[i] = image[i];
+            he.relinearize_inplace(relinearized[i]);
+            sources[i] = &relinearized[i];
+        }
     }
 
-    // Create a ciphertext that encrypts zero.
-    seal::Ciphertext zero_ct = he.encrypt(0.0);
+    // Baby steps: one rotation per (input ciphertext, horizontal tap), shared by all filters and rows
+    std::vector<std::vector<seal::Ciphertext>> shifted(n_in_cts, std::vector<seal::Ciphertext>(x_f));
+    TaskScheduler::instance().parallel_for(n_in_cts, x_f, [&](int i, int fx) {
+        int step = packed_col_step(layout, padding, fx);
+        shifted[i][fx] = seal::Ciphertext(he.pool());
+        if (step == 0) {
+            shifted[i][fx] = *sources[i];
+        } else {
+            he.evaluator().rotate_vector(*sources[i], step, galois_keys, shifted[i][fx], he.pool());
+        }
+    });
+
+    // Giant steps: one partial sum per (output ciphertext, diagonal)
+    std::vector<std::vector<seal::Ciphertext>> partial(n_out_cts, std::vector<seal::Ciphertext>(n_diagonals));
+    std::vector<std::vector<char>> partial_used(n_out_cts, std::vector<char>(n_diagonals, 0));
+
+    TaskScheduler::instance().parallel_for(n_out_cts, n_diagonals, [&](int o, int k) {
+        seal::Ciphertext accum_ct;
+        bool accum_empty = true;
+
+        for (int fy = 0; fy < y_f; fy++) {
+            // Fused sum of the masked products of this kernel row over input ciphertexts and
+            // horizontal taps; the masks are read at the input level, so no mod_switch is needed
+            Recycled<std::vector<const seal::Ciphertext *>> row_cts;
+            Recycled<std::vector<const seal::Plaintext *>> row_pts;
+            row_cts->clear();
+            row_pts->clear();
+            for (int i = 0; i < n_in_cts; i++) {
+                for (int fx = 0; fx < x_f; fx++) {
+                    if (!tap_used[o][i][k][fy][fx]) continue;
+                    row_cts->push_back(&shifted[i][fx]);
+                    row_pts->push_back(&masks[o][i][k][fy][fx]);
+                }
+            }
+            if (row_cts->empty()) continue;
 
-    auto output = input; // Copy input to output.
-    for (size_t img = 0; img < output.size(); img++)
-    {
-        for (size_t l = 0; l < output[img].size(); l++)
-        {
-            size_t old_y = output[img][l].size();
-            size_t old_x = (old_y > 0) ? output[img][l][0].size() : 0;
-            size_t new_y = old_y + 2 * y_pad;
-            size_t new_x = old_x + 2 * x_pad;
+            seal::Ciphertext row_ct;
+            he.multiply_plain_accumulate(*row_cts, *row_pts, row_ct);
 
-            std::vector<std::vector<seal::Ciphertext>> padded(
-                new_y, std::vector<seal::Ciphertext>(new_x, zero_ct)
-            );
+            // Giant step on the un-rescaled row; every row and diagonal lands on one scale
+            int step = k * static_cast<int>(layout.channel_stride) + packed_row_step(layout, padding, fy);
+            if (step != 0) {
+                he.evaluator().rotate_vector_inplace(row_ct, step, galois_keys, he.pool());
+            }
 
-            for (size_t yy = 0; yy < old_y; yy++)
-            {
-                for (size_t xx = 0; xx < old_x; xx++)
-                {
-                    padded[yy + y_pad][xx + x_pad] = output[img][l][yy][xx];
-                }
+            if (accum_empty) {
+                accum_ct = std::move(row_ct);
+                accum_empty = false;
+            } else {
+                he.evaluator().add_inplace(accum_ct, row_ct);
             }
+        }
 
-            output[img][l] = std::move(padded);
+        if (!accum_empty) {
+            partial[o][k] = std::move(accum_ct);
+            partial_used[o][k] = 1;
+        }
+    });
+
+    // Sum the diagonals of each output ciphertext
+    for (int o = 0; o < n_out_cts; o++) {
+        bool first = true;
+        for (int k = 0; k < n_diagonals; k++) {
+            if (!partial_used[o][k]) continue;
+            if (first) {
+                output[o] = std::move(partial[o][k]);
+                first = false;
+            } else {
+                he.evaluator().add_inplace(output[o], partial[o][k]);
+            }
         }
     }
+}
 
-    return output;
+/*************************************************************
+ * sliding_window_output_size
+ *************************************************************/
+size_t sliding_window_output_size(size_t input, size_t kernel, int stride, int padding)
+{
+    if (stride <= 0 || padding < 0 || input + 2 * padding < kernel)
+        throw std::runtime_error("Window does not fit the input. Check stride and padding.");
+    return (input + 2 * padding - kernel) / stride + 1;
+}
+
+std::pair<size_t, size_t> sliding_window_input_rows(size_t out_row, size_t in_height, size_t kernel, int stride, int padding)
+{
+    long top = static_cast<long>(out_row) * stride - padding;
+    size_t first = static_cast<size_t>(std::max(0L, top));
+    size_t last = static_cast<size_t>(std::max(0L, std::min(static_cast<long>(in_height), top + static_cast<long>(kernel))));
+    return { std::min(first, last), last };
 }
 
 /*************************************************************
  * convolute2d
  *************************************************************/
-std::vector<std::vector<seal::Ciphertext>> convolute2d(
-    const std::vector<std::vector<seal::Ciphertext>> &image,
-    const std::vector<std::vector<seal::Plaintext>> &filter_matrix,
+void convolute2d(
+    const CipherTensor &image,
+    const std::vector<std::vector<std::vector<ScalarConstant>>> &filter,
     std::pair<int, int> stride,
-    CKKSPyfhel &he)
+    std::pair<int, int> padding,
+    const CKKSPyfhel &he,
+    CipherTensor &output,
+    const ScalarConstant *bias)
 {
-    int y_d = static_cast<int>(image.size());
-    int x_d = (y_d > 0) ? static_cast<int>(image[0].size()) : 0;
-    int y_f = static_cast<int>(filter_matrix.size());
-    int x_f = (y_f > 0) ? static_cast<int>(filter_matrix[0].size()) : 0;
-
+    if (image.ndim() != 3)
+        throw std::runtime_error("convolute2d expects a 3D image [channels, height, width].");
+    int n_c = static_cast<int>(image.dim(0));
+    int y_d = static_cast<int>(image.dim(1));
+    int x_d = static_cast<int>(image.dim(2));
+    int y_f = (n_c > 0) ? static_cast<int>(filter[0].size()) : 0;
+    int x_f = (y_f > 0) ? static_cast<int>(filter[0][0].size()) : 0;
+
+    if (static_cast<int>(filter.size()) != n_c)
+        throw std::runtime_error("Filter channels do not match input channels.");
     if (y_f == 0 || x_f == 0)
         throw std::runtime_error("Kernel size is zero, cannot apply convolution.");
     if (stride.first <= 0 || stride.second <= 0)
         throw std::runtime_error("Stride must be positive.");
-    if (y_d < y_f || x_d < x_f)
+    if (padding.first < 0 || padding.second < 0 || padding.first >= y_f || padding.second >= x_f)
+        throw std::runtime_error("Padding must be non-negative and smaller than the kernel.");
+    if (y_d + 2 * padding.first < y_f || x_d + 2 * padding.second < x_f)
         throw std::runtime_error("Filter size is larger than input size.");
 
-    int y_out = ((y_d - y_f) / stride.first) + 1;
-    int x_out = ((x_d - x_f) / stride.second) + 1;
+    int y_out = ((y_d + 2 * padding.first - y_f) / stride.first) + 1;
+    int x_out = ((x_d + 2 * padding.second - x_f) / stride.second) + 1;
 
     if (y_out <= 0 || x_out <= 0)
         throw std::runtime_error("Output size is zero or negative. Check stride and padding.");
+    if (output.shape() != std::vector<size_t>{ static_cast<size_t>(y_out), static_cast<size_t>(x_out) })
+        throw std::runtime_error("convolute2d: output view does not match the output size.");
+
+    // Every pixel of every channel must share one level and scale, so all products land on one
+    // scale and can be summed before the single rescale.
+    std::vector<const seal::Ciphertext *> all_pixels;
+    for (const auto &ct : image) all_pixels.push_back(&ct);
+    he.check_aligned(all_pixels);
+
+    // One task per output position
+    TaskScheduler::instance().parallel_for(y_out, x_out, [&](int oy, int ox) {
+        output(oy, ox) = convolute2d_pixel(image, filter, stride, padding, he, oy, ox, bias);
+    });
+}
 
-    std::vector<std::vector<seal::Ciphertext>> result(y_out, std::vector<seal::Ciphertext>(x_out));
-
-    seal::Ciphertext zero_ct = he.encrypt(0.0);
-
-    // Process the image in parallel for each output position
-    #pragma omp parallel for collapse(2)
-    for (int oy = 0; oy < y_out; oy++)
+/*************************************************************
+ * convolute2d_pixel
+ *************************************************************/
+seal::Ciphertext convolute2d_pixel(
+    const CipherTensor &image,
+    const std::vector<std::vector<std::vector<ScalarConstant>>> &filter,
+    std::pair<int, int> stride,
+    std::pair<int, int> padding,
+    const CKKSPyfhel &he,
+    int oy,
+    int ox,
+    const ScalarConstant *bias)
+{
+    int n_c = static_cast<int>(image.dim(0));
+    int y_d = static_cast<int>(image.dim(1));
+    int x_d = static_cast<int>(image.dim(2));
+    int y_f = static_cast<int>(filter[0].size());
+    int x_f = static_cast<int>(filter[0][0].size());
+
+    int sub_y = oy * stride.first - padding.first;
+    int sub_x = ox * stride.second - padding.second;
+
+    // Point at the patch and filter values of every channel (no copies). Taps on the
+    // padding border multiply zero, so they are skipped instead of materialized; since
+    // padding < kernel size, every window keeps at least one in-bounds tap.
+    // The pointer lists are recycled from pixel to pixel on each thread.
+    Recycled<std::vector<const seal::Ciphertext *>> image_patch;
+    Recycled<std::vector<const ScalarConstant *>> filter_patch;
+    image_patch->clear();
+    filter_patch->clear();
+
+    for (int c = 0; c < n_c; c++)
     {
-        for (int ox = 0; ox < x_out; ox++)
+        for (int fy = 0; fy < y_f; fy++)
         {
-            int sub_y = oy * stride.first;
-            int sub_x = ox * stride.second;
-
-            std::vector<seal::Ciphertext> image_patch;
-            std::vector<seal::Plaintext> filter_patch;
-            image_patch.reserve(y_f * x_f);
-            filter_patch.reserve(y_f * x_f);
-
-            // Extract patch and filter values
-            for (int fy = 0; fy < y_f; fy++)
+            int y = sub_y + fy;
+            if (y < 0 || y >= y_d) continue;
+            for (int fx = 0; fx < x_f; fx++)
             {
-                for (int fx = 0; fx < x_f; fx++)
-                {
-                    image_patch.push_back(image[sub_y + fy][sub_x + fx]);
-                    filter_patch.push_back(filter_matrix[fy][fx]);
-                }
+                int x = sub_x + fx;
+                if (x < 0 || x >= x_d) continue;
+                image_patch->push_back(&image(c, y, x));
+                filter_patch->push_back(&filter[c][fy][fx]);
             }
-
-            // Perform batch multiplication
-            std::vector<seal::Ciphertext> products = multiply_ciphertext_plain_batch(he, image_patch, filter_patch);
-
-            // Accumulate result
-            seal::Ciphertext accum_ct = zero_ct;
-            for (const auto &prod : products)
-            {
-                he.evaluator_->mod_switch_to_inplace(accum_ct, prod.parms_id());
-                accum_ct.scale() = prod.scale();
-                he.evaluator_->add_inplace(accum_ct, prod);
-            }
-
-            result[oy][ox] = std::move(accum_ct);
-
-            // Explicitly free memory before next iteration
-            // image_patch.clear();
-            // image_patch.shrink_to_fit();
-            // filter_patch.clear();
-            // filter_patch.shrink_to_fit();
-            // products.clear();         
-            // products.shrink_to_fit(); 
-
         }
     }
 
-    return result;
+    // Fused dot product over channels and taps, bias at the product scale, one rescale
+    seal::Ciphertext accum_ct;
+    he.multiply_const_accumulate(*image_patch, *filter_patch, accum_ct);
+    if (bias)
+        he.add_const_inplace(accum_ct, *bias);
+    he.evaluator().rescale_to_next_inplace(accum_ct, he.pool());
+    he.relinearize_inplace(accum_ct); // Once per output for lazily squared inputs
+    return accum_ct;
 }
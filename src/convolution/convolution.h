@@ -3,14 +3,21 @@
 
 #include <vector>
 #include <utility>   // for std::pair
+#include <memory>
 #include "he/he.h" // Your CKKSPyfhel class
+#include "layer/layer.h"
+#include "runtime/constantBank.h"
 
 /**
  * Conv2d class simulates a 2D convolution layer with homomorphic encryption.
- * - Weights and bias are stored as Plaintext arrays (encoded via CKKS).
+ * - Weights are stored as ScalarConstant arrays (per-prime residues, no Plaintext);
+ *   the bias is encoded once per input level and scale, at the product scale it is added at,
+ *   and shared read-only by all threads (ConstantBank).
  * - Inputs are ciphertext arrays.
+ * - Forward passes are const and reentrant: one layer serves concurrent requests. Packed plans
+ *   are built once per input layout and shared read-only.
  */
-class Conv2d {
+class Conv2d : public RowLayer {
 public:
     /**
      * @brief Constructor
@@ -21,66 +28,216 @@ public:
      * @param bias       (optional) 1D array of double to encode as plaintext, length = n_filters
      */
     Conv2d(
-        CKKSPyfhel &he,
+        const CKKSPyfhel &he,
         const std::vector<std::vector<std::vector<std::vector<double>>>> &weights,
         std::pair<int,int> stride = {1, 1},
         std::pair<int,int> padding = {0, 0},
         const std::vector<double> &bias = {}
     );
 
+    /**
+     * @brief Constructor from weights encoded ahead of time (e.g. loaded from a ModelPlan)
+     * @param he              Must have the encryption parameters the weights were encoded with
+     * @param encoded_weights encodeScalar() of each weight, same shape as weights
+     * @param weights         Raw weights (packed kernel masks), shape [n_filters, n_input_channels, fh, fw]
+     */
+    Conv2d(
+        const CKKSPyfhel &he,
+        std::vector<std::vector<std::vector<std::vector<ScalarConstant>>>> encoded_weights,
+        const std::vector<std::vector<std::vector<std::vector<double>>>> &weights,
+        std::pair<int,int> stride,
+        std::pair<int,int> padding,
+        const std::vector<double> &bias = {}
+    );
+
     /**
      * @brief Perform convolution on a batch of encrypted images.
-     * @param input A 4D array of Ciphertext: [n_images, n_input_channels, height, width]
-     * @return A 4D array of Ciphertext: [n_images, n_filters, out_height, out_width]
+     * @param input CipherTensor [n_images, n_input_channels, height, width]
+     *              With batch-packed input (CKKSPyfhel::encryptTensorBatched) each "image"
+     *              is a group of up to slot_count() images, one per slot.
+     * @return CipherTensor [n_images, n_filters, out_height, out_width]
      */
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>
-    operator()(const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input);
+    CipherTensor operator()(const CipherTensor &input) const;
+
+    /**
+     * @brief Same convolution, consuming the input: rows of each image are released as soon as
+     *        no remaining output row reads them, so input and output are never both whole in memory.
+     *        An input shared with other tensors is left untouched.
+     */
+    CipherTensor operator()(CipherTensor &&input) const override;
+
+    /**
+     * @brief Layer interface: convolve input [n_images, n_input_channels, height, width] into output,
+     *        preallocated as [n_images, n_filters, out_height, out_width] (infer_shape).
+     */
+    void forward(const CipherTensor &input, CipherTensor &output) const override;
+
+    /**
+     * @brief Perform convolution on slot-packed images using rotations.
+     * @param input PackedTensor [n_images][n_input_ciphertexts]; channels may be multiplexed
+     * @return PackedTensor [n_images][n_output_ciphertexts], multiplexed like the input. Outputs stay in
+     *         place: pixel (y, x) sits at the slot of input pixel (y * y_stride, x * x_stride), so strides
+     *         widen instead of compacting. Slots outside the output pixels are zero.
+     */
+    PackedTensor operator()(const PackedTensor &input) const;
+
+    /**
+     * @brief Levels (rescales) one forward pass consumes.
+     */
+    size_t depth() const override { return 1; }
+
+    /**
+     * @brief Encode the bias for inputs at this level and scale (see Layer::prepare).
+     */
+    void prepare(const seal::parms_id_type &parms_id, double scale) const override;
+
+    /**
+     * @brief Rotation steps used by the packed kernel for a given input layout.
+     *        Pass them to CKKSPyfhel::generate_rotation_keys before running packed inputs.
+     */
+    std::vector<int> rotation_steps(const PackedLayout &layout) const;
+
+    /**
+     * @brief Layout of the packed output for a given input layout.
+     */
+    PackedLayout output_layout(const PackedLayout &layout) const;
+
+    /**
+     * @brief Row interface for the dataflow pipeline (Sequential::setPipelined).
+     *        output_shape maps [n_input_channels, height, width] to [n_filters, out_height, out_width];
+     *        input_rows gives the input rows [first, last) read by one output row;
+     *        forward_row computes output row out_row (all filters) of one image view.
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t> &input_shape) const override;
+    std::pair<size_t, size_t> input_rows(size_t out_row, size_t in_height) const override;
+    void forward_row(const CipherTensor &image, CipherTensor &output, size_t out_row) const override;
 
 private:
     // Reference to the homomorphic encryption object
-    CKKSPyfhel &he_;
+    const CKKSPyfhel &he_;
     
-    // 4D array of Plaintexts for weights.
+    // 4D array of scalar constants for weights.
     // [n_filters][n_input_channels][filter_height][filter_width]
-    std::vector<std::vector<std::vector<std::vector<seal::Plaintext>>>> weights_;
-
-    // 1D array of Plaintexts for bias, with length = n_filters.
-    // If empty, no bias is used.
-    std::vector<seal::Plaintext> bias_;
+    std::vector<std::vector<std::vector<std::vector<ScalarConstant>>>> weights_;
 
     // (y_stride, x_stride) and (y_padding, x_padding)
     std::pair<int,int> stride_;
     std::pair<int,int> padding_;
+
+    // Raw weights, kept to build slot masks for packed inputs
+    std::vector<std::vector<std::vector<std::vector<double>>>> raw_weights_;
+
+    // Bias, length = n_filters. If empty, no bias is used.
+    std::vector<double> raw_bias_;
+
+    // Bias per filter at the input level and the product scale, keyed by the input (level, scale)
+    ConstantBank<std::vector<ScalarConstant>> bias_bank_;
+
+    // Encoded bias for inputs at (parms_id, scale), or nullptr without a bias
+    const std::vector<ScalarConstant> *bias_at(const seal::parms_id_type &parms_id, double scale) const;
+
+    // Plaintexts of the packed kernel for one input layout; read-only once built
+    struct PackedPlan {
+        PackedLayout layout;
+
+        // Masked weights [n_output_cts][n_input_cts][channels_per_ct][filter_height][filter_width]:
+        // diagonal k pairs input block c with output block c - k, and is rotated into place by
+        // k channel blocks. Each mask holds the tap weights at the output slots where the tap is
+        // in bounds, pre-rotated for its giant step.
+        std::vector<std::vector<std::vector<std::vector<std::vector<seal::Plaintext>>>>> weights;
+        std::vector<std::vector<std::vector<std::vector<std::vector<char>>>>> tap_used;
+
+        // Bias per output ciphertext, encoded at the level and scale of the un-rescaled products.
+        // One entry per (level, scale) met so far; entries are never removed.
+        ConstantBank<std::vector<seal::Plaintext>> bias;
+    };
+
+    // Plan of the most recent packed layout, swapped (never modified) when the layout changes,
+    // so passes still running on the old plan keep it alive. Accessed with std::atomic_load/CAS only.
+    mutable std::shared_ptr<const PackedPlan> packed_plan_;
+
+    // Plan for an input layout, built on first use
+    std::shared_ptr<const PackedPlan> packed_plan(const PackedLayout &layout) const;
+
+    // Packed bias at the given level and product scale, encoded on first use (nullptr without a bias)
+    const std::vector<seal::Plaintext> *packed_bias(const PackedPlan &plan, seal::parms_id_type parms_id, double scale) const;
 };
 
 /**
- * @brief Zero-pad a batch of images.
- * @param input A 4D array: [n_images, n_channels, y, x]
- * @param padding (y_pad, x_pad)
- * @param he  Used to create a ciphertext that decrypts to zero.
- * @return The padded 4D array.
+ * @brief 2D convolution between a multi-channel ciphertext image and one constant filter.
+ *        Products over all channels and taps (and the bias) are summed at the product scale
+ *        and rescaled once per output pixel.
+ * @param image  CipherTensor view [n_input_channels, height, width], one level and scale
+ * @param filter 3D ScalarConstant array [n_input_channels, filter_height, filter_width]
+ * @param stride (y_stride, x_stride)
+ * @param padding (y_pad, x_pad), each smaller than the kernel. Virtual: taps on the zero border are skipped.
+ * @param he Used for HE operations (fused dot product, rescale)
+ * @param output CipherTensor view [out_height, out_width] that receives the result
+ * @param bias Added to every output pixel, encoded at the image's level and the product scale
+ *             (nullptr = no bias)
  */
-std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>
-apply_padding(
-    const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input,
+void convolute2d(
+    const CipherTensor &image,
+    const std::vector<std::vector<std::vector<ScalarConstant>>> &filter,
+    std::pair<int,int> stride,
     std::pair<int,int> padding,
-    CKKSPyfhel &he
+    const CKKSPyfhel &he,
+    CipherTensor &output,
+    const ScalarConstant *bias = nullptr
 );
 
 /**
- * @brief 2D convolution between a ciphertext image and a plaintext filter.
- * @param image 2D ciphertext array [height, width]
- * @param filter_matrix 2D plaintext array [filter_height, filter_width]
- * @param stride (y_stride, x_stride)
- * @param he Used for HE operations (multiplyPlain, sum, etc.)
- * @return 2D ciphertext array [out_height, out_width]
+ * @brief One output pixel (oy, ox) of convolute2d, rescaled (and relinearized if the inputs are size 3).
+ *        The caller checks the window's alignment and the padding.
  */
-std::vector<std::vector<seal::Ciphertext>>
-convolute2d(
-    const std::vector<std::vector<seal::Ciphertext>> &image,
-    const std::vector<std::vector<seal::Plaintext>> &filter_matrix,
+seal::Ciphertext convolute2d_pixel(
+    const CipherTensor &image,
+    const std::vector<std::vector<std::vector<ScalarConstant>>> &filter,
     std::pair<int,int> stride,
-    CKKSPyfhel &he
+    std::pair<int,int> padding,
+    const CKKSPyfhel &he,
+    int oy,
+    int ox,
+    const ScalarConstant *bias = nullptr
+);
+
+/**
+ * @brief Output length of a sliding window along one axis: (input + 2 * padding - kernel) / stride + 1.
+ */
+std::size_t sliding_window_output_size(std::size_t input, std::size_t kernel, int stride, int padding);
+
+/**
+ * @brief Input rows [first, last) under the window of output row out_row, clamped to the input
+ *        (rows on the virtual padding border are left out).
+ */
+std::pair<std::size_t, std::size_t> sliding_window_input_rows(
+    std::size_t out_row, std::size_t in_height, std::size_t kernel, int stride, int padding);
+
+/**
+ * @brief Rotation-based 2D convolution of one slot-packed image against all filters.
+ *
+ * Rotations are split into baby steps (horizontal taps, applied to each input ciphertext once and
+ * shared by every filter and kernel row) and giant steps (one rotation per output ciphertext, diagonal
+ * and kernel row, applied after summing that row over input ciphertexts and horizontal taps). The giant
+ * step also moves input channel block c onto output block c - k, which sums the multiplexed channels.
+ *
+ * @param image     CipherTensor view [n_input_cts] of packed ciphertexts
+ * @param masks     [n_output_cts][n_input_cts][channels_per_ct][filter_height][filter_width] masked weights
+ * @param tap_used  Same shape as masks; 0 for all-zero masks, which are skipped
+ * @param layout    Input layout
+ * @param padding   (y_pad, x_pad)
+ * @param he        Used for HE operations (rotations, fused multiply-accumulate)
+ * @param output    CipherTensor view [n_output_cts] that receives the packed outputs at the product
+ *                  scale, NOT rescaled (add the bias, then rescale once)
+ */
+void convolute2d_packed(
+    const CipherTensor &image,
+    const std::vector<std::vector<std::vector<std::vector<std::vector<seal::Plaintext>>>>> &masks,
+    const std::vector<std::vector<std::vector<std::vector<std::vector<char>>>>> &tap_used,
+    const PackedLayout &layout,
+    std::pair<int,int> padding,
+    const CKKSPyfhel &he,
+    CipherTensor &output
 );
 
 #endif // CONVOLUTION_H
@@ -2,16 +2,26 @@
 #define FLATTEN_H
 
 #include "../he/he.h"  // Ensure correct path
+#include "../layer/layer.h"
 #include <vector>
 #include <seal/seal.h>
 
-class FlattenLayer {
+class FlattenLayer : public Layer {
 public:
     FlattenLayer() = default;
 
-    // Function to flatten the encrypted tensor for each image independently
-    std::vector<std::vector<seal::Ciphertext>> 
-    operator()(const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input);
+    // Flatten each image independently: [n_images, ...] -> [n_images, features].
+    // A zero-copy reshape: the output shares the input's ciphertexts.
+    CipherTensor operator()(const CipherTensor &input) const;
+
+    // Layer interface: [n_images, ...] -> [n_images, product of the other axes]. forward assigns
+    // the reshaped view to output (aliases_input), so nothing is preallocated or copied.
+    std::vector<size_t> infer_shape(const std::vector<size_t> &input_shape) const override;
+    void forward(const CipherTensor &input, CipherTensor &output) const override;
+    bool aliases_input() const override { return true; }
+
+    // A reshape: no level is consumed
+    size_t depth() const override { return 0; }
 };
 
 #endif // FLATTEN_H
@@ -1,9 +1,9 @@
 #include "square.h"
 #include <stdexcept>
 #include <iostream>
-#include <omp.h>
+#include "runtime/taskScheduler.h"
 
-SquareLayer::SquareLayer(CKKSPyfhel &he) : he_(he) {
+SquareLayer::SquareLayer(const CKKSPyfhel &he, bool lazy_relinearize) : he_(he), lazy_relinearize_(lazy_relinearize) {
     // Ensure relinearization keys exist
     if (he_.get_relin_keys().data().empty()) {
         throw std::runtime_error("Relinearization keys not generated! Call generate_relin_keys() first.");
@@ -12,38 +12,88 @@ SquareLayer::SquareLayer(CKKSPyfhel &he) : he_(he) {
 }
 
 // Perform square operation on a single ciphertext in place
-void SquareLayer::square_inplace(seal::Ciphertext &ct) {
+void SquareLayer::square_inplace(seal::Ciphertext &ct) const {
+    square(ct, ct);  // Modify the original ciphertext `ct` in place
+}
+
+// Perform square operation into a separate ciphertext
+void SquareLayer::square(const seal::Ciphertext &input, seal::Ciphertext &ct) const {
 
-    // Apply square operation
-    he_.evaluator_->square(ct, ct);  // Modify the original ciphertext `ct` in place
+    // Apply square operation; a fresh destination is allocated from the thread's pool
+    if (&input != &ct && ct.size() == 0) {
+        ct = seal::Ciphertext(he_.pool());
+    }
+    he_.evaluator().square(input, ct, he_.pool());
     
-    // Relinearize using pre-stored keys
-    he_.evaluator_->relinearize_inplace(ct, relin_keys_);
+    // Relinearize using pre-stored keys (deferred to the consumer in lazy mode)
+    if (!lazy_relinearize_) {
+        he_.evaluator().relinearize_inplace(ct, relin_keys_, he_.pool());
+    }
 
     // Rescale only if necessary
     if (ct.is_ntt_form()) {
-        he_.evaluator_->rescale_to_next_inplace(ct);
+        he_.evaluator().rescale_to_next_inplace(ct, he_.pool());
     }
 }
 
 // Square operation on a 1D vector (modifies input directly)
-void SquareLayer::operator()(std::vector<seal::Ciphertext> &input) {
+void SquareLayer::operator()(std::vector<seal::Ciphertext> &input) const {
     for (auto &ct : input) {
         square_inplace(ct);  // Modify input directly
     }
 }
 
-// Square operation on a 4D tensor (modifies input directly)
-void SquareLayer::operator()(std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input) {
-    // Use index-based loops with collapse(4) to parallelize all four nested loops
-    #pragma omp parallel for collapse(4)
-    for (size_t i = 0; i < input.size(); i++) {
-        for (size_t j = 0; j < input[i].size(); j++) {
-            for (size_t k = 0; k < input[i][j].size(); k++) {
-                for (size_t l = 0; l < input[i][j][k].size(); l++) {
-                    square_inplace(input[i][j][k][l]);
-                }
-            }
-        }
+// Square operation on a tensor (modifies input directly)
+void SquareLayer::operator()(CipherTensor &input) const {
+    // Element-wise: one task per ciphertext of the contiguous store
+    TaskScheduler::instance().parallel_for(input.size(), [&](size_t i) {
+        square_inplace(input[i]);
+    });
+}
+
+// Square operation on a consumed tensor: in place unless shared, never a full copy
+CipherTensor SquareLayer::operator()(CipherTensor &&input) const {
+    if (!input.is_shared()) {
+        (*this)(input);
+        return std::move(input);
     }
+    CipherTensor result(input.shape());
+    forward(input, result);
+    return result;
+}
+
+std::vector<size_t> SquareLayer::infer_shape(const std::vector<size_t> &input_shape) const {
+    return input_shape;
+}
+
+void SquareLayer::forward(const CipherTensor &input, CipherTensor &output) const {
+    if (output.shape() != input.shape()) {
+        throw std::runtime_error("SquareLayer: output tensor does not match the input shape.");
+    }
+    // square() handles output[i] being input[i] when both views share one store
+    TaskScheduler::instance().parallel_for(input.size(), [&](size_t i) {
+        square(input[i], output[i]);
+    });
+}
+
+// Square operation on a slot-packed tensor (modifies input directly)
+void SquareLayer::operator()(PackedTensor &input) const {
+    // Squaring is slot-wise, so the packed layout is left untouched
+    (*this)(input.data);
+}
+
+// Row interface: element-wise, so the shape is unchanged
+std::vector<size_t> SquareLayer::output_shape(const std::vector<size_t> &input_shape) const {
+    return input_shape;
+}
+
+std::pair<size_t, size_t> SquareLayer::input_rows(size_t out_row, size_t /*in_height*/) const {
+    return { out_row, out_row + 1 };
+}
+
+void SquareLayer::forward_row(const CipherTensor &image, CipherTensor &output, size_t out_row) const {
+    // One task per (channel, column) of the row
+    TaskScheduler::instance().parallel_for(image.dim(0), image.dim(2), [&](size_t c, size_t x) {
+        square(image(c, out_row, x), output(c, out_row, x));
+    });
 }
@@ -2,25 +2,58 @@
 #define SQUARE_LAYER_H
 
 #include "../he/he.h"
+#include "../layer/layer.h"
 #include <vector>
 #include <seal/seal.h>
 
-class SquareLayer {
+// Forward passes are const and reentrant: one layer serves concurrent requests
+class SquareLayer : public RowLayer {
 public:
-    explicit SquareLayer(CKKSPyfhel &he);
+    // lazy_relinearize: leave the squares at size 3; the next additive layer (AvgPool, Linear, Conv2d)
+    // sums them and relinearizes once per output instead of once per input
+    explicit SquareLayer(const CKKSPyfhel &he, bool lazy_relinearize = false);
 
     // Applies the square function in-place on a 1D vector of encrypted ciphertexts
-    void operator()(std::vector<seal::Ciphertext> &input);
+    void operator()(std::vector<seal::Ciphertext> &input) const;
 
-    // Applies the square function in-place on a 4D tensor of encrypted ciphertexts
-    void operator()(std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input);
+    // Applies the square function in-place on every ciphertext of a tensor (any shape)
+    void operator()(CipherTensor &input) const;
+
+    // Squares a tensor handed over by the caller: in place, or into a new tensor if other
+    // tensors share the input's ciphertexts (they are left untouched)
+    CipherTensor operator()(CipherTensor &&input) const override;
+
+    // Layer interface: element-wise, so any shape is accepted and kept. output may be input itself
+    // (squared in place) or a tensor preallocated with the same shape.
+    std::vector<size_t> infer_shape(const std::vector<size_t> &input_shape) const override;
+    void forward(const CipherTensor &input, CipherTensor &output) const override;
+
+    // Applies the square function in-place on a slot-packed tensor (squares every slot at once)
+    void operator()(PackedTensor &input) const;
+
+    // Levels (rescales) one forward pass consumes
+    size_t depth() const override { return 1; }
+
+    // True if the outputs are left at size 3 for the next layer to relinearize
+    bool lazy_relinearize() const { return lazy_relinearize_; }
+
+    // Row interface for the dataflow pipeline (Sequential::setPipelined): element-wise, so the
+    // shape is kept and output row r reads input row r only; forward_row squares one row of an
+    // image [channels, height, width] into output
+    std::vector<size_t> output_shape(const std::vector<size_t> &input_shape) const override;
+    std::pair<size_t, size_t> input_rows(size_t out_row, size_t in_height) const override;
+    void forward_row(const CipherTensor &image, CipherTensor &output, size_t out_row) const override;
 
 private:
-    CKKSPyfhel &he_;
+    const CKKSPyfhel &he_;
     seal::RelinKeys relin_keys_;
+    bool lazy_relinearize_;
     
     // Function to perform the square operation in-place
-    void square_inplace(seal::Ciphertext &ct);
+    void square_inplace(seal::Ciphertext &ct) const;
+
+    // Square into destination (input is left untouched)
+    void square(const seal::Ciphertext &input, seal::Ciphertext &destination) const;
 };
 
 #endif // SQUARE_LAYER_H
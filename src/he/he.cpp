@@ -3,13 +3,28 @@
 #include <stdexcept>
 #include <cmath>
 #include <sstream>
-#include <omp.h>
+#include <cstring>
+#include "runtime/taskScheduler.h"
+#include <limits>
+#include <seal/util/ntt.h>
+#include <seal/util/uintarith.h>
+#include <seal/util/uintarithsmallmod.h>
+#include <algorithm>
+#include <string>
 
 CKKSPyfhel::CKKSPyfhel(std::size_t poly_modulus_degree,
                        double scale,
-                       const std::vector<int> &bit_sizes)
+                       const std::vector<int> &bit_sizes,
+                       bool huge_pages)
     : scale_(scale)
 {
+    if (huge_pages) {
+        huge_pages_ = std::make_shared<HugePageMemoryPool>();
+        huge_pool_ = seal::MemoryPoolHandle(huge_pages_);
+    }
+    // Precomputed NTT tables, the secret key and the helpers' scratch come from the huge pool too
+    auto guard = huge_page_guard();
+
     // 1. Set up encryption parameters for the CKKS scheme
     params_ = seal::EncryptionParameters(seal::scheme_type::ckks);
 
@@ -31,6 +46,14 @@ CKKSPyfhel::CKKSPyfhel(std::size_t poly_modulus_degree,
 
     encoder_   = std::make_unique<seal::CKKSEncoder>(*context_);
     evaluator_ = std::make_unique<seal::Evaluator>(*context_);
+
+    // Slot 0 is the evaluation at zeta = e^(i*pi/N) (or its conjugate): for a real message only
+    // Re(zeta^j) = cos(pi*j/N) contributes
+    const double pi = std::acos(-1.0);
+    slot0_cosines_.resize(poly_modulus_degree);
+    for (std::size_t j = 0; j < poly_modulus_degree; j++) {
+        slot0_cosines_[j] = std::cos(pi * static_cast<double>(j) / static_cast<double>(poly_modulus_degree));
+    }
     // We'll allocate encryptor/decryptor only after we actually have keys:
     encryptor_ = nullptr;
     decryptor_ = nullptr;
@@ -43,41 +66,132 @@ CKKSPyfhel::~CKKSPyfhel()
 
 void CKKSPyfhel::generate_keys()
 {
+    auto guard = huge_page_guard();
     // Generate public & secret key
     keygen_->create_public_key(public_key_);
     // Re-create encryptor & decryptor based on newly generated keys
     encryptor_ = std::make_unique<seal::Encryptor>(*context_, public_key_, secret_key_);
     decryptor_ = std::make_unique<seal::Decryptor>(*context_, secret_key_);
+    if (zero_pool_) {
+        start_encryption_pool(zero_pool_->capacity(), zero_pool_->background());
+    }
+}
+
+void CKKSPyfhel::start_encryption_pool(std::size_t capacity, bool background)
+{
+    if (!encryptor_) {
+        throw std::runtime_error("Public key not generated. Call generate_keys() first.");
+    }
+    // Stop the old pool first: its zeros belong to the previous key
+    zero_pool_.reset();
+    seal::MemoryPoolHandle stock_pool = huge_pool_ ? huge_pool_ : seal::MemoryPoolHandle::New();
+    zero_pool_ = std::make_unique<ZeroEncryptionPool>(*context_, public_key_, capacity, background, stock_pool);
+}
+
+void CKKSPyfhel::fill_encryption_pool()
+{
+    if (!zero_pool_) {
+        throw std::runtime_error("Encryption pool not started. Call start_encryption_pool() first.");
+    }
+    zero_pool_->fill();
+}
+
+ZeroPoolStats CKKSPyfhel::encryption_pool_stats() const
+{
+    return zero_pool_ ? zero_pool_->stats() : ZeroPoolStats{};
 }
 
 seal::RelinKeys CKKSPyfhel::generate_relin_keys()
 {
+    auto guard = huge_page_guard();
     // Create relinearization keys
     keygen_->create_relin_keys(relin_keys_);
     return relin_keys_;
 }
 
-seal::Plaintext CKKSPyfhel::encode(double value)
+seal::GaloisKeys CKKSPyfhel::generate_rotation_keys(const std::vector<int> &steps)
 {
-    // We'll encode a single double into a vector of length 1
-    std::vector<double> vec{ value };
+    // Keep every step requested so far, so layers can ask for their own steps independently
+    int slots = static_cast<int>(slot_count());
+    for (int step : steps) {
+        // Normalize to (-slots, slots); a step of 0 (or a full turn) needs no key
+        step %= slots;
+        if (step != 0) {
+            rotation_steps_.insert(step);
+        }
+    }
+    std::vector<int> all_steps(rotation_steps_.begin(), rotation_steps_.end());
+    auto guard = huge_page_guard();
+    keygen_->create_galois_keys(all_steps, galois_keys_);
+    return galois_keys_;
+}
 
-    seal::Plaintext plaintext;
-    encoder_->encode(vec, scale_, plaintext);
+seal::Plaintext CKKSPyfhel::encode(double value) const
+{
+    // Broadcast the double to every slot, so scalar weights also apply to
+    // batch-packed ciphertexts (slot k = image k). Slot 0 is unchanged.
+    // A constant in every slot is the constant polynomial round(value * scale): SEAL's scalar
+    // overload writes its residues directly, without the canonical embedding FFT or NTTs.
+    seal::Plaintext plaintext(pool());
+    encoder_->encode(value, scale_, plaintext);
     return plaintext;
 }
 
 double CKKSPyfhel::decode(const seal::Plaintext &plaintext)
 {
-    // Decode into a vector<double>
-    std::vector<double> decoded;
-    encoder_->decode(plaintext, decoded);
+    // Only slot 0 is read (like your Python decodeFrac(...)[0]), so evaluate m(zeta) for that one
+    // root in O(N) instead of inverse-transforming all N/2 slots
+    auto context_data = context_->get_context_data(plaintext.parms_id());
+    if (!context_data || !plaintext.is_ntt_form()) {
+        std::vector<double> decoded;
+        encoder_->decode(plaintext, decoded);
+        return decoded.empty() ? 0.0 : decoded[0];
+    }
+    const auto &moduli = context_data->parms().coeff_modulus();
+    const seal::util::NTTTables *ntt_tables = context_data->small_ntt_tables();
+    std::size_t n = context_data->parms().poly_modulus_degree();
 
-    if (decoded.empty()) {
-        return 0.0;
+    // CRT-compose the leading primes whose product fits in 126 bits: the centered coefficients of
+    // a decrypted message (|value| * scale plus noise) are far smaller, so the remaining primes
+    // carry no information. SEAL composes every prime in multi-precision instead.
+    std::size_t limbs = 1;
+    int bits = moduli[0].bit_count();
+    while (limbs < moduli.size() && bits + moduli[limbs].bit_count() <= 126) {
+        bits += moduli[limbs++].bit_count();
     }
-    // Return first element (like your Python decodeFrac(...)[0])
-    return decoded[0];
+    std::vector<std::uint64_t> coeffs(plaintext.data(), plaintext.data() + limbs * n);
+    for (std::size_t l = 0; l < limbs; l++) {
+        seal::util::inverse_ntt_negacyclic_harvey(coeffs.data() + l * n, ntt_tables[l]);
+    }
+
+    // Garner: x = r_0 + t_1 q_0 + t_2 q_0 q_1 + ..., with t_l = (r_l - x) * (q_0...q_{l-1})^-1 mod q_l
+    std::vector<std::uint64_t> prefix_inverse(limbs, 0);
+    unsigned __int128 product = moduli[0].value();
+    for (std::size_t l = 1; l < limbs; l++) {
+        std::uint64_t prefix = static_cast<std::uint64_t>(product % moduli[l].value());
+        if (!seal::util::try_invert_uint_mod(prefix, moduli[l], prefix_inverse[l])) {
+            throw std::logic_error("decode: coefficient moduli are not coprime.");
+        }
+        product *= moduli[l].value();
+    }
+
+    double sum = 0.0;
+    for (std::size_t j = 0; j < n; j++) {
+        unsigned __int128 x = coeffs[j];
+        unsigned __int128 prefix = moduli[0].value();
+        for (std::size_t l = 1; l < limbs; l++) {
+            const seal::Modulus &q = moduli[l];
+            std::uint64_t x_mod_q = static_cast<std::uint64_t>(x % q.value());
+            std::uint64_t t = seal::util::multiply_uint_mod(
+                seal::util::sub_uint_mod(coeffs[l * n + j], x_mod_q, q), prefix_inverse[l], q);
+            x += static_cast<unsigned __int128>(t) * prefix;
+            prefix *= q.value();
+        }
+        // Centered lift to (-product/2, product/2]
+        double coeff = x > product / 2 ? -static_cast<double>(product - x) : static_cast<double>(x);
+        sum += coeff * slot0_cosines_[j];
+    }
+    return sum / plaintext.scale();
 }
 
 seal::Ciphertext CKKSPyfhel::encrypt(double value)
@@ -85,11 +199,18 @@ seal::Ciphertext CKKSPyfhel::encrypt(double value)
     if (!encryptor_) {
         throw std::runtime_error("Public key not generated. Call generate_keys() first.");
     }
+    if (zero_pool_) {
+        // Online part only: add the constant's residues to a precomputed encryption of zero
+        seal::Ciphertext ct = zero_pool_->take();
+        ct.scale() = scale_;
+        add_const_inplace(ct, encodeScalar(value));
+        return ct;
+    }
     // Encode
     seal::Plaintext pt = encode(value);
 
     // Encrypt
-    seal::Ciphertext ct;
+    seal::Ciphertext ct(pool());
     encryptor_->encrypt(pt, ct);
     return ct;
 }
@@ -100,7 +221,7 @@ double CKKSPyfhel::decrypt(const seal::Ciphertext &ciphertext)
         throw std::runtime_error("Secret key not generated. Call generate_keys() first.");
     }
     // Decrypt
-    seal::Plaintext pt;
+    seal::Plaintext pt(pool());
     decryptor_->decrypt(ciphertext, pt);
 
     // Decode to double
@@ -112,11 +233,9 @@ double CKKSPyfhel::decrypt(const seal::Ciphertext &ciphertext)
 std::vector<seal::Plaintext> CKKSPyfhel::encodeVector1D(const std::vector<double> &values)
 {
     std::vector<seal::Plaintext> encoded(values.size());
-    #pragma omp parallel for
-    for (size_t i = 0; i < values.size(); i++)
-    {
+    TaskScheduler::instance().parallel_for(values.size(), [&](size_t i) {
         encoded[i] = encode(values[i]); // uses encode(double) internally
-    }
+    });
     return encoded;
 }
 
@@ -124,11 +243,9 @@ std::vector<seal::Plaintext> CKKSPyfhel::encodeVector1D(const std::vector<double
 std::vector<std::vector<seal::Plaintext>> CKKSPyfhel::encodeMatrix2D(const std::vector<std::vector<double>> &mat)
 {
     std::vector<std::vector<seal::Plaintext>> encoded(mat.size());
-    #pragma omp parallel for
-    for (size_t r = 0; r < mat.size(); r++)
-    {
+    TaskScheduler::instance().parallel_for(mat.size(), [&](size_t r) {
         encoded[r] = encodeVector1D(mat[r]);
-    }
+    });
     return encoded;
 }
 
@@ -136,11 +253,9 @@ std::vector<std::vector<seal::Plaintext>> CKKSPyfhel::encodeMatrix2D(const std::
 std::vector<seal::Ciphertext> CKKSPyfhel::encryptVector1D(const std::vector<double> &values)
 {
     std::vector<seal::Ciphertext> encrypted(values.size());
-    #pragma omp parallel for
-    for (size_t i = 0; i < values.size(); i++)
-    {
+    TaskScheduler::instance().parallel_for(values.size(), [&](size_t i) {
         encrypted[i] = encrypt(values[i]); // uses encrypt(double) internally
-    }
+    });
     return encrypted;
 }
 
@@ -148,11 +263,9 @@ std::vector<seal::Ciphertext> CKKSPyfhel::encryptVector1D(const std::vector<doub
 std::vector<std::vector<seal::Ciphertext>> CKKSPyfhel::encryptMatrix2D(const std::vector<std::vector<double>> &mat)
 {
     std::vector<std::vector<seal::Ciphertext>> encrypted(mat.size());
-    #pragma omp parallel for
-    for (size_t r = 0; r < mat.size(); r++)
-    {
+    TaskScheduler::instance().parallel_for(mat.size(), [&](size_t r) {
         encrypted[r] = encryptVector1D(mat[r]);
-    }
+    });
     return encrypted;
 }
 
@@ -163,11 +276,10 @@ std::vector<std::vector<seal::Ciphertext>> CKKSPyfhel::encryptMatrix2D(const std
 std::vector<double> CKKSPyfhel::decodeVector1D(const std::vector<seal::Plaintext> &encodedVec)
 {
     std::vector<double> result(encodedVec.size());
-    for (size_t i = 0; i < encodedVec.size(); i++)
-    {
+    TaskScheduler::instance().parallel_for(encodedVec.size(), [&](size_t i) {
         // decode(...) returns a single double
         result[i] = decode(encodedVec[i]);
-    }
+    });
     return result;
 }
 
@@ -190,11 +302,10 @@ std::vector<std::vector<double>> CKKSPyfhel::decodeMatrix2D(const std::vector<st
 std::vector<double> CKKSPyfhel::decryptVector1D(const std::vector<seal::Ciphertext> &encryptedVec)
 {
     std::vector<double> result(encryptedVec.size());
-    for (size_t i = 0; i < encryptedVec.size(); i++)
-    {
+    TaskScheduler::instance().parallel_for(encryptedVec.size(), [&](size_t i) {
         // decrypt(...) returns a single double
         result[i] = decrypt(encryptedVec[i]);
-    }
+    });
     return result;
 }
 
@@ -212,6 +323,360 @@ std::vector<std::vector<double>> CKKSPyfhel::decryptMatrix2D(const std::vector<s
 }
 
 
+/******************************************************
+ * Packed (SIMD) encoding: one value per slot
+ *****************************************************/
+std::size_t CKKSPyfhel::slot_count() const
+{
+    return encoder_->slot_count();
+}
+
+seal::Plaintext CKKSPyfhel::encodeVectorPacked(const std::vector<double> &values) const
+{
+    if (values.size() > slot_count()) {
+        throw std::invalid_argument("Too many values to pack: " + std::to_string(values.size()) +
+                                    " > " + std::to_string(slot_count()) + " slots.");
+    }
+    // Unused slots are zero-filled by the encoder
+    seal::Plaintext plaintext(pool());
+    encoder_->encode(values, scale_, plaintext);
+    return plaintext;
+}
+
+seal::Plaintext CKKSPyfhel::encodeVectorPacked(const std::vector<double> &values,
+                                               seal::parms_id_type parms_id, double scale) const
+{
+    if (values.size() > slot_count()) {
+        throw std::invalid_argument("Too many values to pack: " + std::to_string(values.size()) +
+                                    " > " + std::to_string(slot_count()) + " slots.");
+    }
+    seal::Plaintext plaintext(pool());
+    encoder_->encode(values, parms_id, scale, plaintext);
+    return plaintext;
+}
+
+std::vector<double> CKKSPyfhel::decodeVectorPacked(const seal::Plaintext &plaintext, std::size_t length)
+{
+    std::vector<double> decoded;
+    encoder_->decode(plaintext, decoded);
+    decoded.resize(std::min(length, decoded.size()));
+    return decoded;
+}
+
+seal::Ciphertext CKKSPyfhel::encryptVectorPacked(const std::vector<double> &values)
+{
+    if (!encryptor_) {
+        throw std::runtime_error("Public key not generated. Call generate_keys() first.");
+    }
+    seal::Plaintext pt = encodeVectorPacked(values);
+
+    if (zero_pool_) {
+        seal::Ciphertext ct = zero_pool_->take();
+        ct.scale() = pt.scale();
+        evaluator_->add_plain_inplace(ct, pt);
+        return ct;
+    }
+    seal::Ciphertext ct(pool());
+    encryptor_->encrypt(pt, ct);
+    return ct;
+}
+
+std::vector<double> CKKSPyfhel::decryptVectorPacked(const seal::Ciphertext &ciphertext, std::size_t length)
+{
+    if (!decryptor_) {
+        throw std::runtime_error("Secret key not generated. Call generate_keys() first.");
+    }
+    seal::Plaintext pt(pool());
+    decryptor_->decrypt(ciphertext, pt);
+    return decodeVectorPacked(pt, length);
+}
+
+/******************************************************
+ * Packed 4D Encrypt: channels multiplexed into slot blocks
+ *****************************************************/
+PackedTensor CKKSPyfhel::encryptTensorPacked(const std::vector<std::vector<std::vector<std::vector<double>>>> &tensor,
+                                             std::size_t channels_per_ct)
+{
+    size_t slots = slot_count();
+    if (channels_per_ct == 0 || (channels_per_ct & (channels_per_ct - 1)) != 0 || channels_per_ct > slots) {
+        throw std::invalid_argument("channels_per_ct must be a power of two no larger than slot_count().");
+    }
+
+    PackedTensor result;
+    PackedLayout &layout = result.layout;
+    size_t n_images = tensor.size();
+    layout.channels = (n_images > 0) ? tensor[0].size() : 0;
+    layout.height = (layout.channels > 0) ? tensor[0][0].size() : 0;
+    layout.width = (layout.height > 0) ? tensor[0][0][0].size() : 0;
+    layout.row_stride = layout.width;
+    layout.col_stride = 1;
+    layout.channels_per_ct = channels_per_ct;
+    layout.channel_stride = slots / channels_per_ct;
+
+    if (layout.span() > layout.channel_stride) {
+        throw std::invalid_argument("Channel of size " + std::to_string(layout.span()) +
+                                    " does not fit in a block of " + std::to_string(layout.channel_stride) + " slots.");
+    }
+
+    size_t n_cts = layout.n_ciphertexts();
+    result.data = CipherTensor({ n_images, n_cts });
+
+    // Write each channel row-major into its slot block and encrypt one ciphertext per block group
+    TaskScheduler::instance().parallel_for(n_images, n_cts, [&](size_t img, size_t ct) {
+        size_t first = ct * channels_per_ct;
+        size_t last = std::min(first + channels_per_ct, layout.channels);
+
+        std::vector<double> flat((last - first - 1) * layout.channel_stride + layout.span(), 0.0);
+        for (size_t ch = first; ch < last; ch++) {
+            for (size_t y = 0; y < layout.height; y++) {
+                for (size_t x = 0; x < layout.width; x++) {
+                    flat[layout.slot(ch, y, x)] = tensor[img][ch][y][x];
+                }
+            }
+        }
+        result.data(img, ct) = encryptVectorPacked(flat);
+    });
+    return result;
+}
+
+/******************************************************
+ * Packed 4D Decrypt
+ *****************************************************/
+std::vector<std::vector<std::vector<std::vector<double>>>> CKKSPyfhel::decryptTensorPacked(const PackedTensor &tensor)
+{
+    const PackedLayout &layout = tensor.layout;
+    std::vector<std::vector<std::vector<std::vector<double>>>> result(tensor.n_images());
+
+    for (size_t img = 0; img < tensor.n_images(); img++) {
+        result[img].assign(layout.channels, std::vector<std::vector<double>>(
+            layout.height, std::vector<double>(layout.width)));
+
+        for (size_t ct = 0; ct < layout.n_ciphertexts(); ct++) {
+            std::vector<double> flat = decryptVectorPacked(tensor.data(img, ct), slot_count());
+            size_t first = ct * layout.channels_per_ct;
+            size_t last = std::min(first + layout.channels_per_ct, layout.channels);
+            for (size_t ch = first; ch < last; ch++) {
+                for (size_t y = 0; y < layout.height; y++) {
+                    for (size_t x = 0; x < layout.width; x++) {
+                        result[img][ch][y][x] = flat[layout.slot(ch, y, x)];
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/******************************************************
+ * 4D Encrypt/Decrypt: one ciphertext per pixel
+ *****************************************************/
+CipherTensor CKKSPyfhel::encryptTensor(const std::vector<std::vector<std::vector<std::vector<double>>>> &tensor)
+{
+    size_t n_images = tensor.size();
+    size_t n_channels = (n_images > 0) ? tensor[0].size() : 0;
+    size_t height = (n_channels > 0) ? tensor[0][0].size() : 0;
+    size_t width = (height > 0) ? tensor[0][0][0].size() : 0;
+
+    CipherTensor result({ n_images, n_channels, height, width });
+
+    TaskScheduler::instance().parallel_for(n_images, n_channels, [&](size_t img, size_t ch) {
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                result(img, ch, y, x) = encrypt(tensor[img][ch][y][x]);
+            }
+        }
+    });
+    return result;
+}
+
+std::vector<double> CKKSPyfhel::decryptTensor(const CipherTensor &tensor)
+{
+    std::vector<double> result(tensor.size());
+    TaskScheduler::instance().parallel_for(tensor.size(), [&](size_t i) {
+        result[i] = decrypt(tensor[i]);
+    });
+    return result;
+}
+
+seal::Serializable<seal::Ciphertext> CKKSPyfhel::encrypt_symmetric(double value) const
+{
+    if (!encryptor_) {
+        throw std::runtime_error("Secret key not generated. Call generate_keys() first.");
+    }
+    return encryptor_->encrypt_symmetric(encode(value), pool());
+}
+
+std::string CKKSPyfhel::encryptTensorSymmetric(const std::vector<std::vector<std::vector<std::vector<double>>>> &tensor) const
+{
+    std::vector<std::uint64_t> shape(4, 0);
+    shape[0] = tensor.size();
+    shape[1] = (shape[0] > 0) ? tensor[0].size() : 0;
+    shape[2] = (shape[1] > 0) ? tensor[0][0].size() : 0;
+    shape[3] = (shape[2] > 0) ? tensor[0][0][0].size() : 0;
+    std::size_t height = shape[2], width = shape[3];
+
+    // Each pixel is encrypted and serialized on its own, then concatenated in row-major order
+    std::vector<std::string> blobs(shape[0] * shape[1] * height * width);
+    TaskScheduler::instance().parallel_for(shape[0], shape[1], [&](size_t img, size_t ch) {
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                std::ostringstream oss;
+                encrypt_symmetric(tensor[img][ch][y][x]).save(oss);
+                blobs[((img * shape[1] + ch) * height + y) * width + x] = oss.str();
+            }
+        }
+    });
+
+    // Layout: ndim, dims, one byte size per ciphertext, the ciphertexts
+    std::vector<std::uint64_t> header;
+    header.push_back(shape.size());
+    header.insert(header.end(), shape.begin(), shape.end());
+    std::size_t total = 0;
+    for (const std::string &blob : blobs) {
+        header.push_back(blob.size());
+        total += blob.size();
+    }
+    std::string serialized(reinterpret_cast<const char *>(header.data()), header.size() * sizeof(std::uint64_t));
+    serialized.reserve(serialized.size() + total);
+    for (const std::string &blob : blobs) {
+        serialized += blob;
+    }
+    return serialized;
+}
+
+CipherTensor CKKSPyfhel::loadTensor(const std::string &serialized) const
+{
+    const char *data = serialized.data();
+    std::size_t remaining = serialized.size();
+    auto read_u64 = [&]() {
+        if (remaining < sizeof(std::uint64_t)) {
+            throw std::invalid_argument("loadTensor: truncated header.");
+        }
+        std::uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        data += sizeof(value);
+        remaining -= sizeof(value);
+        return value;
+    };
+
+    // Uploads come from remote clients: nothing is allocated before it is checked against the
+    // bytes actually received
+    if (read_u64() != 4) {
+        throw std::invalid_argument("loadTensor: expected a 4D tensor.");
+    }
+    std::vector<std::size_t> shape(4);
+    std::size_t count = 1;
+    for (std::size_t &dim : shape) {
+        std::uint64_t value = read_u64();
+        if (value > std::numeric_limits<std::size_t>::max() ||
+            (value != 0 && count > std::numeric_limits<std::size_t>::max() / value)) {
+            throw std::invalid_argument("loadTensor: tensor shape overflows.");
+        }
+        dim = static_cast<std::size_t>(value);
+        count *= dim;
+    }
+    // Every ciphertext has a size entry in the header
+    if (count > remaining / sizeof(std::uint64_t)) {
+        throw std::invalid_argument("loadTensor: truncated header.");
+    }
+    std::vector<std::uint64_t> sizes(count);
+    for (std::uint64_t &size : sizes) {
+        size = read_u64();
+    }
+    std::vector<std::size_t> offsets(count + 1, 0);
+    for (std::size_t i = 0; i < count; i++) {
+        if (sizes[i] > remaining - offsets[i]) {
+            throw std::invalid_argument("loadTensor: ciphertext sizes exceed the data.");
+        }
+        offsets[i + 1] = offsets[i] + static_cast<std::size_t>(sizes[i]);
+    }
+    if (offsets[count] != remaining) {
+        throw std::invalid_argument("loadTensor: ciphertext sizes do not match the data.");
+    }
+
+    // load() validates each ciphertext against the context and regenerates its seeded polynomial
+    const seal::seal_byte *bytes = reinterpret_cast<const seal::seal_byte *>(data);
+    CipherTensor result(shape);
+    TaskScheduler::instance().parallel_for(count, [&](size_t i) {
+        seal::Ciphertext ct(pool());
+        ct.load(*context_, bytes + offsets[i], offsets[i + 1] - offsets[i]);
+        result[i] = std::move(ct);
+    });
+    return result;
+}
+
+/******************************************************
+ * Batch-packed 4D Encrypt: slot k holds image k
+ *****************************************************/
+CipherTensor CKKSPyfhel::encryptTensorBatched(const std::vector<std::vector<std::vector<std::vector<double>>>> &images)
+{
+    size_t n_images = images.size();
+    size_t n_channels = (n_images > 0) ? images[0].size() : 0;
+    size_t height = (n_channels > 0) ? images[0][0].size() : 0;
+    size_t width = (height > 0) ? images[0][0][0].size() : 0;
+    size_t slots = slot_count();
+    size_t n_groups = (n_images + slots - 1) / slots;
+
+    CipherTensor result({ n_groups, n_channels, height, width });
+
+    for (size_t g = 0; g < n_groups; g++) {
+        size_t first = g * slots;
+        size_t count = std::min(slots, n_images - first);
+
+        // Gather pixel (ch, y, x) of every image in the group and encrypt it as one vector
+        TaskScheduler::instance().parallel_for(n_channels * height, width, [&](size_t row, size_t x) {
+            size_t ch = row / height;
+            size_t y = row % height;
+            std::vector<double> pixel(count);
+            for (size_t k = 0; k < count; k++) {
+                pixel[k] = images[first + k][ch][y][x];
+            }
+            result(g, ch, y, x) = encryptVectorPacked(pixel);
+        });
+    }
+    return result;
+}
+
+/******************************************************
+ * Batch-packed 4D Decrypt
+ *****************************************************/
+std::vector<std::vector<std::vector<std::vector<double>>>>
+CKKSPyfhel::decryptTensorBatched(const CipherTensor &encrypted, std::size_t n_images)
+{
+    size_t slots = slot_count();
+    size_t n_groups = encrypted.empty() ? 0 : encrypted.dim(0);
+    if (n_images > n_groups * slots) {
+        throw std::invalid_argument("decryptTensorBatched: more images requested than were packed.");
+    }
+    size_t n_channels = (n_groups > 0) ? encrypted.dim(1) : 0;
+    size_t height = (n_groups > 0) ? encrypted.dim(2) : 0;
+    size_t width = (n_groups > 0) ? encrypted.dim(3) : 0;
+
+    std::vector<std::vector<std::vector<std::vector<double>>>> result(
+        n_images, std::vector<std::vector<std::vector<double>>>(
+            n_channels, std::vector<std::vector<double>>(height, std::vector<double>(width))));
+
+    for (size_t g = 0; g < n_groups; g++) {
+        size_t first = g * slots;
+        if (first >= n_images) {
+            break;
+        }
+        size_t count = std::min(slots, n_images - first);
+
+        for (size_t ch = 0; ch < n_channels; ch++) {
+            for (size_t y = 0; y < height; y++) {
+                for (size_t x = 0; x < width; x++) {
+                    std::vector<double> pixel = decryptVectorPacked(encrypted(g, ch, y, x), count);
+                    for (size_t k = 0; k < count; k++) {
+                        result[first + k][ch][y][x] = pixel[k];
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
 std::string CKKSPyfhel::get_public_key()
 {
     // Serialize the public key to a string
@@ -236,17 +701,44 @@ seal::RelinKeys CKKSPyfhel::get_relin_keys() const {
     return relin_keys_;
 }
 
+const seal::GaloisKeys &CKKSPyfhel::get_galois_keys() const {
+    if (galois_keys_.data().empty()) {
+        throw std::runtime_error("Galois keys have not been generated. Call generate_rotation_keys() first.");
+    }
+    return galois_keys_;
+}
+
+std::string CKKSPyfhel::get_galois_key()
+{
+    // Serialize the Galois keys to a string
+    std::ostringstream oss;
+    galois_keys_.save(oss);
+    return oss.str();
+}
+
+void CKKSPyfhel::load_galois_key(const std::string &galois_str)
+{
+    auto guard = huge_page_guard();
+    std::istringstream iss(galois_str);
+    galois_keys_.load(*context_, iss);
+}
+
 void CKKSPyfhel::load_public_key(const std::string &pk_str)
 {
+    auto guard = huge_page_guard();
     std::istringstream iss(pk_str);
     public_key_.load(*context_, iss);
 
     // Re-create encryptor with newly loaded public key
     encryptor_ = std::make_unique<seal::Encryptor>(*context_, public_key_, secret_key_);
+    if (zero_pool_) {
+        start_encryption_pool(zero_pool_->capacity(), zero_pool_->background());
+    }
 }
 
 void CKKSPyfhel::load_relin_key(const std::string &relin_str)
 {
+    auto guard = huge_page_guard();
     std::istringstream iss(relin_str);
     relin_keys_.load(*context_, iss);
 }
@@ -254,19 +746,355 @@ void CKKSPyfhel::load_relin_key(const std::string &relin_str)
 seal::Ciphertext CKKSPyfhel::power2(const seal::Ciphertext &ct)
 {
     // Equivalent to "ct * ct", then relin & rescale
-    seal::Ciphertext result;
-    evaluator_->square(ct, result);
+    seal::Ciphertext result(pool());
+    evaluator_->square(ct, result, pool());
 
     // Relinearize
     if (!relin_keys_.data().empty()) {
-        evaluator_->relinearize_inplace(result, relin_keys_);
+        evaluator_->relinearize_inplace(result, relin_keys_, pool());
     }
 
     // Rescale
-    evaluator_->rescale_to_next_inplace(result);
+    evaluator_->rescale_to_next_inplace(result, pool());
     return result;
 }
 
+// Same closeness test SEAL applies before adding ciphertexts
+static bool scales_close(double a, double b)
+{
+    double scale_factor = std::max({ std::fabs(a), std::fabs(b), 1.0 });
+    return std::fabs(a - b) < std::numeric_limits<double>::epsilon() * scale_factor;
+}
+
+// Residue of an integer-valued double modulo q, exact for any magnitude
+static std::uint64_t constant_residue(double coeff, const seal::Modulus &q)
+{
+    bool negative = coeff < 0;
+    double magnitude = std::fabs(coeff);
+    const double two_pow_64 = std::ldexp(1.0, 64);
+
+    // Split into base-2^64 digits (exact: dividing by a power of two), then Horner mod q
+    std::vector<std::uint64_t> digits;
+    while (magnitude >= 1.0) {
+        digits.push_back(static_cast<std::uint64_t>(std::fmod(magnitude, two_pow_64)));
+        magnitude = std::floor(magnitude / two_pow_64);
+    }
+    std::uint64_t base = (std::numeric_limits<std::uint64_t>::max() % q.value() + 1) % q.value();
+    std::uint64_t residue = 0;
+    for (auto it = digits.rbegin(); it != digits.rend(); ++it) {
+        residue = seal::util::add_uint_mod(
+            seal::util::multiply_uint_mod(residue, base, q), *it % q.value(), q);
+    }
+    return negative ? seal::util::negate_uint_mod(residue, q) : residue;
+}
+
+// Limb l of the i-th right-hand operand of a fused dot product: either a full plaintext limb
+// (step 1) or a single constant residue broadcast over the limb (step 0).
+struct FusedOperand {
+    const std::uint64_t *data;
+    std::size_t step;
+};
+
+// Shared body of the fused kernels: destination = sum_i cts[i] * operand(i), reduced once per coefficient
+template <typename OperandFn>
+static void fused_accumulate(const seal::SEALContext &context,
+                             const std::vector<const seal::Ciphertext *> &cts,
+                             OperandFn operand,
+                             double product_scale,
+                             const seal::MemoryPoolHandle &pool,
+                             seal::Ciphertext &destination)
+{
+    const seal::Ciphertext &first = *cts[0];
+    auto context_data = context.get_context_data(first.parms_id());
+    const auto &coeff_modulus = context_data->parms().coeff_modulus();
+    size_t coeff_count = context_data->parms().poly_modulus_degree();
+    size_t n_limbs = coeff_modulus.size();
+
+    size_t size = 0;
+    for (const seal::Ciphertext *ct : cts) {
+        size = std::max(size, ct->size());
+    }
+
+    // A fresh destination comes from the thread's pool; a used one keeps its buffer if it fits
+    if (destination.size() == 0) {
+        destination = seal::Ciphertext(pool);
+    }
+    destination.resize(context, first.parms_id(), size);
+    destination.is_ntt_form() = true;
+    destination.scale() = product_scale;
+
+    // Coefficients are processed in tiles so the 128-bit accumulators stay in L1 while
+    // every term streams through them.
+    constexpr size_t tile = 256;
+    std::uint64_t acc_lo[tile];
+    std::uint64_t acc_hi[tile];
+    unsigned long long prod[2];
+
+    for (size_t poly = 0; poly < size; poly++) {
+        for (size_t l = 0; l < n_limbs; l++) {
+            const seal::Modulus &q = coeff_modulus[l];
+
+            // Each product is below q^2, so this many fit in 128 bits before a reduction
+            int product_bits = 2 * q.bit_count();
+            size_t budget = (product_bits >= 127) ? 1 : (size_t{ 1 } << std::min(62, 128 - product_bits));
+
+            std::uint64_t *out = destination.data(poly) + l * coeff_count;
+            for (size_t base = 0; base < coeff_count; base += tile) {
+                size_t width = std::min(tile, coeff_count - base);
+                std::fill(acc_lo, acc_lo + width, 0);
+                std::fill(acc_hi, acc_hi + width, 0);
+                size_t terms = 0;
+
+                for (size_t i = 0; i < cts.size(); i++) {
+                    if (poly >= cts[i]->size()) continue;
+
+                    if (terms == budget) {
+                        // Fold the accumulator back below q and keep going
+                        for (size_t t = 0; t < width; t++) {
+                            std::uint64_t value[2] = { acc_lo[t], acc_hi[t] };
+                            acc_lo[t] = seal::util::barrett_reduce_128(value, q);
+                            acc_hi[t] = 0;
+                        }
+                        terms = 1;
+                    }
+
+                    const std::uint64_t *c = cts[i]->data(poly) + l * coeff_count + base;
+                    FusedOperand op = operand(i, l);
+                    if (op.step == 0) {
+                        std::uint64_t r = *op.data;
+                        for (size_t t = 0; t < width; t++) {
+                            seal::util::multiply_uint64(c[t], r, prod);
+                            acc_lo[t] += prod[0];
+                            acc_hi[t] += prod[1] + (acc_lo[t] < prod[0]);
+                        }
+                    } else {
+                        const std::uint64_t *p = op.data + base;
+                        for (size_t t = 0; t < width; t++) {
+                            seal::util::multiply_uint64(c[t], p[t], prod);
+                            acc_lo[t] += prod[0];
+                            acc_hi[t] += prod[1] + (acc_lo[t] < prod[0]);
+                        }
+                    }
+                    terms++;
+                }
+
+                for (size_t t = 0; t < width; t++) {
+                    std::uint64_t value[2] = { acc_lo[t], acc_hi[t] };
+                    out[base + t] = seal::util::barrett_reduce_128(value, q);
+                }
+            }
+        }
+    }
+}
+
+// Checks shared by the fused kernels; returns the number of limbs at the ciphertexts' level
+static size_t check_fused_inputs(const seal::SEALContext &context,
+                                 const std::vector<const seal::Ciphertext *> &cts,
+                                 size_t n_operands,
+                                 const seal::Ciphertext &destination)
+{
+    if (cts.empty() || cts.size() != n_operands) {
+        throw std::invalid_argument("Fused dot product: need matching, non-empty operand lists.");
+    }
+    auto context_data = context.get_context_data(cts[0]->parms_id());
+    if (!context_data) {
+        throw std::invalid_argument("Fused dot product: ciphertext is not valid for this context.");
+    }
+    for (const seal::Ciphertext *ct : cts) {
+        if (ct == &destination) {
+            throw std::invalid_argument("Fused dot product: destination must not alias an input.");
+        }
+        if (ct->parms_id() != cts[0]->parms_id() || !ct->is_ntt_form()) {
+            throw std::invalid_argument("Fused dot product: ciphertexts must share a level and be in NTT form.");
+        }
+    }
+    return context_data->parms().coeff_modulus().size();
+}
+
+void CKKSPyfhel::multiply_plain_accumulate(const std::vector<const seal::Ciphertext *> &cts,
+                                           const std::vector<const seal::Plaintext *> &pts,
+                                           seal::Ciphertext &destination) const
+{
+    size_t n_limbs = check_fused_inputs(*context_, cts, pts.size(), destination);
+    size_t coeff_count = params_.poly_modulus_degree();
+    double product_scale = cts[0]->scale() * pts[0]->scale();
+
+    for (size_t i = 0; i < cts.size(); i++) {
+        if (!pts[i]->is_ntt_form() || pts[i]->coeff_count() < n_limbs * coeff_count) {
+            throw std::invalid_argument("multiply_plain_accumulate: plaintext is below the ciphertext level.");
+        }
+        if (!scales_close(cts[i]->scale() * pts[i]->scale(), product_scale)) {
+            throw std::invalid_argument("multiply_plain_accumulate: products have mismatched scales.");
+        }
+    }
+
+    fused_accumulate(*context_, cts,
+        [&](size_t i, size_t l) { return FusedOperand{ pts[i]->data() + l * coeff_count, 1 }; },
+        product_scale, pool(), destination);
+}
+
+/******************************************************
+ * Plaintext-free scalar constants
+ *****************************************************/
+ScalarConstant CKKSPyfhel::encodeScalar(double value) const
+{
+    ScalarConstant constant;
+    constant.value = value;
+    constant.scale = scale_;
+
+    // A broadcast constant is the constant polynomial round(value * scale), which stays the same
+    // value in every NTT coefficient: one residue per prime describes it at every level.
+    double coeff = std::round(value * scale_);
+    const auto &coeff_modulus = context_->first_context_data()->parms().coeff_modulus();
+    constant.residues.reserve(coeff_modulus.size());
+    for (const auto &q : coeff_modulus) {
+        constant.residues.push_back(constant_residue(coeff, q));
+    }
+    return constant;
+}
+
+void CKKSPyfhel::multiply_const_accumulate(const std::vector<const seal::Ciphertext *> &cts,
+                                           const std::vector<const ScalarConstant *> &consts,
+                                           seal::Ciphertext &destination) const
+{
+    size_t n_limbs = check_fused_inputs(*context_, cts, consts.size(), destination);
+    double product_scale = cts[0]->scale() * consts[0]->scale;
+
+    for (size_t i = 0; i < cts.size(); i++) {
+        if (consts[i]->residues.size() < n_limbs) {
+            throw std::invalid_argument("multiply_const_accumulate: constant is below the ciphertext level.");
+        }
+        if (!scales_close(cts[i]->scale() * consts[i]->scale, product_scale)) {
+            throw std::invalid_argument("multiply_const_accumulate: products have mismatched scales.");
+        }
+    }
+
+    fused_accumulate(*context_, cts,
+        [&](size_t i, size_t l) { return FusedOperand{ &consts[i]->residues[l], 0 }; },
+        product_scale, pool(), destination);
+}
+
+void CKKSPyfhel::check_aligned(const std::vector<const seal::Ciphertext *> &cts) const
+{
+    for (const seal::Ciphertext *ct : cts) {
+        if (ct->parms_id() != cts[0]->parms_id()) {
+            throw std::invalid_argument("check_aligned: ciphertexts are at different levels.");
+        }
+        if (!scales_close(ct->scale(), cts[0]->scale())) {
+            throw std::invalid_argument("check_aligned: ciphertexts have mismatched scales.");
+        }
+    }
+}
+
+ScalarConstant CKKSPyfhel::encodeScalar(double value, seal::parms_id_type parms_id, double scale) const
+{
+    auto context_data = context_->get_context_data(parms_id);
+    if (!context_data) {
+        throw std::invalid_argument("encodeScalar: parms_id is not valid for these encryption parameters.");
+    }
+    ScalarConstant constant;
+    constant.value = value;
+    constant.scale = scale;
+
+    double coeff = std::round(value * scale);
+    const auto &coeff_modulus = context_data->parms().coeff_modulus();
+    constant.residues.reserve(coeff_modulus.size());
+    for (const auto &q : coeff_modulus) {
+        constant.residues.push_back(constant_residue(coeff, q));
+    }
+    return constant;
+}
+
+void CKKSPyfhel::add_const_inplace(seal::Ciphertext &ct, const ScalarConstant &constant) const
+{
+    auto context_data = context_->get_context_data(ct.parms_id());
+    if (!context_data || !ct.is_ntt_form()) {
+        throw std::invalid_argument("add_const_inplace: ciphertext must be valid and in NTT form.");
+    }
+    const auto &coeff_modulus = context_data->parms().coeff_modulus();
+    if (constant.residues.size() < coeff_modulus.size() || constant.scale != ct.scale()) {
+        throw std::invalid_argument("add_const_inplace: constant is not encoded at the ciphertext's level and scale.");
+    }
+    size_t coeff_count = context_data->parms().poly_modulus_degree();
+
+    for (size_t l = 0; l < coeff_modulus.size(); l++) {
+        const seal::Modulus &q = coeff_modulus[l];
+        std::uint64_t r = constant.residues[l];
+        std::uint64_t *c0 = ct.data(0) + l * coeff_count;
+        for (size_t t = 0; t < coeff_count; t++) {
+            c0[t] = seal::util::add_uint_mod(c0[t], r, q);
+        }
+    }
+}
+
+void CKKSPyfhel::add_const_inplace(seal::Ciphertext &ct, double value) const
+{
+    // Encoded at the ciphertext's own scale, so no scale override is needed
+    add_const_inplace(ct, encodeScalar(value, ct.parms_id(), ct.scale()));
+}
+
+void CKKSPyfhel::relinearize_inplace(seal::Ciphertext &ct) const
+{
+    if (ct.size() <= 2) {
+        return;
+    }
+    if (relin_keys_.data().empty()) {
+        throw std::runtime_error("Relinearization keys not generated! Call generate_relin_keys() first.");
+    }
+    evaluator_->relinearize_inplace(ct, relin_keys_, pool());
+}
+
+std::size_t CKKSPyfhel::depth_left(const seal::Ciphertext &ct) const
+{
+    auto context_data = context_->get_context_data(ct.parms_id());
+    if (!context_data) {
+        throw std::invalid_argument("Ciphertext is not valid for these encryption parameters.");
+    }
+    return context_data->chain_index();
+}
+
+void CKKSPyfhel::drop_to_depth_inplace(seal::Ciphertext &ct, std::size_t depth) const
+{
+    auto context_data = context_->get_context_data(ct.parms_id());
+    if (!context_data) {
+        throw std::invalid_argument("Ciphertext is not valid for these encryption parameters.");
+    }
+    if (context_data->chain_index() < depth) {
+        throw std::runtime_error("Ciphertext has " + std::to_string(context_data->chain_index()) +
+                                 " levels left, " + std::to_string(depth) + " are needed.");
+    }
+    while (context_data->chain_index() > depth) {
+        context_data = context_data->next_context_data();
+    }
+    if (context_data->parms_id() != ct.parms_id()) {
+        evaluator_->mod_switch_to_inplace(ct, context_data->parms_id(), pool());
+    }
+}
+
+const seal::MemoryPoolHandle &CKKSPyfhel::pool() const
+{
+    if (huge_pool_) {
+        return huge_pool_;
+    }
+    // MemoryPoolHandle::New() is a thread-safe pool: uncontended for its owner thread, and safe
+    // when a ciphertext produced by one task is released by another (pipeline rows, outputs)
+    thread_local seal::MemoryPoolHandle handle = seal::MemoryPoolHandle::New();
+    return handle;
+}
+
+HugePageStats CKKSPyfhel::huge_page_stats() const
+{
+    return huge_pages_ ? huge_pages_->stats() : HugePageStats{};
+}
+
+std::unique_ptr<seal::MMProfGuard> CKKSPyfhel::huge_page_guard() const
+{
+    if (!huge_pool_) {
+        return nullptr;
+    }
+    return std::make_unique<seal::MMProfGuard>(std::make_unique<seal::MMProfFixed>(huge_pool_));
+}
+
 int CKKSPyfhel::noise_budget(const seal::Ciphertext &ct)
 {
     // Returns an approximate measure of remaining noise budget in bits
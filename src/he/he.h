@@ -4,7 +4,30 @@
 #include <seal/seal.h>
 #include <vector>
 #include <cstddef> // for size_t
+#include <set>
+#include <string>
+#include <cstdint>
+#include "packing/packedTensor.h"
+#include "runtime/hugePagePool.h"
+#include "runtime/zeroEncryptionPool.h"
 
+/**
+ * A real constant broadcast to every slot, kept without a Plaintext.
+ * The encoded constant polynomial has the same value in every NTT coefficient, so only
+ * round(value * scale) mod q_i per prime is stored. Lower levels use a prefix of the residues.
+ */
+struct ScalarConstant {
+    double value = 0.0;
+    double scale = 1.0;
+    std::vector<std::uint64_t> residues;  // One per prime of the top data level
+};
+
+/**
+ * CKKS context, keys and evaluation helpers shared by all layers.
+ * - Setup (key generation and loading) mutates the object and must finish before inference starts.
+ * - Everything a forward pass uses (encoding, evaluator(), the fused kernels) is const and
+ *   thread-safe, so layers hold a const reference and one instance serves concurrent requests.
+ */
 class CKKSPyfhel {
 public:
     /**
@@ -12,12 +35,16 @@ public:
      * @param poly_modulus_degree Typically 2^14 = 16384 for CKKS
      * @param scale               Typical scale = 2^30
      * @param bit_sizes          Vector of bit-lengths for the CoeffModulus
+     *                           (the defaults fit depth 7; plan_ckks_parameters sizes the degree
+     *                           and the chain for a given model)
+     * @param huge_pages         Back the context, keys and every pool() allocation with a
+     *                           HugePageMemoryPool (transparent huge pages). Ciphertexts allocated
+     *                           from it must not outlive this object.
      */
-     std::unique_ptr<seal::Evaluator> evaluator_;
-
     CKKSPyfhel(std::size_t poly_modulus_degree = 16384,
                double scale = static_cast<double>(1ULL << 30),
-               const std::vector<int>& bit_sizes = {40, 30, 30, 30, 30, 30, 30, 30, 40});
+               const std::vector<int>& bit_sizes = {40, 30, 30, 30, 30, 30, 30, 30, 40},
+               bool huge_pages = false);
 
     /**
      * @brief Destructor
@@ -25,12 +52,15 @@ public:
     ~CKKSPyfhel();
 
     /**
-     * @brief Encode a double into a plaintext
+     * @brief Encode a double into a plaintext (the value is broadcast to every slot)
+     *        A broadcast is a constant polynomial: no FFT, one residue per prime.
      */
-    seal::Plaintext encode(double value);
+    seal::Plaintext encode(double value) const;
 
     /**
-     * @brief Decode a plaintext into a double
+     * @brief Decode slot 0 of a plaintext into a double
+     *        Evaluates the polynomial at slot 0's root in O(N) after an inverse NTT of the few
+     *        primes a message needs, instead of SEAL's full multi-precision CRT and N/2-slot FFT.
      */
     double decode(const seal::Plaintext &plaintext);
 
@@ -67,16 +97,124 @@ public:
     // Decrypt 2D array of Ciphertext -> 2D array of double
     std::vector<std::vector<double>> decryptMatrix2D(const std::vector<std::vector<seal::Ciphertext>> &encryptedMat);
 
+    /**
+     * @brief Number of CKKS slots in one plaintext/ciphertext (poly_modulus_degree / 2)
+     */
+    std::size_t slot_count() const;
+
+    // Packed: encode up to slot_count() doubles into the slots of a single Plaintext
+    seal::Plaintext encodeVectorPacked(const std::vector<double> &values) const;
+
+    // Packed: encode at a given level and scale, so the plaintext meets a ciphertext without any
+    // mod_switch or scale override (e.g. a bias added at the product scale before the rescale)
+    seal::Plaintext encodeVectorPacked(const std::vector<double> &values,
+                                       seal::parms_id_type parms_id, double scale) const;
+
+    // Packed: decode the first `length` slots of a Plaintext
+    std::vector<double> decodeVectorPacked(const seal::Plaintext &plaintext, std::size_t length);
+
+    // Packed: encrypt up to slot_count() doubles into a single Ciphertext
+    seal::Ciphertext encryptVectorPacked(const std::vector<double> &values);
+
+    // Packed: decrypt the first `length` slots of a Ciphertext
+    std::vector<double> decryptVectorPacked(const seal::Ciphertext &ciphertext, std::size_t length);
+
+    // Packed: encrypt a 4D tensor [n_images][n_channels][height][width].
+    // channels_per_ct channels are multiplexed into each ciphertext (a power of two dividing slot_count()).
+    PackedTensor encryptTensorPacked(const std::vector<std::vector<std::vector<std::vector<double>>>> &tensor,
+                                     std::size_t channels_per_ct = 1);
+
+    // Packed: decrypt a PackedTensor back to [n_images][n_channels][height][width]
+    std::vector<std::vector<std::vector<std::vector<double>>>> decryptTensorPacked(const PackedTensor &tensor);
+
+    /**
+     * @brief Encrypt a 4D tensor, one ciphertext per pixel.
+     * @param tensor [n_images][n_channels][height][width]
+     * @return CipherTensor of shape [n_images, n_channels, height, width]
+     */
+    CipherTensor encryptTensor(const std::vector<std::vector<std::vector<std::vector<double>>>> &tensor);
+
+    /**
+     * @brief Decrypt every ciphertext of a tensor (slot 0), in row-major order.
+     */
+    std::vector<double> decryptTensor(const CipherTensor &tensor);
+
+    /**
+     * @brief Secret-key encrypt a double into SEAL's seeded form (for uploads).
+     *        The second polynomial is replaced by the seed that generates it, so the serialized
+     *        ciphertext is about half the size, and no public-key sampling or encryption of zero
+     *        is needed. It can only be saved; the receiver's load() expands the seed.
+     */
+    seal::Serializable<seal::Ciphertext> encrypt_symmetric(double value) const;
+
+    /**
+     * @brief Client side of an upload: encrypt a 4D tensor with encrypt_symmetric, one ciphertext
+     *        per pixel, and serialize it (shape, ciphertext sizes, seeded ciphertexts).
+     * @param tensor [n_images][n_channels][height][width]
+     */
+    std::string encryptTensorSymmetric(const std::vector<std::vector<std::vector<std::vector<double>>>> &tensor) const;
+
+    /**
+     * @brief Server side of an upload: load a tensor serialized by encryptTensorSymmetric,
+     *        expanding the seeds. Needs only the context (no keys).
+     *        The header is validated against the received bytes before anything is allocated;
+     *        throws std::invalid_argument on a malformed or truncated upload.
+     */
+    CipherTensor loadTensor(const std::string &serialized) const;
+
+    /**
+     * @brief Batch-packed encrypt: slot k of every ciphertext holds image k.
+     * @param images [n_images][n_channels][height][width]
+     * @return CipherTensor [n_groups, n_channels, height, width] with n_groups = ceil(n_images / slot_count()).
+     *         The result feeds the regular per-pixel layers, which then evaluate a whole group at once.
+     */
+    CipherTensor encryptTensorBatched(const std::vector<std::vector<std::vector<std::vector<double>>>> &images);
+
+    /**
+     * @brief Batch-packed decrypt: inverse of encryptTensorBatched.
+     * @param encrypted [n_groups, n_channels, height, width]
+     * @param n_images  Number of images originally packed
+     * @return [n_images][n_channels][height][width]
+     */
+    std::vector<std::vector<std::vector<std::vector<double>>>>
+    decryptTensorBatched(const CipherTensor &encrypted, std::size_t n_images);
+
     /**
      * @brief Generate a new public key & secret key
      */
     void generate_keys();
 
+    /**
+     * @brief Precompute public-key encryptions of zero, so encrypt() and encryptVectorPacked()
+     *        only add the encoded message to one (offline/online encryption, see ZeroEncryptionPool).
+     *        Needs the public key; regenerating or loading it restarts the pool with the new key.
+     * @param capacity   Encryptions of zero kept in stock: about one per ciphertext of a request
+     *                   (e.g. 784 for a pixel-per-ciphertext 28x28 image) hides all sampling
+     * @param background Refill from a background thread; otherwise call fill_encryption_pool()
+     */
+    void start_encryption_pool(std::size_t capacity, bool background = true);
+
+    /**
+     * @brief Top the encryption pool up to capacity on the calling thread (e.g. between requests).
+     */
+    void fill_encryption_pool();
+
+    /**
+     * @brief Counters of the encryption pool (all zero when it is not started).
+     */
+    ZeroPoolStats encryption_pool_stats() const;
+
     /**
      * @brief Generate relinearization keys
      */
     seal::RelinKeys generate_relin_keys();
 
+    /**
+     * @brief Generate Galois keys for slot rotations (positive step = rotate left).
+     *        Steps accumulate across calls; keys are regenerated for all steps requested so far.
+     */
+    seal::GaloisKeys generate_rotation_keys(const std::vector<int> &steps);
+
     /**
      * @brief Get public key (serialized). Demonstrates in-memory approach.
      */
@@ -92,6 +230,21 @@ public:
      */
     std::string get_relin_key();
 
+    /**
+     * @brief Get Galois keys (used by rotation-based packed kernels).
+     */
+    const seal::GaloisKeys &get_galois_keys() const;
+
+    /**
+     * @brief Get Galois keys (serialized).
+     */
+    std::string get_galois_key();
+
+    /**
+     * @brief Load Galois keys from an in-memory string
+     */
+    void load_galois_key(const std::string &galois_str);
+
     /**
      * @brief Load a public key from an in-memory string
      */
@@ -107,12 +260,113 @@ public:
      */
     seal::Ciphertext power2(const seal::Ciphertext &ct);
 
+    /**
+     * @brief Fused dot product: destination = sum_i cts[i] * pts[i], in one pass over the RNS limbs.
+     *        Products are accumulated in 128 bits and reduced once per coefficient, with no
+     *        temporary ciphertexts. The result is NOT rescaled; call rescale_to_next once on it.
+     *        An empty destination is allocated from pool(); a non-empty one reuses its buffer.
+     * @param cts Ciphertexts in NTT form, all at the same level and scale (sizes may differ)
+     * @param pts Plaintexts at the ciphertexts' level or higher (only the needed limbs are read,
+     *            so no mod_switch is required), all at the same scale
+     */
+    void multiply_plain_accumulate(const std::vector<const seal::Ciphertext *> &cts,
+                                   const std::vector<const seal::Plaintext *> &pts,
+                                   seal::Ciphertext &destination) const;
+
+    /**
+     * @brief Encode a double as a ScalarConstant (per-prime residues, no Plaintext).
+     */
+    ScalarConstant encodeScalar(double value) const;
+
+    /**
+     * @brief Encode a double as a ScalarConstant at a given level and scale: residues for exactly
+     *        the primes of that level (e.g. a bias at the product scale of the level it is added at).
+     */
+    ScalarConstant encodeScalar(double value, seal::parms_id_type parms_id, double scale) const;
+
+    /**
+     * @brief Fused dot product with scalar constants: destination = sum_i cts[i] * consts[i].
+     *        Same contract as multiply_plain_accumulate; each limb is multiplied by one residue.
+     */
+    void multiply_const_accumulate(const std::vector<const seal::Ciphertext *> &cts,
+                                   const std::vector<const ScalarConstant *> &consts,
+                                   seal::Ciphertext &destination) const;
+
+    /**
+     * @brief Throw unless all ciphertexts share one level and scale. Operands of a fused dot
+     *        product are checked up front so a mismatch is a planning error, not a silent patch.
+     */
+    void check_aligned(const std::vector<const seal::Ciphertext *> &cts) const;
+
+    /**
+     * @brief Add a real constant to every slot, encoded on the fly at the ciphertext's scale and level.
+     */
+    void add_const_inplace(seal::Ciphertext &ct, double value) const;
+
+    /**
+     * @brief Add a constant encoded ahead of time (encodeScalar at the ciphertext's level and
+     *        scale): no encoding in the loop. Throws if the constant's scale differs.
+     */
+    void add_const_inplace(seal::Ciphertext &ct, const ScalarConstant &constant) const;
+
+    /**
+     * @brief Relinearize a ciphertext left at size 3 by a lazy square (no-op on size 2).
+     *        Additive layers call it once per output, after summing the size-3 inputs.
+     */
+    void relinearize_inplace(seal::Ciphertext &ct) const;
+
+    /**
+     * @brief Multiplicative depth left on a ciphertext: the number of rescales it can still take
+     *        (the chain index of its level; 0 at the last level).
+     */
+    std::size_t depth_left(const seal::Ciphertext &ct) const;
+
+    /**
+     * @brief Drop primes (mod switch, scale unchanged) until exactly `depth` rescales are left.
+     *        Every later operation on the ciphertext then touches fewer RNS limbs. No-op if it is
+     *        already there; throws if it has fewer levels than `depth`.
+     */
+    void drop_to_depth_inplace(seal::Ciphertext &ct, std::size_t depth) const;
+
+    /**
+     * @brief Scale fresh encodings and encodeScalar() constants are taken at.
+     */
+    double scale() const { return scale_; }
+
+    /**
+     * @brief SEAL context of the encryption parameters (e.g. to load serialized ciphertexts).
+     */
+    const seal::SEALContext &context() const { return *context_; }
+
+    /**
+     * @brief SEAL evaluator (stateless: all its operations are const and thread-safe).
+     */
+    const seal::Evaluator &evaluator() const { return *evaluator_; }
+
+    /**
+     * @brief Memory pool of the calling thread. Pass it to evaluator() calls in the layers:
+     *        tasks then allocate from their own pool instead of contending on SEAL's global one,
+     *        and buffers freed by a thread are handed out to it again. The pools are thread-safe,
+     *        so ciphertexts allocated here may be freed on any thread.
+     *        With huge_pages, every thread shares the instance's HugePageMemoryPool instead.
+     */
+    const seal::MemoryPoolHandle &pool() const;
+
+    /**
+     * @brief Counters of the huge-page pool (all zero when huge_pages is off).
+     */
+    HugePageStats huge_page_stats() const;
+
     /**
      * @brief Returns the current noise budget of a ciphertext in bits (an approximate measure).
      */
     int noise_budget(const seal::Ciphertext &ct);
 
 private:
+    // Huge-page pool, or empty. Declared first: everything below may hold its buffers.
+    seal::MemoryPoolHandle huge_pool_;
+    std::shared_ptr<HugePageMemoryPool> huge_pages_;
+
     // SEAL components
     seal::EncryptionParameters params_;
     std::shared_ptr<seal::SEALContext> context_;
@@ -121,16 +375,29 @@ private:
     std::unique_ptr<seal::KeyGenerator> keygen_;
     std::unique_ptr<seal::Encryptor> encryptor_;
     std::unique_ptr<seal::Decryptor> decryptor_;
-    // std::unique_ptr<seal::Evaluator> evaluator_;
+    std::unique_ptr<seal::Evaluator> evaluator_;
     std::unique_ptr<seal::CKKSEncoder> encoder_;
 
     // Keys
     seal::PublicKey public_key_;
     seal::SecretKey secret_key_;
     seal::RelinKeys relin_keys_;
+    seal::GaloisKeys galois_keys_;
+
+    // Rotation steps covered by galois_keys_
+    std::set<int> rotation_steps_;
 
     // Scale used in CKKS encoding
     double scale_;
+
+    // cos(pi * j / N): real part of slot 0's root to the power j, for decode()
+    std::vector<double> slot0_cosines_;
+
+    // Encryptions of zero for encrypt(), or null. Declared last: its thread stops first.
+    std::unique_ptr<ZeroEncryptionPool> zero_pool_;
+
+    // Route SEAL's default allocations (context, keys) to the huge-page pool while alive; null when off
+    std::unique_ptr<seal::MMProfGuard> huge_page_guard() const;
 };
 
 #endif // HE_H
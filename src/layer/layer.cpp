@@ -0,0 +1,21 @@
+#include "layer.h"
+#include <stdexcept>
+
+CipherTensor Layer::operator()(CipherTensor &&input) const
+{
+    CipherTensor output;
+    if (!aliases_input()) {
+        output = CipherTensor(infer_shape(input.shape()));
+    }
+    forward(input, output);
+    return output;
+}
+
+std::vector<std::size_t> RowLayer::infer_shape(const std::vector<std::size_t> &input_shape) const
+{
+    if (input_shape.size() != 4) {
+        throw std::runtime_error("Expected a 4D input [n_images, channels, height, width].");
+    }
+    std::vector<std::size_t> image = output_shape({ input_shape[1], input_shape[2], input_shape[3] });
+    return { input_shape[0], image[0], image[1], image[2] };
+}
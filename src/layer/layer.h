@@ -0,0 +1,60 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "tensor/cipherTensor.h"
+
+/**
+ * Common interface of the ciphertext layers, used by Sequential and GraphExecutor.
+ * - Shapes include the batch axis: [n_images, ...].
+ * - Implementations are const and reentrant: one layer serves concurrent requests.
+ */
+class Layer {
+public:
+    virtual ~Layer() = default;
+
+    // Output shape for an input shape; throws if the layer does not accept the input
+    virtual std::vector<std::size_t> infer_shape(const std::vector<std::size_t> &input_shape) const = 0;
+
+    // Levels (rescales) one forward pass consumes
+    virtual std::size_t depth() const = 0;
+
+    // Compute into output, preallocated with infer_shape(input.shape()). Layers that alias their
+    // input (aliases_input()) assign a view of it to output instead.
+    virtual void forward(const CipherTensor &input, CipherTensor &output) const = 0;
+
+    // True for layers that only reinterpret their input (Flatten): no output is preallocated
+    virtual bool aliases_input() const { return false; }
+
+    // Encode the layer's constants (bias, pooling factor) for inputs at this level and scale ahead
+    // of time, from the level schedule (e.g. ModelPlan::build). Inputs at other levels still work:
+    // their constants are encoded on first use.
+    virtual void prepare(const seal::parms_id_type &/*parms_id*/, double /*scale*/) const {}
+
+    // Forward pass on a tensor handed over by the caller. Layers that free their input while
+    // reading it override this; by default the output is allocated and computed by forward().
+    virtual CipherTensor operator()(CipherTensor &&input) const;
+};
+
+/**
+ * Layer whose output rows depend on a band of input rows, so it can run in a row pipeline
+ * (see run_row_pipeline). Shapes here are per image: [channels, height, width].
+ */
+class RowLayer : public Layer {
+public:
+    // Output shape of one image (throws if the layer does not accept it)
+    virtual std::vector<std::size_t> output_shape(const std::vector<std::size_t> &input_shape) const = 0;
+
+    // Input rows [first, last) read by output row out_row
+    virtual std::pair<std::size_t, std::size_t> input_rows(std::size_t out_row, std::size_t in_height) const = 0;
+
+    // Compute output row out_row of one image view
+    virtual void forward_row(const CipherTensor &image, CipherTensor &output, std::size_t out_row) const = 0;
+
+    // Batched shape: [n_images] followed by output_shape of one image
+    std::vector<std::size_t> infer_shape(const std::vector<std::size_t> &input_shape) const override;
+};
+
+#endif // LAYER_H
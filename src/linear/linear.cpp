@@ -1,10 +1,13 @@
 #include "linear.h"
+#include <atomic>
 #include <stdexcept>
 #include <iostream>
 #include <iomanip> 
+#include "runtime/recycler.h"
+#include "runtime/taskScheduler.h"
 
 // Constructor: Encodes Weights and Bias
-LinearLayer::LinearLayer(CKKSPyfhel &he, const std::vector<std::vector<double>> &weights, 
+LinearLayer::LinearLayer(const CKKSPyfhel &he, const std::vector<std::vector<double>> &weights, 
                          const std::vector<double> &bias)
     : he_(he)
 {
@@ -13,70 +16,136 @@ LinearLayer::LinearLayer(CKKSPyfhel &he, const std::vector<std::vector<double>>
     for (size_t i = 0; i < weights.size(); i++) {
         weights_[i].resize(weights[i].size());
         for (size_t j = 0; j < weights[i].size(); j++) {
-            weights_[i][j] = he_.encode(weights[i][j]);
+            weights_[i][j] = he_.encodeScalar(weights[i][j]);
         }
     }
 
-    // Encode bias if provided
-    if (!bias.empty()) {
-        bias_.resize(bias.size());
-        for (size_t i = 0; i < bias.size(); i++) {
-            bias_[i] = he_.encode(bias[i]);
+    // Keep the bias as is; it is encoded at the output's scale in the forward pass
+    bias_ = bias;
+}
+
+LinearLayer::LinearLayer(const CKKSPyfhel &he, std::vector<std::vector<ScalarConstant>> encoded_weights,
+                         const std::vector<double> &bias)
+    : he_(he), weights_(std::move(encoded_weights)), bias_(bias)
+{
+    if (weights_.empty() || weights_[0].empty()) {
+        throw std::invalid_argument("LinearLayer Error: No weights.");
+    }
+    for (const auto &row : weights_) {
+        if (row.size() != weights_[0].size()) {
+            throw std::invalid_argument("LinearLayer Error: Weight rows differ in length.");
         }
     }
 }
 
 // Forward pass: Encrypted matrix-vector multiplication
-std::vector<std::vector<seal::Ciphertext>> 
-LinearLayer::operator()(const std::vector<std::vector<seal::Ciphertext>> &input)
+CipherTensor LinearLayer::operator()(const CipherTensor &input) const
 {
-    size_t n_samples = input.size();     // Number of input samples (batch size)
-    size_t in_features = input[0].size(); // Input vector size
-    size_t out_features = weights_.size(); // Output vector size
+    CipherTensor result(infer_shape(input.shape()));
+    multiply(input, result, false);
+    return result;
+}
 
+CipherTensor LinearLayer::operator()(CipherTensor &&input) const
+{
+    bool owned = !input.is_shared();
+    CipherTensor result(infer_shape(input.shape()));
+    multiply(std::move(input), result, owned);
+    return result;
+}
+
+void LinearLayer::forward(const CipherTensor &input, CipherTensor &output) const
+{
+    multiply(input, output, false);
+}
+
+void LinearLayer::prepare(const seal::parms_id_type &parms_id, double scale) const
+{
+    bias_at(parms_id, scale);
+}
+
+const std::vector<ScalarConstant> *LinearLayer::bias_at(const seal::parms_id_type &parms_id, double scale) const
+{
+    if (bias_.empty()) {
+        return nullptr;
+    }
+    double product_scale = scale * weights_[0][0].scale;
+    return &bias_bank_.get(parms_id, scale, [&] {
+        std::vector<ScalarConstant> bias;
+        for (double b : bias_) {
+            bias.push_back(he_.encodeScalar(b, parms_id, product_scale));
+        }
+        return bias;
+    });
+}
+
+std::vector<size_t> LinearLayer::infer_shape(const std::vector<size_t> &input_shape) const
+{
+    if (input_shape.size() != 2) {
+        throw std::runtime_error("LinearLayer Error: Expected a 2D input [n_samples, in_features].");
+    }
     // Ensure input matches weight dimensions
-    if (in_features != weights_[0].size()) {
+    if (input_shape[1] != weights_[0].size()) {
         throw std::runtime_error("LinearLayer Error: Input size does not match weight dimensions.");
     }
+    return { input_shape[0], weights_.size() };
+}
 
-    std::vector<std::vector<seal::Ciphertext>> result(n_samples, std::vector<seal::Ciphertext>(out_features));
+void LinearLayer::multiply(CipherTensor input, CipherTensor &result, bool release_input) const
+{
+    if (result.shape() != infer_shape(input.shape())) {
+        throw std::runtime_error("LinearLayer Error: Output tensor does not match the inferred output shape.");
+    }
+    size_t n_samples = input.dim(0);     // Number of input samples (batch size)
+    size_t in_features = input.dim(1); // Input vector size
+    size_t out_features = weights_.size(); // Output vector size
+    const std::vector<ScalarConstant> *bias = input.empty() ? nullptr : bias_at(input[0].parms_id(), input[0].scale());
 
+    // Every output feature reads the whole input vector
+    std::vector<std::vector<const seal::Ciphertext *>> features(n_samples);
     for (size_t img = 0; img < n_samples; img++) {
-        for (size_t out_f = 0; out_f < out_features; out_f++) {
-            // Initialize sum to zero ciphertext
-            seal::Ciphertext sum_ct = he_.encrypt(0.0);
-
-            for (size_t in_f = 0; in_f < in_features; in_f++) {
-                seal::Ciphertext prod_ct;
-                
-                he_.evaluator_->mod_switch_to_inplace(weights_[out_f][in_f], input[img][in_f].parms_id());
-                weights_[out_f][in_f].scale() = input[img][in_f].scale();
-                he_.evaluator_->multiply_plain(input[img][in_f], weights_[out_f][in_f], prod_ct);
-
-                // Rescale and switch modulus if necessary
-                he_.evaluator_->rescale_to_next_inplace(prod_ct);
-                he_.evaluator_->mod_switch_to_inplace(sum_ct, prod_ct.parms_id());
-                sum_ct.scale() = prod_ct.scale();
-
-                // Sum the weighted input
-                he_.evaluator_->add_inplace(sum_ct, prod_ct);
-            }
+        for (size_t i = 0; i < in_features; i++) {
+            features[img].push_back(&input(img, i));
+        }
+    }
 
-            // Add bias if provided
-            if (!bias_.empty()) {
-                he_.evaluator_->mod_switch_to_inplace(bias_[out_f], sum_ct.parms_id());
-                bias_[out_f].scale() = sum_ct.scale();
-                he_.evaluator_->add_plain_inplace(sum_ct, bias_[out_f]);
-            }
+    // Outputs of each sample still to compute: the last one releases the sample's features
+    std::vector<std::atomic<size_t>> outputs_left(n_samples);
+    for (auto &left : outputs_left) {
+        left.store(out_features, std::memory_order_relaxed);
+    }
 
-            result[img][out_f] = std::move(sum_ct);
+    // One task per (sample, output feature)
+    TaskScheduler::instance().parallel_for(n_samples, out_features, [&](size_t img, size_t out_f) {
+        // Pointer list recycled across output features
+        Recycled<std::vector<const ScalarConstant *>> row;
+        row->clear();
+        for (const auto &w : weights_[out_f]) {
+            row->push_back(&w);
         }
-    }
 
-    return result;
+        // Fused dot product over all input features; the bias joins at the product scale,
+        // then a single rescale
+        seal::Ciphertext sum_ct;
+        he_.multiply_const_accumulate(features[img], *row, sum_ct);
+        if (bias) {
+            he_.add_const_inplace(sum_ct, (*bias)[out_f]);
+        }
+        he_.evaluator().rescale_to_next_inplace(sum_ct, he_.pool());
+        he_.relinearize_inplace(sum_ct); // Once per output for lazily squared inputs
+
+        result(img, out_f) = std::move(sum_ct);
+
+        // Every output of this sample is done: its features are no longer read
+        if (release_input && outputs_left[img].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            for (size_t i = 0; i < in_features; i++) {
+                input(img, i).release();
+            }
+        }
+    });
 }
 
 // Getter function to retrieve encoded weights (for debugging)
-std::vector<std::vector<seal::Plaintext>> LinearLayer::get_weights() const {
+std::vector<std::vector<ScalarConstant>> LinearLayer::get_weights() const {
     return weights_;
 }
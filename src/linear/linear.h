@@ -3,23 +3,55 @@
 
 #include <vector>
 #include "../he/he.h"  // Include your CKKS encryption header
+#include "../layer/layer.h"
+#include "../runtime/constantBank.h"
 
-class LinearLayer {
+// Forward passes are const and reentrant: one layer serves concurrent requests
+class LinearLayer : public Layer {
 public:
     // Constructor: Takes HE reference, weights (2D vector), and optional bias
-    LinearLayer(CKKSPyfhel &he, const std::vector<std::vector<double>> &weights, 
+    LinearLayer(const CKKSPyfhel &he, const std::vector<std::vector<double>> &weights, 
                 const std::vector<double> &bias = {});
 
-    // Forward pass
-    std::vector<std::vector<seal::Ciphertext>> operator()(const std::vector<std::vector<seal::Ciphertext>> &input);
+    // Constructor from weights encoded ahead of time (encodeScalar() with he's parameters, e.g.
+    // loaded from a ModelPlan): [out_features][in_features]
+    LinearLayer(const CKKSPyfhel &he, std::vector<std::vector<ScalarConstant>> encoded_weights,
+                const std::vector<double> &bias = {});
+
+    // Forward pass: [n_samples, in_features] -> [n_samples, out_features]
+    CipherTensor operator()(const CipherTensor &input) const;
+
+    // Same pass, consuming the input: each sample's features are released as soon as all of its
+    // outputs are computed (an input shared with other tensors is left untouched)
+    CipherTensor operator()(CipherTensor &&input) const override;
+
+    // Layer interface: [n_samples, in_features] -> [n_samples, out_features]
+    std::vector<size_t> infer_shape(const std::vector<size_t> &input_shape) const override;
+    void forward(const CipherTensor &input, CipherTensor &output) const override;
+
+    // Levels (rescales) one forward pass consumes
+    size_t depth() const override { return 1; }
+
+    // Encode the bias for inputs at this level and scale (see Layer::prepare)
+    void prepare(const seal::parms_id_type &parms_id, double scale) const override;
 
     // Getter for weights (for debugging)
-    std::vector<std::vector<seal::Plaintext>> get_weights() const;
+    std::vector<std::vector<ScalarConstant>> get_weights() const;
 
 private:
-    CKKSPyfhel &he_;  // Homomorphic Encryption object
-    std::vector<std::vector<seal::Plaintext>> weights_; // Encoded Weights
-    std::vector<seal::Plaintext> bias_; // Encoded Bias
+    // Forward pass over a view of the input into output; release_input frees each sample's
+    // features once its outputs are computed
+    void multiply(CipherTensor input, CipherTensor &output, bool release_input) const;
+
+    const CKKSPyfhel &he_;  // Homomorphic Encryption object
+    std::vector<std::vector<ScalarConstant>> weights_; // Encoded Weights (per-prime residues)
+    std::vector<double> bias_; // Raw bias, encoded per input level and scale by bias_at
+
+    // Bias per output feature at the input level and the product scale, keyed by the input (level, scale)
+    ConstantBank<std::vector<ScalarConstant>> bias_bank_;
+
+    // Encoded bias for inputs at (parms_id, scale), or nullptr without a bias
+    const std::vector<ScalarConstant> *bias_at(const seal::parms_id_type &parms_id, double scale) const;
 };
 
 #endif
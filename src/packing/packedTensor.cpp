@@ -0,0 +1,56 @@
+#include "packedTensor.h"
+#include <stdexcept>
+
+PackedLayout packed_window_layout(
+    const PackedLayout &input,
+    std::pair<int,int> kernel_size,
+    std::pair<int,int> stride,
+    std::pair<int,int> padding,
+    std::size_t out_channels)
+{
+    if (stride.first <= 0 || stride.second <= 0)
+        throw std::runtime_error("Stride must be positive.");
+
+    int y_out = ((static_cast<int>(input.height) + 2 * padding.first - kernel_size.first) / stride.first) + 1;
+    int x_out = ((static_cast<int>(input.width) + 2 * padding.second - kernel_size.second) / stride.second) + 1;
+
+    if (y_out <= 0 || x_out <= 0)
+        throw std::runtime_error("Output size is zero or negative. Check stride and padding.");
+
+    PackedLayout out = input;
+    out.channels = out_channels;
+    out.height = static_cast<std::size_t>(y_out);
+    out.width = static_cast<std::size_t>(x_out);
+    out.row_stride = input.row_stride * stride.first;
+    out.col_stride = input.col_stride * stride.second;
+
+    // A padded output row may be wider than the input row; it must not run into the next one
+    if (out.width > 1 && (out.width - 1) * out.col_stride >= out.row_stride)
+        throw std::runtime_error("Packed layout: padded output rows overlap in the slot layout.");
+    // Nor may a channel run into the next channel block
+    if (out.channels_per_ct > 1 && out.span() > out.channel_stride)
+        throw std::runtime_error("Packed layout: output channel does not fit in its slot block.");
+
+    return out;
+}
+
+std::vector<std::size_t> packed_tap_slots(
+    const PackedLayout &input,
+    const PackedLayout &output,
+    std::pair<int,int> stride,
+    std::pair<int,int> padding,
+    int fy,
+    int fx)
+{
+    std::vector<std::size_t> hits;
+    for (int oy = 0; oy < static_cast<int>(output.height); oy++) {
+        int iy = oy * stride.first - padding.first + fy;
+        if (iy < 0 || iy >= static_cast<int>(input.height)) continue;
+        for (int ox = 0; ox < static_cast<int>(output.width); ox++) {
+            int ix = ox * stride.second - padding.second + fx;
+            if (ix < 0 || ix >= static_cast<int>(input.width)) continue;
+            hits.push_back(output.slot(oy, ox));
+        }
+    }
+    return hits;
+}
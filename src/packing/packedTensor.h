@@ -0,0 +1,98 @@
+#ifndef PACKED_TENSOR_H
+#define PACKED_TENSOR_H
+
+#include <vector>
+#include <cstddef>
+#include <utility>   // for std::pair
+#include <seal/seal.h>
+#include "tensor/cipherTensor.h"
+
+/**
+ * Describes how a feature map is laid out inside the CKKS slots of its ciphertexts.
+ * - Channels are multiplexed: channel c lives in ciphertext c / channels_per_ct, in the slot
+ *   block starting at (c % channels_per_ct) * channel_stride.
+ * - Inside a block, pixel (y, x) lives at y * row_stride + x * col_stride.
+ * Freshly encrypted maps are dense row-major (row_stride = width, col_stride = 1); strided
+ * layers keep their outputs in place and widen the strides instead of compacting the slots.
+ */
+struct PackedLayout {
+    std::size_t channels = 0;         // Number of logical channels
+    std::size_t height = 0;           // Feature map height
+    std::size_t width = 0;            // Feature map width
+    std::size_t row_stride = 0;       // Slot distance between vertically adjacent pixels
+    std::size_t col_stride = 1;       // Slot distance between horizontally adjacent pixels
+    std::size_t channels_per_ct = 1;  // Channels multiplexed into one ciphertext
+    std::size_t channel_stride = 0;   // Slot distance between channel blocks (slot_count / channels_per_ct)
+
+    // Slot index of pixel (y, x) inside its channel block
+    std::size_t slot(std::size_t y, std::size_t x) const { return y * row_stride + x * col_stride; }
+
+    // Slot index of pixel (y, x) of channel c inside its ciphertext
+    std::size_t slot(std::size_t c, std::size_t y, std::size_t x) const {
+        return (c % channels_per_ct) * channel_stride + slot(y, x);
+    }
+
+    // Number of slots spanned by one channel (first to last pixel, inclusive)
+    std::size_t span() const { return (height == 0 || width == 0) ? 0 : slot(height - 1, width - 1) + 1; }
+
+    // Number of ciphertexts per image
+    std::size_t n_ciphertexts() const { return (channels + channels_per_ct - 1) / channels_per_ct; }
+
+    bool operator==(const PackedLayout &other) const {
+        return channels == other.channels && height == other.height && width == other.width &&
+               row_stride == other.row_stride && col_stride == other.col_stride &&
+               channels_per_ct == other.channels_per_ct && channel_stride == other.channel_stride;
+    }
+    bool operator!=(const PackedLayout &other) const { return !(*this == other); }
+};
+
+/**
+ * A batch of slot-packed encrypted feature maps.
+ * - data shape = [n_images, layout.n_ciphertexts()]
+ * - layout describes where each pixel sits inside the slots
+ */
+struct PackedTensor {
+    CipherTensor data;
+    PackedLayout layout;
+
+    std::size_t n_images() const { return data.empty() ? 0 : data.dim(0); }
+};
+
+/**
+ * @brief Layout produced by a sliding-window layer (convolution, pooling) on a packed input.
+ *        Output pixel (y, x) stays on the slot of input pixel (y * y_stride, x * x_stride).
+ * @param out_channels Number of output channels (multiplexing is kept from the input)
+ */
+PackedLayout packed_window_layout(
+    const PackedLayout &input,
+    std::pair<int,int> kernel_size,
+    std::pair<int,int> stride,
+    std::pair<int,int> padding,
+    std::size_t out_channels
+);
+
+/**
+ * @brief Output slots (inside a channel block) whose window tap (fy, fx) reads an in-bounds input pixel.
+ *        Out-of-bounds taps correspond to zero padding and are left out.
+ */
+std::vector<std::size_t> packed_tap_slots(
+    const PackedLayout &input,
+    const PackedLayout &output,
+    std::pair<int,int> stride,
+    std::pair<int,int> padding,
+    int fy,
+    int fx
+);
+
+/**
+ * @brief Slot rotation that brings input tap (fy, fx) onto its output slot.
+ *        Split into a horizontal part (baby step) and a vertical part (giant step).
+ */
+inline int packed_col_step(const PackedLayout &input, std::pair<int,int> padding, int fx) {
+    return (fx - padding.second) * static_cast<int>(input.col_stride);
+}
+inline int packed_row_step(const PackedLayout &input, std::pair<int,int> padding, int fy) {
+    return (fy - padding.first) * static_cast<int>(input.row_stride);
+}
+
+#endif // PACKED_TENSOR_H
@@ -0,0 +1,445 @@
+#include "modelPlan.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "convolution/convolution.h"
+#include "flatten/flatten.h"
+#include "functions/square.h"
+#include "linear/linear.h"
+#include "pooling/adaptiveAvgPooling.h"
+#include "pooling/avgPooling.h"
+#include "runtime/taskScheduler.h"
+
+namespace {
+
+constexpr char plan_magic[6] = { 'H', 'E', 'P', 'L', 'A', 'N' };
+constexpr std::uint32_t plan_version = 1;
+
+// Appends PODs and counted arrays to a file
+class PlanWriter {
+public:
+    explicit PlanWriter(const std::string &path) : out_(path, std::ios::binary | std::ios::trunc)
+    {
+        if (!out_) {
+            throw std::runtime_error("Model plan: cannot write " + path);
+        }
+    }
+
+    template <typename T>
+    void pod(const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "PODs only");
+        out_.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void array(const std::vector<T> &values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "PODs only");
+        pod<std::uint64_t>(values.size());
+        out_.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+    void close(const std::string &path)
+    {
+        out_.close();
+        if (!out_) {
+            throw std::runtime_error("Model plan: write to " + path + " failed");
+        }
+    }
+
+private:
+    std::ofstream out_;
+};
+
+// Reads PODs and counted arrays from a mapped file, checking every read against its end
+class PlanReader {
+public:
+    PlanReader(const char *data, std::size_t size) : data_(data), size_(size) {}
+
+    template <typename T>
+    T pod()
+    {
+        T value;
+        take(&value, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    std::vector<T> array()
+    {
+        std::uint64_t count = pod<std::uint64_t>();
+        if (count > (size_ - offset_) / sizeof(T)) {
+            throw std::runtime_error("Model plan: truncated file.");
+        }
+        std::vector<T> values(count);
+        take(values.data(), count * sizeof(T));
+        return values;
+    }
+
+    bool done() const { return offset_ == size_; }
+
+private:
+    const char *data_;
+    std::size_t size_;
+    std::size_t offset_ = 0;
+
+    void take(void *destination, std::size_t bytes)
+    {
+        if (bytes > size_ - offset_) {
+            throw std::runtime_error("Model plan: truncated file.");
+        }
+        std::memcpy(destination, data_ + offset_, bytes);
+        offset_ += bytes;
+    }
+};
+
+// Read-only mapping of a whole file, unmapped on scope exit
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Model plan: cannot open " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("Model plan: " + path + " is empty or unreadable");
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        void *map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            throw std::runtime_error("Model plan: cannot map " + path + ": " + std::strerror(errno));
+        }
+        data_ = static_cast<const char *>(map);
+    }
+
+    ~MappedFile() { munmap(const_cast<char *>(data_), size_); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+std::size_t product(const std::vector<std::size_t> &shape)
+{
+    std::size_t n = 1;
+    for (std::size_t d : shape) n *= d;
+    return n;
+}
+
+// Number of weights the layer kind expects for its weight shape
+std::size_t weight_rank(PlanLayerKind kind)
+{
+    switch (kind) {
+    case PlanLayerKind::Conv2d: return 4;
+    case PlanLayerKind::Linear: return 2;
+    default: return 0;
+    }
+}
+
+// Layers that sum lazily squared (size-3) inputs and relinearize once per output
+bool relinearizes_sums(PlanLayerKind kind)
+{
+    switch (kind) {
+    case PlanLayerKind::Conv2d:
+    case PlanLayerKind::AvgPool:
+    case PlanLayerKind::AdaptiveAvgPool:
+    case PlanLayerKind::Linear: return true;
+    default: return false;
+    }
+}
+
+// A square may leave its outputs at size 3 only if the next layer, past any Flatten, relinearizes
+// them: squaring a size-3 ciphertext again gives size 5, which no relinearization key covers
+bool square_is_lazy(const std::vector<PlanLayer> &layers, std::size_t i)
+{
+    std::size_t next = i + 1;
+    while (next < layers.size() && layers[next].kind == PlanLayerKind::Flatten) {
+        next++;
+    }
+    return next < layers.size() && relinearizes_sums(layers[next].kind);
+}
+
+} // namespace
+
+ModelPlan::ModelPlan(std::size_t poly_modulus_degree, double scale, std::vector<int> bit_sizes,
+                     std::vector<std::size_t> input_shape)
+    : poly_modulus_degree_(poly_modulus_degree), scale_(scale), bit_sizes_(std::move(bit_sizes)),
+      input_shape_(std::move(input_shape)) {}
+
+void ModelPlan::add_layer(PlanLayer layer)
+{
+    std::size_t rank = weight_rank(layer.kind);
+    if (layer.weight_shape.size() != rank || (rank > 0 && product(layer.weight_shape) != layer.weights.size())) {
+        throw std::invalid_argument("Model plan: weights do not match the layer's weight shape.");
+    }
+    if (rank > 0 && !layer.bias.empty() && layer.bias.size() != layer.weight_shape[0]) {
+        throw std::invalid_argument("Model plan: bias length does not match the layer's outputs.");
+    }
+    layers_.push_back(std::move(layer));
+}
+
+std::vector<std::uint64_t> ModelPlan::data_primes(const CKKSPyfhel &he)
+{
+    std::vector<std::uint64_t> primes;
+    for (const auto &q : he.context().first_context_data()->parms().coeff_modulus()) {
+        primes.push_back(q.value());
+    }
+    return primes;
+}
+
+void ModelPlan::compile(const CKKSPyfhel &he)
+{
+    if (layers_.empty()) {
+        throw std::runtime_error("Model plan: no layers.");
+    }
+    if (he.context().first_context_data()->parms().poly_modulus_degree() != poly_modulus_degree_ ||
+        he.scale() != scale_) {
+        throw std::invalid_argument("Model plan: context does not have the plan's parameters.");
+    }
+    coeff_modulus_ = data_primes(he);
+
+    // Pre-encode the weights: this is the work the server no longer does at startup
+    for (PlanLayer &layer : layers_) {
+        layer.encoded.assign(layer.weights.size(), ScalarConstant{});
+        TaskScheduler::instance().parallel_for(layer.weights.size(), [&](std::size_t i) {
+            layer.encoded[i] = he.encodeScalar(layer.weights[i]);
+        });
+    }
+
+    // The graph must hold together for the input shape
+    std::vector<std::shared_ptr<const Layer>> built = build(he);
+
+    // Ciphertext sizes: a size-3 (lazily squared) input must reach a layer that relinearizes it
+    std::size_t ct_size = 2;
+    for (std::size_t i = 0; i < layers_.size(); i++) {
+        PlanLayerKind kind = layers_[i].kind;
+        if (ct_size > 2 && kind != PlanLayerKind::Flatten && !relinearizes_sums(kind)) {
+            throw std::runtime_error("Model plan: layer " + std::to_string(i) + " receives size-" + std::to_string(ct_size) +
+                                     " ciphertexts it cannot relinearize.");
+        }
+        if (kind == PlanLayerKind::Square) {
+            auto square = std::dynamic_pointer_cast<const SquareLayer>(built[i]);
+            ct_size = square && square->lazy_relinearize() ? 3 : 2;
+        } else if (kind != PlanLayerKind::Flatten) {
+            ct_size = 2;
+        }
+    }
+    if (ct_size > 2) {
+        throw std::runtime_error("Model plan: the model output is not relinearized.");
+    }
+    std::vector<std::size_t> shape = input_shape_;
+    for (std::size_t i = 0; i < built.size(); i++) {
+        try {
+            shape = built[i]->infer_shape(shape);
+        } catch (const std::exception &e) {
+            throw std::runtime_error("Model plan: layer " + std::to_string(i) + " rejects its input: " + e.what());
+        }
+    }
+
+    // Levels: layer i gets exactly the depth of layers i and onwards
+    std::vector<std::size_t> remaining(built.size() + 1, 0);
+    for (std::size_t i = built.size(); i-- > 0;) {
+        remaining[i] = remaining[i + 1] + built[i]->depth();
+    }
+    auto top = he.context().first_context_data();
+    if (remaining[0] > top->chain_index()) {
+        throw std::runtime_error("Model plan: the model consumes " + std::to_string(remaining[0]) +
+                                 " levels, the coefficient modulus offers " + std::to_string(top->chain_index()));
+    }
+
+    // Scales: each rescale divides by the last prime of the level it leaves. Products are taken
+    // with constants at the encoding scale, except Square, which multiplies its input by itself.
+    double scale = scale_;
+    for (std::size_t i = 0; i < layers_.size(); i++) {
+        layers_[i].depth_in = remaining[i];
+        layers_[i].scale_in = scale;
+        if (built[i]->depth() == 0) {
+            continue;
+        }
+        auto level = top;
+        while (level->chain_index() != remaining[i]) {
+            level = level->next_context_data();
+        }
+        double product_scale = scale * (layers_[i].kind == PlanLayerKind::Square ? scale : scale_);
+        scale = product_scale / static_cast<double>(level->parms().coeff_modulus().back().value());
+    }
+    output_scale_ = scale;
+}
+
+std::shared_ptr<const Layer> ModelPlan::build_layer(const CKKSPyfhel &he, const PlanLayer &layer, bool lazy_square)
+{
+    const std::vector<std::size_t> &ws = layer.weight_shape;
+    if (weight_rank(layer.kind) > 0 && layer.encoded.size() != layer.weights.size()) {
+        throw std::runtime_error("Model plan: weights are not encoded (compile the plan first).");
+    }
+
+    switch (layer.kind) {
+    case PlanLayerKind::Conv2d: {
+        std::vector<std::vector<std::vector<std::vector<double>>>> weights(
+            ws[0], std::vector<std::vector<std::vector<double>>>(ws[1], std::vector<std::vector<double>>(ws[2], std::vector<double>(ws[3]))));
+        std::vector<std::vector<std::vector<std::vector<ScalarConstant>>>> encoded(
+            ws[0], std::vector<std::vector<std::vector<ScalarConstant>>>(ws[1], std::vector<std::vector<ScalarConstant>>(ws[2], std::vector<ScalarConstant>(ws[3]))));
+        std::size_t i = 0;
+        for (std::size_t f = 0; f < ws[0]; f++)
+            for (std::size_t c = 0; c < ws[1]; c++)
+                for (std::size_t y = 0; y < ws[2]; y++)
+                    for (std::size_t x = 0; x < ws[3]; x++, i++) {
+                        weights[f][c][y][x] = layer.weights[i];
+                        encoded[f][c][y][x] = layer.encoded[i];
+                    }
+        return std::make_shared<Conv2d>(he, std::move(encoded), weights, layer.stride, layer.padding, layer.bias);
+    }
+    case PlanLayerKind::Linear: {
+        std::vector<std::vector<ScalarConstant>> encoded(ws[0], std::vector<ScalarConstant>(ws[1]));
+        for (std::size_t o = 0; o < ws[0]; o++)
+            for (std::size_t j = 0; j < ws[1]; j++) encoded[o][j] = layer.encoded[o * ws[1] + j];
+        return std::make_shared<LinearLayer>(he, std::move(encoded), layer.bias);
+    }
+    case PlanLayerKind::AvgPool:
+        return std::make_shared<AvgPoolLayer>(he, layer.kernel, layer.stride, layer.padding);
+    case PlanLayerKind::AdaptiveAvgPool:
+        return std::make_shared<AdaptiveAvgPoolLayer>(he, layer.kernel);
+    case PlanLayerKind::Square:
+        // Squares stay at size 3 only when the next additive layer relinearizes their sum
+        return std::make_shared<SquareLayer>(he, lazy_square);
+    case PlanLayerKind::Flatten:
+        return std::make_shared<FlattenLayer>();
+    }
+    throw std::runtime_error("Model plan: unknown layer kind.");
+}
+
+std::vector<std::shared_ptr<const Layer>> ModelPlan::build(const CKKSPyfhel &he) const
+{
+    if (data_primes(he) != coeff_modulus_) {
+        throw std::invalid_argument("Model plan: context does not have the coefficient modulus the weights were encoded for.");
+    }
+    // Constants (bias, pooling factors) are encoded right away at the level and scale the schedule
+    // says each layer's input arrives at, which is where Sequential::setLevelDropping puts it
+    std::vector<std::shared_ptr<const Layer>> layers;
+    for (std::size_t i = 0; i < layers_.size(); i++) {
+        const PlanLayer &layer = layers_[i];
+        layers.push_back(build_layer(he, layer, layer.kind == PlanLayerKind::Square && square_is_lazy(layers_, i)));
+        for (auto level = he.context().first_context_data(); level && layer.scale_in > 0; level = level->next_context_data()) {
+            if (level->chain_index() == layer.depth_in) {
+                layers.back()->prepare(level->parms_id(), layer.scale_in);
+                break;
+            }
+        }
+    }
+    return layers;
+}
+
+void ModelPlan::save(const std::string &path) const
+{
+    PlanWriter out(path);
+    out.pod(plan_magic);
+    out.pod(plan_version);
+    out.pod<std::uint64_t>(poly_modulus_degree_);
+    out.pod(scale_);
+    out.array(bit_sizes_);
+    out.array(coeff_modulus_);
+    out.array(std::vector<std::uint64_t>(input_shape_.begin(), input_shape_.end()));
+    out.pod(output_scale_);
+
+    out.pod<std::uint64_t>(layers_.size());
+    for (const PlanLayer &layer : layers_) {
+        out.pod(static_cast<std::uint32_t>(layer.kind));
+        for (int v : { layer.kernel.first, layer.kernel.second, layer.stride.first, layer.stride.second,
+                       layer.padding.first, layer.padding.second }) {
+            out.pod<std::int32_t>(v);
+        }
+        out.pod<std::uint64_t>(layer.depth_in);
+        out.pod(layer.scale_in);
+        out.array(std::vector<std::uint64_t>(layer.weight_shape.begin(), layer.weight_shape.end()));
+        out.array(layer.weights);
+
+        // Residues of every weight, back to back (all constants carry one per data prime)
+        std::vector<std::uint64_t> residues;
+        residues.reserve(layer.encoded.size() * coeff_modulus_.size());
+        for (const ScalarConstant &constant : layer.encoded) {
+            residues.insert(residues.end(), constant.residues.begin(), constant.residues.end());
+        }
+        out.array(residues);
+        out.array(layer.bias);
+    }
+    out.close(path);
+}
+
+ModelPlan ModelPlan::load(const std::string &path)
+{
+    MappedFile file(path);
+    PlanReader in(file.data(), file.size());
+
+    char magic[sizeof(plan_magic)];
+    for (char &c : magic) c = in.pod<char>();
+    if (std::memcmp(magic, plan_magic, sizeof(plan_magic)) != 0 || in.pod<std::uint32_t>() != plan_version) {
+        throw std::runtime_error("Model plan: " + path + " is not a version " + std::to_string(plan_version) + " plan.");
+    }
+
+    std::size_t poly_modulus_degree = in.pod<std::uint64_t>();
+    double scale = in.pod<double>();
+    std::vector<int> bit_sizes = in.array<int>();
+    std::vector<std::uint64_t> coeff_modulus = in.array<std::uint64_t>();
+    std::vector<std::uint64_t> input_shape = in.array<std::uint64_t>();
+
+    ModelPlan plan(poly_modulus_degree, scale, bit_sizes, std::vector<std::size_t>(input_shape.begin(), input_shape.end()));
+    plan.coeff_modulus_ = std::move(coeff_modulus);
+    plan.output_scale_ = in.pod<double>();
+
+    std::uint64_t n_layers = in.pod<std::uint64_t>();
+    for (std::uint64_t l = 0; l < n_layers; l++) {
+        PlanLayer layer;
+        layer.kind = static_cast<PlanLayerKind>(in.pod<std::uint32_t>());
+        layer.kernel.first = in.pod<std::int32_t>();
+        layer.kernel.second = in.pod<std::int32_t>();
+        layer.stride.first = in.pod<std::int32_t>();
+        layer.stride.second = in.pod<std::int32_t>();
+        layer.padding.first = in.pod<std::int32_t>();
+        layer.padding.second = in.pod<std::int32_t>();
+        layer.depth_in = in.pod<std::uint64_t>();
+        layer.scale_in = in.pod<double>();
+        std::vector<std::uint64_t> weight_shape = in.array<std::uint64_t>();
+        layer.weight_shape.assign(weight_shape.begin(), weight_shape.end());
+        layer.weights = in.array<double>();
+
+        std::vector<std::uint64_t> residues = in.array<std::uint64_t>();
+        std::size_t n_primes = plan.coeff_modulus_.size();
+        if (residues.size() != layer.weights.size() * n_primes) {
+            throw std::runtime_error("Model plan: residues do not match the weights in " + path);
+        }
+        layer.encoded.resize(layer.weights.size());
+        for (std::size_t i = 0; i < layer.weights.size(); i++) {
+            layer.encoded[i].value = layer.weights[i];
+            layer.encoded[i].scale = scale;
+            layer.encoded[i].residues.assign(residues.begin() + i * n_primes, residues.begin() + (i + 1) * n_primes);
+        }
+        layer.bias = in.array<double>();
+
+        std::uint32_t kind = static_cast<std::uint32_t>(layer.kind);
+        if (kind < static_cast<std::uint32_t>(PlanLayerKind::Conv2d) || kind > static_cast<std::uint32_t>(PlanLayerKind::Linear)) {
+            throw std::runtime_error("Model plan: unknown layer kind in " + path);
+        }
+        plan.add_layer(std::move(layer));
+    }
+    if (!in.done()) {
+        throw std::runtime_error("Model plan: trailing data in " + path);
+    }
+    return plan;
+}
@@ -0,0 +1,112 @@
+#ifndef MODEL_PLAN_H
+#define MODEL_PLAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "he/he.h"
+#include "layer/layer.h"
+
+enum class PlanLayerKind : std::uint32_t {
+    Conv2d = 1,
+    AvgPool = 2,
+    AdaptiveAvgPool = 3,
+    Square = 4,
+    Flatten = 5,
+    Linear = 6
+};
+
+/**
+ * One layer of a ModelPlan, in execution order.
+ */
+struct PlanLayer {
+    PlanLayerKind kind = PlanLayerKind::Flatten;
+    std::pair<int, int> kernel{ 0, 0 };    // AvgPool kernel; AdaptiveAvgPool output size
+    std::pair<int, int> stride{ 1, 1 };    // Conv2d, AvgPool
+    std::pair<int, int> padding{ 0, 0 };   // Conv2d, AvgPool
+    std::vector<std::size_t> weight_shape; // Conv2d: [n_filters, n_input_channels, fh, fw]; Linear: [out, in]
+    std::vector<double> weights;           // Raw weights, row-major
+    std::vector<double> bias;              // Conv2d: one per filter; Linear: one per output (or empty)
+    std::vector<ScalarConstant> encoded;   // encodeScalar() of each weight (set by compile())
+
+    // Level and scale schedule (set by compile()), with the input and every output dropped to the
+    // levels the remaining layers consume (Sequential::setLevelDropping)
+    std::size_t depth_in = 0;  // Levels left on the layer input
+    double scale_in = 0.0;     // Scale of the layer input
+};
+
+/**
+ * Serialized HE execution plan of a model: CKKS parameters, layer graph, level and scale schedule,
+ * and weights pre-encoded for those parameters.
+ * - Built offline by the model compiler (tools/compileModel.cpp, the only LibTorch user), loaded
+ *   by the server with one mmap: no weight is re-encoded at startup.
+ * - Encoded weights are only valid under the exact coefficient modulus they were encoded for;
+ *   build() checks it against the context.
+ *
+ * File layout (native endianness): magic "HEPLAN", version, parameters (poly_modulus_degree,
+ * scale, bit sizes, coefficient modulus), input shape, then per layer its kind, window, schedule,
+ * weight shape, raw weights, residues (one per prime of the top data level per weight) and bias.
+ * Arrays are stored as a 64-bit count followed by the elements.
+ */
+class ModelPlan {
+public:
+    /**
+     * @param poly_modulus_degree CKKS parameters the plan is compiled for (see CKKSPyfhel)
+     * @param scale               Encoding scale
+     * @param bit_sizes           Coefficient modulus bit sizes
+     * @param input_shape         Encrypted input shape, batch axis included
+     */
+    ModelPlan(std::size_t poly_modulus_degree, double scale, std::vector<int> bit_sizes,
+              std::vector<std::size_t> input_shape);
+
+    // Append a layer (raw weights only); compile() fills in the rest
+    void add_layer(PlanLayer layer);
+
+    // Encode every weight with he (created from this plan's parameters), check the layer graph by
+    // shape inference and compute the level and scale schedule. Throws if the model does not fit
+    // the modulus chain, or if a lazily squared (size-3) output would reach a layer that does not
+    // relinearize it.
+    void compile(const CKKSPyfhel &he);
+
+    void save(const std::string &path) const;
+
+    // Map path and parse it (the mapping is dropped once the plan is read)
+    static ModelPlan load(const std::string &path);
+
+    // Layers on he from the pre-encoded weights, their constants prepared at the scheduled levels
+    // (Layer::prepare); throws unless he has the plan's coefficient modulus
+    std::vector<std::shared_ptr<const Layer>> build(const CKKSPyfhel &he) const;
+
+    std::size_t poly_modulus_degree() const { return poly_modulus_degree_; }
+    double scale() const { return scale_; }
+    const std::vector<int> &bit_sizes() const { return bit_sizes_; }
+    const std::vector<std::size_t> &input_shape() const { return input_shape_; }
+    const std::vector<PlanLayer> &layers() const { return layers_; }
+
+    // Levels the whole model consumes (the input's depth_left once dropped)
+    std::size_t depth() const { return layers_.empty() ? 0 : layers_.front().depth_in; }
+
+    // Expected scale of the model output
+    double output_scale() const { return output_scale_; }
+
+private:
+    std::size_t poly_modulus_degree_;
+    double scale_;
+    std::vector<int> bit_sizes_;
+    std::vector<std::uint64_t> coeff_modulus_;  // Primes of the top data level (set by compile())
+    std::vector<std::size_t> input_shape_;
+    std::vector<PlanLayer> layers_;
+    double output_scale_ = 0.0;
+
+    // Primes of he's top data level
+    static std::vector<std::uint64_t> data_primes(const CKKSPyfhel &he);
+
+    // One layer on he from its encoded weights; lazy_square: a Square layer leaves its outputs
+    // unrelinearized for the next layer to relinearize
+    static std::shared_ptr<const Layer> build_layer(const CKKSPyfhel &he, const PlanLayer &layer, bool lazy_square);
+};
+
+#endif // MODEL_PLAN_H
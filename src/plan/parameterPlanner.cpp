@@ -0,0 +1,82 @@
+#include "parameterPlanner.h"
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include "functions/square.h"
+#include "pooling/adaptiveAvgPooling.h"
+#include "pooling/avgPooling.h"
+
+ModelDepth count_depth(const std::vector<std::shared_ptr<const Layer>> &layers)
+{
+    ModelDepth depth;
+    for (const auto &layer : layers) {
+        std::size_t rescales = layer->depth();
+        if (dynamic_cast<const SquareLayer *>(layer.get())) {
+            depth.squarings += rescales;
+        } else if (dynamic_cast<const AvgPoolLayer *>(layer.get()) || dynamic_cast<const AdaptiveAvgPoolLayer *>(layer.get())) {
+            depth.pool_scalings += rescales;
+        } else {
+            depth.products += rescales;
+        }
+    }
+    return depth;
+}
+
+ModelDepth count_depth(const std::vector<PlanLayer> &layers)
+{
+    ModelDepth depth;
+    for (const PlanLayer &layer : layers) {
+        switch (layer.kind) {
+        case PlanLayerKind::Conv2d:
+        case PlanLayerKind::Linear:
+            depth.products++;
+            break;
+        case PlanLayerKind::Square:
+            depth.squarings++;
+            break;
+        case PlanLayerKind::AvgPool:
+        case PlanLayerKind::AdaptiveAvgPool:
+            depth.pool_scalings++;
+            break;
+        case PlanLayerKind::Flatten:
+            break;
+        }
+    }
+    return depth;
+}
+
+CkksParameters plan_ckks_parameters(const ModelDepth &depth, const PrecisionTarget &target)
+{
+    // SEAL primes are at most 60 bits; much below 20 bits the rescales lose the precision
+    int output_bits = target.scale_bits + target.integer_bits;
+    if (target.scale_bits < 20 || target.integer_bits < 0 || output_bits > 60) {
+        throw std::invalid_argument("Parameter planner: need 20 <= scale_bits and scale_bits + integer_bits <= 60.");
+    }
+    if (target.min_degree < 1024 || (target.min_degree & (target.min_degree - 1)) != 0) {
+        throw std::invalid_argument("Parameter planner: min_degree must be a power of two, at least 1024.");
+    }
+
+    CkksParameters parameters;
+    parameters.scale = std::ldexp(1.0, target.scale_bits);
+    parameters.bit_sizes.push_back(output_bits);
+    parameters.bit_sizes.insert(parameters.bit_sizes.end(), depth.rescales(), target.scale_bits);
+    parameters.bit_sizes.push_back(output_bits);  // Special prime, not smaller than any data prime
+    int total_bits = std::accumulate(parameters.bit_sizes.begin(), parameters.bit_sizes.end(), 0);
+
+    for (std::size_t n = target.min_degree; n <= 32768; n *= 2) {
+        if (n / 2 < target.min_slots || total_bits > seal::CoeffModulus::MaxBitCount(n, target.security)) {
+            continue;
+        }
+        try {
+            // Enough primes of these sizes congruent to 1 mod 2n?
+            seal::CoeffModulus::Create(n, parameters.bit_sizes);
+        } catch (const std::logic_error &) {
+            continue;
+        }
+        parameters.poly_modulus_degree = n;
+        return parameters;
+    }
+    throw std::runtime_error("Parameter planner: " + std::to_string(depth.rescales()) + " rescales need a " +
+                             std::to_string(total_bits) + "-bit coefficient modulus, more than any degree up to 32768 allows.");
+}
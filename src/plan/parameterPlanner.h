@@ -0,0 +1,64 @@
+#ifndef PARAMETER_PLANNER_H
+#define PARAMETER_PLANNER_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "he/he.h"
+#include "layer/layer.h"
+#include "plan/modelPlan.h"
+
+/**
+ * Multiplicative depth of a model, by kind of rescale.
+ */
+struct ModelDepth {
+    std::size_t products = 0;       // Conv2d and Linear: ciphertext x weight
+    std::size_t squarings = 0;      // Square: ciphertext x ciphertext
+    std::size_t pool_scalings = 0;  // AvgPool and AdaptiveAvgPool: the 1/(k*k) scaling
+
+    // Rescales one forward pass performs: the data primes the chain needs besides the output prime
+    std::size_t rescales() const { return products + squarings + pool_scalings; }
+};
+
+// Depth of a layer graph (Layer::depth(), classified by layer type)
+ModelDepth count_depth(const std::vector<std::shared_ptr<const Layer>> &layers);
+
+// Depth of the layers of a model plan, before any context exists (e.g. in the model compiler)
+ModelDepth count_depth(const std::vector<PlanLayer> &layers);
+
+/**
+ * Precision and security a parameter set must meet.
+ */
+struct PrecisionTarget {
+    int scale_bits = 30;    // Fractional precision: scale 2^scale_bits, one prime of that size per rescale
+    int integer_bits = 10;  // Headroom of the output prime above the scale (|values| < 2^integer_bits)
+    std::size_t min_slots = 1;  // Slots a ciphertext must offer (batch or packed layouts need more)
+    // Smallest degree to consider (a power of two). Below 4096 MaxBitCount leaves room for about one
+    // small prime (27 bits at N = 1024, 54 at 2048), too little for any scale with useful precision.
+    std::size_t min_degree = 4096;
+    seal::sec_level_type security = seal::sec_level_type::tc128;
+};
+
+/**
+ * CKKS parameters in the form CKKSPyfhel takes them.
+ */
+struct CkksParameters {
+    std::size_t poly_modulus_degree = 0;
+    double scale = 0.0;
+    std::vector<int> bit_sizes;  // Output prime, one prime per rescale, special (key switching) prime
+};
+
+/**
+ * @brief Smallest parameters that evaluate depth at target.
+ *
+ * The chain is the shortest one: an output prime of scale_bits + integer_bits, depth.rescales()
+ * primes of scale_bits (each rescale divides by about the scale) and a special prime as large as
+ * the largest data prime. poly_modulus_degree is the smallest power of two from min_degree whose
+ * CoeffModulus::MaxBitCount at the security level fits the chain, that offers min_slots and for
+ * which SEAL finds the primes. Every ciphertext operation is linear in the degree and in the number
+ * of primes, so both are kept to what the model needs.
+ * Throws if no degree up to 32768 fits.
+ */
+CkksParameters plan_ckks_parameters(const ModelDepth &depth, const PrecisionTarget &target = {});
+
+#endif // PARAMETER_PLANNER_H
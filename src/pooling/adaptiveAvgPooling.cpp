@@ -1,86 +1,116 @@
 #include "adaptiveAvgPooling.h"
 #include <stdexcept>
 #include <iostream>
+#include "runtime/taskScheduler.h"
 
-AdaptiveAvgPoolLayer::AdaptiveAvgPoolLayer(CKKSPyfhel &he, std::pair<int, int> output_size)
+AdaptiveAvgPoolLayer::AdaptiveAvgPoolLayer(const CKKSPyfhel &he, std::pair<int, int> output_size)
     : he_(he), output_size_(output_size) {}
 
 // Apply Adaptive Average Pooling on batch of encrypted images
-std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>
-AdaptiveAvgPoolLayer::operator()(const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input) {
-    
-    size_t n_images = input.size();
-    size_t n_channels = (n_images > 0) ? input[0].size() : 0;
-
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> result(n_images);
+CipherTensor AdaptiveAvgPoolLayer::operator()(const CipherTensor &input) const {
+    CipherTensor result(infer_shape(input.shape()));
+    pool(input, result, false);
+    return result;
+}
 
-    for (size_t img = 0; img < n_images; img++) {
-        result[img].resize(n_channels);
-        for (size_t ch = 0; ch < n_channels; ch++) {
-            result[img][ch] = adaptive_avg(input[img][ch]);
-        }
-    }
+CipherTensor AdaptiveAvgPoolLayer::operator()(CipherTensor &&input) const {
+    bool owned = !input.is_shared();
+    CipherTensor result(infer_shape(input.shape()));
+    pool(std::move(input), result, owned);
     return result;
 }
 
-// Perform Adaptive Average Pooling on a Single Channel
-std::vector<std::vector<seal::Ciphertext>>
-AdaptiveAvgPoolLayer::adaptive_avg(const std::vector<std::vector<seal::Ciphertext>> &image) {
-    size_t input_height = image.size();
-    size_t input_width = (input_height > 0) ? image[0].size() : 0;
-    size_t target_height = output_size_.first;
-    size_t target_width = output_size_.second;
+void AdaptiveAvgPoolLayer::forward(const CipherTensor &input, CipherTensor &output) const {
+    pool(input, output, false);
+}
 
-    if (target_height == 0 || target_width == 0) {
+std::vector<size_t> AdaptiveAvgPoolLayer::infer_shape(const std::vector<size_t> &input_shape) const {
+    if (input_shape.size() != 4) {
+        throw std::invalid_argument("Adaptive pooling expects a 4D input [n_images, channels, height, width].");
+    }
+    if (output_size_.first <= 0 || output_size_.second <= 0) {
         throw std::invalid_argument("Adaptive pooling output size must be non-zero.");
     }
+    size_t out_height = static_cast<size_t>(output_size_.first);
+    size_t out_width = static_cast<size_t>(output_size_.second);
+    if (input_shape[2] < out_height || input_shape[3] < out_width) {
+        throw std::invalid_argument("Adaptive pooling output is larger than its input.");
+    }
+    return { input_shape[0], input_shape[1], out_height, out_width };
+}
 
-    // Compute kernel size and stride
-    int kernel_height = input_height / target_height;
-    int kernel_width = input_width / target_width;
-    std::pair<int, int> kernel_size = { kernel_height, kernel_width };
-    std::pair<int, int> stride = kernel_size;
+void AdaptiveAvgPoolLayer::pool(CipherTensor input, CipherTensor &result, bool release_input) const {
+    if (result.shape() != infer_shape(input.shape())) {
+        throw std::invalid_argument("Adaptive pooling: output tensor does not match the inferred output shape.");
+    }
+    if (input.empty()) {
+        return;
+    }
+    size_t n_images = input.dim(0);
+    size_t n_channels = input.dim(1);
 
-    // Prepare encoded denominator (1 / kernel_size)
-    double scale_factor = 1.0 / (kernel_size.first * kernel_size.second);
-    seal::Plaintext denominator = he_.encode(scale_factor);
+    // Every window of a pass has the same area: one encoding of 1/area serves all channels
+    size_t area = (input.dim(2) / result.dim(2)) * (input.dim(3) / result.dim(3));
+    const ScalarConstant &denominator = denominator_at(input[0].parms_id(), area);
 
-    // Initialize pooled result
-    std::vector<std::vector<seal::Ciphertext>> pooled(target_height, std::vector<seal::Ciphertext>(target_width));
+    TaskScheduler::instance().parallel_for(n_images, n_channels, [&](size_t img, size_t ch) {
+        CipherTensor channel_out = result.slice(img).slice(ch);
+        CipherTensor channel_in = input.slice(img).slice(ch);
+        adaptive_avg(channel_in, denominator, channel_out);
+        if (release_input) {
+            for (auto &ct : channel_in) {
+                ct.release();
+            }
+        }
+    });
+}
+
+const ScalarConstant &AdaptiveAvgPoolLayer::denominator_at(const seal::parms_id_type &parms_id, size_t area) const {
+    // Looked up once per pass, so the lock on the level's entry is not contended
+    const Denominators &denominators = denominator_bank_.get(parms_id, he_.scale(), [] { return Denominators(); });
+    std::lock_guard<std::mutex> lock(denominators.mutex);
+    auto it = denominators.by_area.find(area);
+    if (it == denominators.by_area.end()) {
+        it = denominators.by_area.emplace(area, he_.encodeScalar(1.0 / static_cast<double>(area), parms_id, he_.scale())).first;
+    }
+    return it->second;
+}
+
+// Perform Adaptive Average Pooling on a Single Channel
+void AdaptiveAvgPoolLayer::adaptive_avg(const CipherTensor &image, const ScalarConstant &denominator,
+                                        CipherTensor &pooled) const {
+    size_t input_height = image.dim(0);
+    size_t input_width = image.dim(1);
+    size_t target_height = pooled.dim(0);
+    size_t target_width = pooled.dim(1);
+
+    // Compute kernel size and stride
+    std::pair<size_t, size_t> kernel_size = { input_height / target_height, input_width / target_width };
+    std::pair<size_t, size_t> stride = kernel_size;
 
     for (size_t y = 0; y < target_height; y++) {
         for (size_t x = 0; x < target_width; x++) {
-            // Aggregate values inside kernel
-            seal::Ciphertext sum_ct;
-            bool first = true;
-
+            // Gather the pixels inside the kernel
+            std::vector<const seal::Ciphertext *> window;
             for (size_t ky = 0; ky < kernel_size.first; ky++) {
                 for (size_t kx = 0; kx < kernel_size.second; kx++) {
                     size_t idx_y = y * stride.first + ky;
                     size_t idx_x = x * stride.second + kx;
 
                     if (idx_y < input_height && idx_x < input_width) {
-                        if (first) {
-                            sum_ct = image[idx_y][idx_x]; // Initialize sum
-                            first = false;
-                        } else {
-                            he_.evaluator_->add_inplace(sum_ct, image[idx_y][idx_x]); // Sum pixels
-                            
-                        }
+                        window.push_back(&image(idx_y, idx_x));
                     }
                 }
             }
 
-            // Compute average (sum * (1/kernel_size))
-            he_.evaluator_->mod_switch_to_inplace(denominator, sum_ct.parms_id());
-            denominator.scale() = sum_ct.scale();  
-
-            he_.evaluator_->multiply_plain_inplace(sum_ct, denominator);
-            he_.evaluator_->rescale_to_next_inplace(sum_ct);
+            // Compute average (sum * (1/kernel_size)) in one fused pass, then rescale once
+            std::vector<const ScalarConstant *> weights(window.size(), &denominator);
+            seal::Ciphertext sum_ct;
+            he_.multiply_const_accumulate(window, weights, sum_ct);
+            he_.evaluator().rescale_to_next_inplace(sum_ct, he_.pool());
+            he_.relinearize_inplace(sum_ct);
 
-            std::cout << "Done ! \n";
-            pooled[y][x] = std::move(sum_ct);
+            pooled(y, x) = std::move(sum_ct);
         }
     }
-    return pooled;
 }
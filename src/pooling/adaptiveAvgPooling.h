@@ -1,22 +1,53 @@
 #ifndef ADAPTIVE_AVG_POOLING_H
 #define ADAPTIVE_AVG_POOLING_H
 
+#include <map>
+#include <mutex>
 #include <vector>
 #include "he/he.h"
+#include "layer/layer.h"
+#include "runtime/constantBank.h"
 
-class AdaptiveAvgPoolLayer {
+// Forward passes are const and reentrant: one layer serves concurrent requests
+class AdaptiveAvgPoolLayer : public Layer {
 public:
-    AdaptiveAvgPoolLayer(CKKSPyfhel &he, std::pair<int, int> output_size);
+    AdaptiveAvgPoolLayer(const CKKSPyfhel &he, std::pair<int, int> output_size);
 
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>
-    operator()(const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input);
+    // [n_images, channels, height, width] -> [n_images, channels, output_height, output_width]
+    CipherTensor operator()(const CipherTensor &input) const;
+
+    // Same pass, consuming the input: each channel is released as soon as it is pooled
+    // (an input shared with other tensors is left untouched)
+    CipherTensor operator()(CipherTensor &&input) const override;
+
+    // Layer interface: [n_images, channels, output_height, output_width]; the input must be 4D
+    // and at least as large as the output
+    std::vector<size_t> infer_shape(const std::vector<size_t> &input_shape) const override;
+    void forward(const CipherTensor &input, CipherTensor &output) const override;
+
+    // Levels (rescales) one forward pass consumes: the 1/(k*k) scaling
+    size_t depth() const override { return 1; }
 
 private:
-    CKKSPyfhel &he_;
+    // Pool a view of the input into output; release_input frees each channel once it is pooled
+    void pool(CipherTensor input, CipherTensor &output, bool release_input) const;
+
+    const CKKSPyfhel &he_;
     std::pair<int, int> output_size_;
 
-    std::vector<std::vector<seal::Ciphertext>>
-    adaptive_avg(const std::vector<std::vector<seal::Ciphertext>> &image);
+    // 1/area for every window area met at one level and scale (the area follows the input shape,
+    // so the entries are added as shapes arrive; std::map keeps references to them valid)
+    struct Denominators {
+        mutable std::mutex mutex;
+        mutable std::map<size_t, ScalarConstant> by_area;
+    };
+    ConstantBank<Denominators> denominator_bank_;
+
+    // 1/area encoded at this level and the encoding scale, on first use
+    const ScalarConstant &denominator_at(const seal::parms_id_type &parms_id, size_t area) const;
+
+    // Pool one channel [height, width] into the view pooled [output_height, output_width]
+    void adaptive_avg(const CipherTensor &image, const ScalarConstant &denominator, CipherTensor &pooled) const;
 };
 
 #endif // ADAPTIVE_AVG_POOLING_H
@@ -1,88 +1,256 @@
 #include "avgPooling.h"
-#include "convolution/convolution.h"  // For apply_padding
+#include "convolution/convolution.h"  // For convolute2d_packed
 #include <iostream>
-#include <omp.h>
+#include <stdexcept>
+#include "runtime/taskScheduler.h"
+#include "runtime/recycler.h"
+#include "runtime/rowPipeline.h"
+
+// One output pixel (y, x) of average pooling on a 2D image [height, width]
+static seal::Ciphertext avg_window(
+    const CKKSPyfhel &he,
+    const CipherTensor &image,
+    std::pair<int, int> kernel_size,
+    std::pair<int, int> stride,
+    std::pair<int, int> padding,
+    const ScalarConstant &denominator,
+    int y,
+    int x)
+{
+    int y_k = kernel_size.first;
+    int x_k = kernel_size.second;
+    int y_d = image.dim(0);
+    int x_d = image.dim(1);
+
+    // Gather the in-bounds pixels of the kernel window (list recycled from pixel to pixel)
+    Recycled<std::vector<const seal::Ciphertext *>> window;
+    window->clear();
+    for (int fy = 0; fy < y_k; fy++) {
+        int iy = y * stride.first - padding.first + fy;
+        if (iy < 0 || iy >= y_d) continue;
+        for (int fx = 0; fx < x_k; fx++) {
+            int ix = x * stride.second - padding.second + fx;
+            if (ix < 0 || ix >= x_d) continue;
+            window->push_back(&image(iy, ix));
+        }
+    }
+
+    // Sum and scale by the denominator in one fused pass, then rescale once.
+    // Lazily squared (size-3) inputs are relinearized once here, on one prime less.
+    Recycled<std::vector<const ScalarConstant *>> weights;
+    weights->assign(window->size(), &denominator);
+    seal::Ciphertext sum_ct;
+    he.multiply_const_accumulate(*window, *weights, sum_ct);
+    he.evaluator().rescale_to_next_inplace(sum_ct, he.pool());
+    he.relinearize_inplace(sum_ct);
+    return sum_ct;
+}
 
 // Constructor
-AvgPoolLayer::AvgPoolLayer(CKKSPyfhel &he, std::pair<int, int> kernel_size, std::pair<int, int> stride, std::pair<int, int> padding)
+AvgPoolLayer::AvgPoolLayer(const CKKSPyfhel &he, std::pair<int, int> kernel_size, std::pair<int, int> stride, std::pair<int, int> padding)
     : he_(he), kernel_size_(kernel_size), stride_(stride), padding_(padding) {}
 
 // Forward pass
-std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> AvgPoolLayer::operator()(
-    const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input)
+CipherTensor AvgPoolLayer::operator()(const CipherTensor &input) const
 {
-    auto padded_input = apply_padding(input, padding_, he_);
+    CipherTensor result(infer_shape(input.shape()));
+    forward(input, result);
+    return result;
+}
 
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> result;
-    result.resize(padded_input.size());  // Number of images
+void AvgPoolLayer::forward(const CipherTensor &input, CipherTensor &result) const
+{
+    // infer_shape checks the padding: with padding >= kernel some windows would be empty, and the
+    // fused kernel would throw inside the parallel region.
+    // Padding is virtual: avg skips window pixels that fall on the zero border
+    if (result.shape() != infer_shape(input.shape())) {
+        throw std::runtime_error("AvgPool: output tensor does not match the inferred output shape.");
+    }
+    size_t n_images = input.dim(0);
+    size_t n_channels = input.dim(1);
+    if (input.empty()) {
+        return;
+    }
+    const ScalarConstant &denominator = denominator_at(input[0].parms_id());
 
-    for (size_t img = 0; img < padded_input.size(); img++) {
-        result[img].resize(padded_input[img].size());  // Number of layers
-        #pragma omp parallel for
-        for (size_t layer = 0; layer < padded_input[img].size(); layer++) {
-            result[img][layer] = avg(he_, padded_input[img][layer], kernel_size_, stride_);
-        }
+    // One task per (image, channel); avg splits each into per-pixel tasks, so the former
+    // nested parallel regions become one pool of stealable work
+    TaskScheduler::instance().parallel_for(n_images, n_channels, [&](size_t img, size_t layer) {
+        CipherTensor layer_out = result.slice(img).slice(layer);
+        avg(he_, input.slice(img).slice(layer), kernel_size_, stride_, padding_, denominator, layer_out);
+    });
+}
+
+void AvgPoolLayer::prepare(const seal::parms_id_type &parms_id, double /*scale*/) const
+{
+    denominator_at(parms_id);
+}
+
+const ScalarConstant &AvgPoolLayer::denominator_at(const seal::parms_id_type &parms_id) const
+{
+    return denominator_bank_.get(parms_id, he_.scale(), [&] {
+        return he_.encodeScalar(1.0 / (kernel_size_.first * kernel_size_.second), parms_id, he_.scale());
+    });
+}
+
+CipherTensor AvgPoolLayer::operator()(CipherTensor &&input) const
+{
+    // One-stage row pipeline, which frees input rows as the pooled rows pass them
+    return run_row_pipeline({ make_row_stage(this) }, std::move(input)).back();
+}
+
+// Row interface: channels are pooled independently, so a row needs the kernel_height input rows under it
+std::vector<size_t> AvgPoolLayer::output_shape(const std::vector<size_t> &input_shape) const
+{
+    if (input_shape.size() != 3) {
+        throw std::runtime_error("AvgPool: row input must be [channels, height, width].");
+    }
+    if (padding_.first < 0 || padding_.second < 0 ||
+        padding_.first >= kernel_size_.first || padding_.second >= kernel_size_.second) {
+        throw std::runtime_error("AvgPool padding must be non-negative and smaller than the kernel.");
     }
+    return { input_shape[0],
+             sliding_window_output_size(input_shape[1], kernel_size_.first, stride_.first, padding_.first),
+             sliding_window_output_size(input_shape[2], kernel_size_.second, stride_.second, padding_.second) };
+}
 
-    return result;
+std::pair<size_t, size_t> AvgPoolLayer::input_rows(size_t out_row, size_t in_height) const
+{
+    return sliding_window_input_rows(out_row, in_height, kernel_size_.first, stride_.first, padding_.first);
 }
 
-// Avg Pooling Function for a 2D Image
-std::vector<std::vector<seal::Ciphertext>> AvgPoolLayer::avg(
-    CKKSPyfhel &he,
-    const std::vector<std::vector<seal::Ciphertext>> &image,
-    std::pair<int, int> kernel_size,
-    std::pair<int, int> stride)
+void AvgPoolLayer::forward_row(const CipherTensor &image, CipherTensor &output, size_t out_row) const
 {
-    int y_s = stride.first;
-    int x_s = stride.second;
+    std::vector<CipherTensor> channels;
+    for (size_t c = 0; c < image.dim(0); c++) {
+        channels.push_back(image.slice(c));
+    }
 
-    int y_k = kernel_size.first;
-    int x_k = kernel_size.second;
+    // Any pixel of the window rows carries the input level (the fused kernel checks they all agree)
+    std::pair<size_t, size_t> rows = input_rows(out_row, image.dim(1));
+    const ScalarConstant &denominator = denominator_at(image(0, rows.first, 0).parms_id());
+
+    // One task per (channel, output column) of the row
+    TaskScheduler::instance().parallel_for(channels.size(), output.dim(2), [&](size_t c, size_t x) {
+        output(c, out_row, x) = avg_window(
+            he_, channels[c], kernel_size_, stride_, padding_, denominator, static_cast<int>(out_row), static_cast<int>(x));
+    });
+}
+
+// Packed output layout: the window sum stays on the slot of the window's top-left pixel
+PackedLayout AvgPoolLayer::output_layout(const PackedLayout &layout) const
+{
+    return packed_window_layout(layout, kernel_size_, stride_, padding_, layout.channels);
+}
+
+std::vector<int> AvgPoolLayer::rotation_steps(const PackedLayout &layout) const
+{
+    std::vector<int> steps;
+    for (int fx = 0; fx < kernel_size_.second; fx++) {
+        steps.push_back(packed_col_step(layout, padding_, fx));
+    }
+    for (int fy = 0; fy < kernel_size_.first; fy++) {
+        steps.push_back(packed_row_step(layout, padding_, fy));
+    }
+    return steps;
+}
+
+std::shared_ptr<const AvgPoolLayer::PackedPlan> AvgPoolLayer::packed_plan(const PackedLayout &layout) const
+{
+    std::shared_ptr<const PackedPlan> current = std::atomic_load(&packed_plan_);
+    if (current && current->layout == layout) {
+        return current;
+    }
+
+    int y_k = kernel_size_.first;
+    int x_k = kernel_size_.second;
+    int slots = static_cast<int>(he_.slot_count());
+    int block = static_cast<int>(layout.channel_stride);
+    size_t n = layout.channels_per_ct;
+    size_t n_cts = layout.n_ciphertexts();
+    PackedLayout out = output_layout(layout);
+
+    // Average pooling is a depthwise convolution with every tap equal to 1/(k*k)
+    double denominator = 1.0 / (x_k * y_k);
 
-    int y_d = image.size();
-    int x_d = (y_d > 0) ? image[0].size() : 0;
-    
-    int y_o = ((y_d - y_k) / y_s) + 1;
-    int x_o = ((x_d - x_k) / x_s) + 1;
-
-    // Create plaintext for division factor
-    seal::Plaintext denominator = he.encode(1.0 / (x_k * y_k));
-    std::vector<std::vector<seal::Ciphertext>> result(y_o, std::vector<seal::Ciphertext>(x_o));
-
-    // Parallelize the outer loops
-    #pragma omp parallel for collapse(2) default(none) \
-        shared(he, image, result, denominator, y_o, x_o, y_k, x_k, y_s, x_s)
-    for (int y = 0; y < y_o; y++) {
-        for (int x = 0; x < x_o; x++) {
-            // Each thread gets its own sum_ct
-            seal::Ciphertext sum_ct = he.encrypt(0.0);
-            
-            // Process the kernel window
-            for (int fy = 0; fy < y_k; fy++) {
-                for (int fx = 0; fx < x_k; fx++) {
-                    int row = y * y_s + fy;
-                    int col = x * x_s + fx;
-                    
-                    // No need for critical section here as each thread has its own sum_ct
-                    he.evaluator_->mod_switch_to_inplace(sum_ct, image[row][col].parms_id());
-                    sum_ct.scale() = image[row][col].scale();
-                    he.evaluator_->add_inplace(sum_ct, image[row][col]);
+    auto plan = std::make_shared<PackedPlan>();
+    plan->layout = layout;
+    plan->masks.assign(n_cts, std::vector<std::vector<std::vector<std::vector<seal::Plaintext>>>>(
+        n_cts, std::vector<std::vector<std::vector<seal::Plaintext>>>(
+            1, std::vector<std::vector<seal::Plaintext>>(y_k, std::vector<seal::Plaintext>(x_k)))));
+    plan->tap_used.assign(n_cts, std::vector<std::vector<std::vector<std::vector<char>>>>(
+        n_cts, std::vector<std::vector<std::vector<char>>>(
+            1, std::vector<std::vector<char>>(y_k, std::vector<char>(x_k, 0)))));
+
+    TaskScheduler::instance().parallel_for(y_k, x_k, [&](int fy, int fx) {
+        std::vector<size_t> hits = packed_tap_slots(layout, out, stride_, padding_, fy, fx);
+        if (hits.empty()) return;
+        int row_step = packed_row_step(layout, padding_, fy);
+
+        for (size_t ct = 0; ct < n_cts; ct++) {
+            std::vector<double> mask(slots, 0.0);
+            for (size_t c = 0; c < n && ct * n + c < layout.channels; c++) {
+                for (size_t hit : hits) {
+                    int slot = static_cast<int>(c) * block + static_cast<int>(hit) + row_step;
+                    mask[((slot % slots) + slots) % slots] = denominator;
                 }
             }
+            plan->masks[ct][ct][0][fy][fx] = he_.encodeVectorPacked(mask);
+            plan->tap_used[ct][ct][0][fy][fx] = true;
+        }
+    });
 
-            // Multiply by denominator (scaling)
-            // No need for critical section as each thread processes its own sum_ct
-            seal::Plaintext local_denominator = denominator; // Thread-local copy
-            he.evaluator_->mod_switch_to_inplace(local_denominator, sum_ct.parms_id());
-            local_denominator.scale() = sum_ct.scale();
-            he.evaluator_->multiply_plain_inplace(sum_ct, local_denominator);
-            he.evaluator_->rescale_to_next_inplace(sum_ct);
-
-            // Store result - no synchronization needed as each thread writes to different locations
-            result[y][x] = sum_ct;
+    // Publish with a compare-and-swap, never under a lock: the build waits on parallel_for, whose
+    // waiting thread may run another packed pass of this layer. A pass that lost the race to a plan
+    // for the same layout drops its own copy.
+    std::shared_ptr<const PackedPlan> built = plan;
+    while (!std::atomic_compare_exchange_weak(&packed_plan_, &current, built)) {
+        if (current && current->layout == layout) {
+            return current;
         }
     }
+    return built;
+}
+
+// Forward pass on slot-packed input
+PackedTensor AvgPoolLayer::operator()(const PackedTensor &input) const
+{
+    std::shared_ptr<const PackedPlan> plan = packed_plan(input.layout);
+
+    PackedTensor result;
+    result.layout = output_layout(input.layout);
+    result.data = CipherTensor({ input.n_images(), result.layout.n_ciphertexts() });
+
+    for (size_t img = 0; img < input.n_images(); img++) {
+        CipherTensor image_out = result.data.slice(img);
+        convolute2d_packed(
+            input.data.slice(img), plan->masks, plan->tap_used, input.layout, padding_, he_, image_out);
 
+        // One rescale per output ciphertext, after all taps are summed
+        TaskScheduler::instance().parallel_for(image_out.size(), [&](size_t ct) {
+            he_.evaluator().rescale_to_next_inplace(image_out[ct], he_.pool());
+        });
+    }
     return result;
-}
\ No newline at end of file
+}
+
+// Avg Pooling Function for a 2D Image
+void AvgPoolLayer::avg(
+    const CKKSPyfhel &he,
+    const CipherTensor &image,
+    std::pair<int, int> kernel_size,
+    std::pair<int, int> stride,
+    std::pair<int, int> padding,
+    const ScalarConstant &denominator,
+    CipherTensor &output) const
+{
+    // The caller sized output (and checked padding < kernel, so no window is empty)
+    int y_o = output.dim(0);
+    int x_o = output.dim(1);
+
+    // One task per output pixel
+    TaskScheduler::instance().parallel_for(y_o, x_o, [&](int y, int x) {
+        // Store result - no synchronization needed as each task writes to a different location
+        output(y, x) = avg_window(he, image, kernel_size, stride, padding, denominator, y, x);
+    });
+}
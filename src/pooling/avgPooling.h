@@ -2,30 +2,90 @@
 #define AVGPOOLING_H
 
 #include "he/he.h"  // CKKS encryption header
+#include "layer/layer.h"
+#include "runtime/constantBank.h"
 #include <vector>
+#include <memory>
 #include <seal/seal.h>
 
-class AvgPoolLayer {
+// Forward passes are const and reentrant: one layer serves concurrent requests
+class AvgPoolLayer : public RowLayer {
 public:
-    CKKSPyfhel &he_;
+    const CKKSPyfhel &he_;
     std::pair<int, int> kernel_size_;
     std::pair<int, int> stride_;
     std::pair<int, int> padding_;
 
     // Constructor
-    AvgPoolLayer(CKKSPyfhel &he, std::pair<int, int> kernel_size, std::pair<int, int> stride, std::pair<int, int> padding);
+    AvgPoolLayer(const CKKSPyfhel &he, std::pair<int, int> kernel_size, std::pair<int, int> stride, std::pair<int, int> padding);
 
-    // Forward pass
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> operator()(
-        const std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &input);
+    // Forward pass: [n_images, channels, height, width] -> [n_images, channels, out_height, out_width]
+    CipherTensor operator()(const CipherTensor &input) const;
+
+    // Same pass, consuming the input: input rows are released once no remaining output row
+    // reads them (an input shared with other tensors is left untouched)
+    CipherTensor operator()(CipherTensor &&input) const override;
+
+    // Layer interface: pool input into output, preallocated with infer_shape
+    void forward(const CipherTensor &input, CipherTensor &output) const override;
+
+    // Forward pass on slot-packed input: the window sum is done with rotations, and the
+    // output stays in place with widened strides (channels may be multiplexed)
+    PackedTensor operator()(const PackedTensor &input) const;
+
+    // Levels (rescales) one forward pass consumes: the 1/(k*k) scaling
+    size_t depth() const override { return 1; }
+
+    // Encode the 1/(k*k) factor at this input level (see Layer::prepare)
+    void prepare(const seal::parms_id_type &parms_id, double scale) const override;
+
+    // Rotation steps used by the packed forward pass (for CKKSPyfhel::generate_rotation_keys)
+    std::vector<int> rotation_steps(const PackedLayout &layout) const;
+
+    // Layout of the packed output for a given input layout
+    PackedLayout output_layout(const PackedLayout &layout) const;
+
+    // Row interface for the dataflow pipeline (Sequential::setPipelined): output shape of one
+    // image [channels, height, width], input rows [first, last) read by an output row, and
+    // the computation of one output row (all channels)
+    std::vector<size_t> output_shape(const std::vector<size_t> &input_shape) const override;
+    std::pair<size_t, size_t> input_rows(size_t out_row, size_t in_height) const override;
+    void forward_row(const CipherTensor &image, CipherTensor &output, size_t out_row) const override;
     
 private:
-    // Perform average pooling on a 2D encrypted image
-    std::vector<std::vector<seal::Ciphertext>> avg(
-        CKKSPyfhel &he, 
-        const std::vector<std::vector<seal::Ciphertext>> &image, 
+    // Masked 1/(k*k) plaintexts for the packed pass on one input layout, in the filter-bank shape
+    // of convolute2d_packed: [n_cts][n_cts][1][kernel_height][kernel_width], only ciphertext
+    // ct -> ct is populated. Read-only once built.
+    struct PackedPlan {
+        PackedLayout layout;
+        std::vector<std::vector<std::vector<std::vector<std::vector<seal::Plaintext>>>>> masks;
+        std::vector<std::vector<std::vector<std::vector<std::vector<char>>>>> tap_used;
+    };
+
+    // Plan of the most recent packed layout, swapped (never modified) when the layout changes.
+    // Accessed with std::atomic_load/CAS only.
+    mutable std::shared_ptr<const PackedPlan> packed_plan_;
+
+    // Plan for an input layout, built on first use
+    std::shared_ptr<const PackedPlan> packed_plan(const PackedLayout &layout) const;
+
+    // 1/(k*k) at each input level (encoding scale), shared read-only by all threads
+    ConstantBank<ScalarConstant> denominator_bank_;
+
+    // Division factor for inputs at parms_id. Padded zeros still count towards the window size,
+    // as in PyTorch's default count_include_pad=True.
+    const ScalarConstant &denominator_at(const seal::parms_id_type &parms_id) const;
+
+    // Perform average pooling on a 2D encrypted image [height, width] into the view output
+    // [out_height, out_width] (padding is virtual: out-of-bounds pixels are skipped)
+    void avg(
+        const CKKSPyfhel &he, 
+        const CipherTensor &image, 
         std::pair<int, int> kernel_size, 
-        std::pair<int, int> stride);
+        std::pair<int, int> stride,
+        std::pair<int, int> padding,
+        const ScalarConstant &denominator,
+        CipherTensor &output) const;
 };
 
 #endif // AVGPOOLING_H
@@ -0,0 +1,77 @@
+#ifndef CONSTANT_BANK_H
+#define CONSTANT_BANK_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <seal/seal.h>
+
+/**
+ * Read-only cache of a layer's encoded constants (bias, pooling factor, packed bias), one entry per
+ * (level, scale) at which the layer consumes them.
+ * - Entries are built once, by prepare() when the level schedule is known or on first use, and
+ *   never modified or removed afterwards: references stay valid for the bank's lifetime.
+ * - Lookups walk an append-only list without taking a lock, so every thread of a forward pass
+ *   reads the same encodings with no copies, mod switches or contention. Only building an
+ *   entry locks. A layer meets one or two (level, scale) pairs, so the list stays short.
+ */
+template <typename Entry>
+class ConstantBank {
+public:
+    ConstantBank() = default;
+    ~ConstantBank()
+    {
+        const Node *node = head_.load(std::memory_order_relaxed);
+        while (node) {
+            const Node *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    ConstantBank(const ConstantBank &) = delete;
+    ConstantBank &operator=(const ConstantBank &) = delete;
+
+    /**
+     * @brief Entry for (parms_id, scale), built with make() (returning an Entry) if missing.
+     */
+    template <typename Make>
+    const Entry &get(const seal::parms_id_type &parms_id, double scale, Make &&make) const
+    {
+        if (const Entry *entry = find(parms_id, scale)) {
+            return *entry;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (const Entry *entry = find(parms_id, scale)) {
+            return *entry;  // Built by another thread meanwhile
+        }
+        Node *node = new Node{ parms_id, scale, make(), head_.load(std::memory_order_relaxed) };
+        head_.store(node, std::memory_order_release);
+        return node->entry;
+    }
+
+    // Entry for (parms_id, scale) if built, else nullptr
+    const Entry *find(const seal::parms_id_type &parms_id, double scale) const
+    {
+        for (const Node *node = head_.load(std::memory_order_acquire); node; node = node->next) {
+            if (node->parms_id == parms_id && node->scale == scale) {
+                return &node->entry;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    struct Node {
+        seal::parms_id_type parms_id;
+        double scale;
+        Entry entry;
+        const Node *next;
+    };
+
+    mutable std::mutex mutex_;
+    mutable std::atomic<const Node *> head_{ nullptr };
+};
+
+#endif // CONSTANT_BANK_H
@@ -0,0 +1,46 @@
+#include "graphExecutor.h"
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+GraphExecutor::GraphExecutor(const CKKSPyfhel &he, std::vector<std::shared_ptr<const Layer>> layers,
+                             std::vector<std::size_t> input_shape)
+    : he_(he), layers_(std::move(layers))
+{
+    if (layers_.empty()) {
+        throw std::runtime_error("GraphExecutor: no layers.");
+    }
+
+    shapes_.push_back(std::move(input_shape));
+    outputs_.resize(layers_.size());
+    for (std::size_t i = 0; i < layers_.size(); i++) {
+        try {
+            shapes_.push_back(layers_[i]->infer_shape(shapes_.back()));
+        } catch (const std::exception &e) {
+            throw std::runtime_error("GraphExecutor: layer " + std::to_string(i) + " rejects its input: " + e.what());
+        }
+        if (!layers_[i]->aliases_input()) {
+            outputs_[i] = CipherTensor(shapes_.back());
+        }
+        depth_ += layers_[i]->depth();
+    }
+}
+
+const CipherTensor &GraphExecutor::run(const CipherTensor &input)
+{
+    if (input.shape() != shapes_.front()) {
+        throw std::runtime_error("GraphExecutor: input does not match the compiled input shape.");
+    }
+    for (const auto &ct : input) {
+        if (he_.depth_left(ct) < depth_) {
+            throw std::runtime_error("GraphExecutor: input has fewer levels left than the layers consume.");
+        }
+    }
+
+    const CipherTensor *x = &input;
+    for (std::size_t i = 0; i < layers_.size(); i++) {
+        layers_[i]->forward(*x, outputs_[i]);
+        x = &outputs_[i];
+    }
+    return outputs_.back();
+}
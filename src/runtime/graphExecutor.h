@@ -0,0 +1,55 @@
+#ifndef GRAPH_EXECUTOR_H
+#define GRAPH_EXECUTOR_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "he/he.h"
+#include "layer/layer.h"
+
+/**
+ * Static execution plan of a layer chain for one input shape.
+ * - The constructor infers every output shape (an invalid chain throws before any ciphertext is
+ *   touched) and allocates every output tensor once; layers that alias their input get a view
+ *   at run time instead.
+ * - run() calls forward() of each layer into its preallocated output: no tensor allocations or
+ *   per-type dispatch per call, and the ciphertext buffers of one call are reused by the next.
+ * - The layers are shared and stay reentrant, but the outputs belong to the executor: use one
+ *   executor per concurrent request (e.g. per worker thread).
+ */
+class GraphExecutor {
+public:
+    /**
+     * @param he          Context the inputs are encrypted under (level checks)
+     * @param layers      Layers in execution order (at least one)
+     * @param input_shape Shape of the inputs, batch axis included
+     */
+    GraphExecutor(const CKKSPyfhel &he, std::vector<std::shared_ptr<const Layer>> layers,
+                  std::vector<std::size_t> input_shape);
+
+    // Run the chain on input (of input_shape(), with at least depth() levels left). The result
+    // is the last output, valid until the next run()
+    const CipherTensor &run(const CipherTensor &input);
+
+    std::size_t size() const { return layers_.size(); }
+
+    // Levels the whole chain consumes
+    std::size_t depth() const { return depth_; }
+
+    const std::vector<std::size_t> &input_shape() const { return shapes_.front(); }
+
+    // Output shape of layer i
+    const std::vector<std::size_t> &shape(std::size_t i) const { return shapes_.at(i + 1); }
+
+    // Output of layer i in the last run() (e.g. the feature map of a Conv2d)
+    const CipherTensor &output(std::size_t i) const { return outputs_.at(i); }
+
+private:
+    const CKKSPyfhel &he_;
+    std::vector<std::shared_ptr<const Layer>> layers_;
+    std::vector<std::vector<std::size_t>> shapes_;  // Input shape, then the output shape of each layer
+    std::vector<CipherTensor> outputs_;
+    std::size_t depth_ = 0;
+};
+
+#endif // GRAPH_EXECUTOR_H
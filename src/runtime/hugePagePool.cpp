@@ -0,0 +1,85 @@
+#include "hugePagePool.h"
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+seal::MemoryPoolHandle HugePageMemoryPool::New()
+{
+    return seal::MemoryPoolHandle(std::make_shared<HugePageMemoryPool>());
+}
+
+seal::util::Pointer<seal::seal_byte> HugePageMemoryPool::get_for_byte_count(std::size_t byte_count)
+{
+    seal::util::Pointer<seal::seal_byte> buffer = seal::util::MemoryPoolMT::get_for_byte_count(byte_count);
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    bytes_served_.fetch_add(byte_count, std::memory_order_relaxed);
+
+    if (byte_count < min_advise_bytes) {
+        return buffer;
+    }
+
+    // Only the huge pages fully inside the buffer can be remapped
+    std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(buffer.get());
+    std::uintptr_t end = begin + byte_count;
+    std::uintptr_t huge_begin = (begin + huge_page_bytes - 1) & ~(huge_page_bytes - 1);
+    std::uintptr_t huge_end = end & ~(huge_page_bytes - 1);
+    if (huge_end <= huge_begin) {
+        return buffer;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!advised_.insert(buffer.get()).second) {
+            return buffer; // Recycled buffer, advised when it was first handed out
+        }
+        bytes_huge_eligible_ += huge_end - huge_begin;
+    }
+#ifdef __linux__
+    // Advice only: if transparent huge pages are off the buffer simply stays on 4 KB pages
+    madvise(reinterpret_cast<void *>(huge_begin), huge_end - huge_begin, MADV_HUGEPAGE);
+#endif
+    return buffer;
+}
+
+HugePageStats HugePageMemoryPool::stats() const
+{
+    HugePageStats stats;
+    stats.allocations = allocations_.load(std::memory_order_relaxed);
+    stats.bytes_served = bytes_served_.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.buffers_advised = advised_.size();
+        stats.bytes_huge_eligible = bytes_huge_eligible_;
+    }
+
+    // The kernel only reports huge page residency per process: AnonHugePages, in kB
+    std::ifstream rollup("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(rollup, line)) {
+        if (line.compare(0, 14, "AnonHugePages:") == 0) {
+            std::istringstream fields(line.substr(14));
+            std::size_t kb = 0;
+            fields >> kb;
+            stats.process_huge_bytes = kb * 1024;
+            break;
+        }
+    }
+    return stats;
+}
+
+bool HugePageMemoryPool::available()
+{
+    // e.g. "always [madvise] never": the bracketed mode is the active one
+    std::ifstream mode("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string line;
+    if (!std::getline(mode, line)) {
+        return false;
+    }
+    return line.find("[never]") == std::string::npos;
+}
@@ -0,0 +1,60 @@
+#ifndef HUGE_PAGE_POOL_H
+#define HUGE_PAGE_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <unordered_set>
+#include <seal/seal.h>
+
+/**
+ * Counters of a HugePageMemoryPool.
+ */
+struct HugePageStats {
+    std::size_t allocations = 0;          // Buffers handed out (new or recycled)
+    std::size_t bytes_served = 0;         // Bytes handed out over all allocations
+    std::size_t buffers_advised = 0;      // Distinct buffers marked MADV_HUGEPAGE
+    std::size_t bytes_huge_eligible = 0;  // Bytes of those buffers in whole, aligned huge pages
+    std::size_t process_huge_bytes = 0;   // Anonymous memory of the process actually backed by huge pages
+};
+
+/**
+ * SEAL memory pool whose large buffers are backed by transparent huge pages (Linux).
+ * - Recycles buffers like SEAL's thread-safe pool (it is one); every buffer of at least
+ *   min_advise_bytes is additionally madvise(MADV_HUGEPAGE)d the first time it is handed out, so
+ *   the kernel maps its aligned 2 MB extents with huge pages and RNS-strided walks over ciphertexts
+ *   and keys stop missing the TLB.
+ * - Needs transparent huge pages in "madvise" or "always" mode; elsewhere it is a plain SEAL pool.
+ * - Use through MemoryPoolHandle (see HugePageMemoryPool::New), e.g. CKKSPyfhel(..., huge_pages = true).
+ */
+class HugePageMemoryPool : public seal::util::MemoryPoolMT {
+public:
+    // Buffers below this size cannot contain an aligned huge page and are not advised
+    static constexpr std::size_t huge_page_bytes = std::size_t{ 1 } << 21;
+    static constexpr std::size_t min_advise_bytes = huge_page_bytes;
+
+    HugePageMemoryPool() = default;
+    ~HugePageMemoryPool() noexcept override = default;
+
+    // New pool wrapped in a handle, ready for SEAL objects and evaluator calls
+    static seal::MemoryPoolHandle New();
+
+    seal::util::Pointer<seal::seal_byte> get_for_byte_count(std::size_t byte_count) override;
+
+    // Snapshot of the counters (process_huge_bytes is read from /proc/self/smaps_rollup)
+    HugePageStats stats() const;
+
+    // True if the kernel honours MADV_HUGEPAGE (transparent huge pages not "never")
+    static bool available();
+
+private:
+    std::atomic<std::size_t> allocations_{ 0 };
+    std::atomic<std::size_t> bytes_served_{ 0 };
+
+    // Large buffers already advised (recycled buffers keep their advice); guarded by mutex_
+    mutable std::mutex mutex_;
+    std::unordered_set<const void *> advised_;
+    std::size_t bytes_huge_eligible_ = 0;
+};
+
+#endif // HUGE_PAGE_POOL_H
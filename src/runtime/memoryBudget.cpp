@@ -0,0 +1,196 @@
+#include "memoryBudget.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include "runtime/taskScheduler.h"
+
+MemoryBudget::MemoryBudget(const CKKSPyfhel &he, std::size_t budget_bytes, const std::string &spill_dir)
+    : he_(he), budget_bytes_(budget_bytes), file_(spill_dir) {}
+
+std::vector<std::pair<seal::Ciphertext *, std::size_t>> MemoryBudget::image_blocks(CipherTensor &tensor, std::size_t img)
+{
+    if (tensor.ndim() == 0 || img >= tensor.dim(0)) {
+        throw std::out_of_range("MemoryBudget: image index out of range.");
+    }
+    std::size_t per_image = tensor.size() / tensor.dim(0);
+    if (tensor.strides()[0] != per_image) {
+        throw std::runtime_error("MemoryBudget: tensors must be contiguous.");
+    }
+
+    seal::Ciphertext *base = tensor.begin() + img * per_image;
+    std::vector<std::pair<seal::Ciphertext *, std::size_t>> blocks;
+    if (tensor.ndim() == 4) {
+        std::size_t plane = tensor.dim(2) * tensor.dim(3);
+        for (std::size_t c = 0; c < tensor.dim(1); c++) {
+            blocks.emplace_back(base + c * plane, plane);
+        }
+    } else {
+        blocks.emplace_back(base, per_image);
+    }
+    return blocks;
+}
+
+std::map<const seal::Ciphertext *, MemoryBudget::Block>::iterator MemoryBudget::first_block(const seal::Ciphertext *begin)
+{
+    auto it = blocks_.upper_bound(begin);
+    if (it != blocks_.begin() && std::prev(it)->second.first + std::prev(it)->second.count > begin) {
+        --it;
+    }
+    return it;
+}
+
+void MemoryBudget::track(CipherTensor &tensor)
+{
+    for (std::size_t img = 0; img < tensor.dim(0); img++) {
+        std::vector<std::pair<seal::Ciphertext *, std::size_t>> ranges = image_blocks(tensor, img);
+
+        // Another view of the store (e.g. a flattened one) may have partitioned this image already:
+        // its blocks cover the same ciphertexts, so they are shared instead of overlapped
+        auto covering = first_block(ranges.front().first);
+        seal::Ciphertext *image_end = ranges.back().first + ranges.back().second;
+        if (covering != blocks_.end() && covering->first < image_end) {
+            for (; covering != blocks_.end() && covering->first < image_end; ++covering) {
+                covering->second.tracked++;
+            }
+            continue;
+        }
+
+        for (const auto &range : ranges) {
+            Block &block = blocks_[range.first];
+            block.first = range.first;
+            block.count = range.second;
+            block.tracked = 1;
+            block.last_use = ++clock_;
+        }
+    }
+}
+
+void MemoryBudget::untrack(CipherTensor &tensor)
+{
+    for (std::size_t img = 0; img < tensor.dim(0); img++) {
+        std::vector<std::pair<seal::Ciphertext *, std::size_t>> ranges = image_blocks(tensor, img);
+        seal::Ciphertext *image_begin = ranges.front().first;
+        seal::Ciphertext *image_end = ranges.back().first + ranges.back().second;
+
+        auto it = first_block(image_begin);
+        while (it != blocks_.end() && it->first < image_end) {
+            Block &block = it->second;
+            if (--block.tracked > 0) {
+                ++it;
+                continue;
+            }
+            for (const auto &extent : block.extents) {
+                file_.free(extent);
+            }
+            it = blocks_.erase(it);
+        }
+    }
+}
+
+void MemoryBudget::use(CipherTensor &tensor, std::size_t img)
+{
+    std::vector<std::pair<seal::Ciphertext *, std::size_t>> ranges = image_blocks(tensor, img);
+    seal::Ciphertext *image_begin = ranges.front().first;
+    seal::Ciphertext *image_end = ranges.back().first + ranges.back().second;
+
+    auto it = first_block(image_begin);
+    for (; it != blocks_.end() && it->first < image_end; ++it) {
+        if (it->second.spilled) {
+            page_in(it->second);
+        }
+        it->second.last_use = ++clock_;
+    }
+}
+
+void MemoryBudget::use_all(CipherTensor &tensor)
+{
+    for (std::size_t img = 0; img < tensor.dim(0); img++) {
+        use(tensor, img);
+    }
+}
+
+void MemoryBudget::enforce()
+{
+    std::size_t resident = resident_bytes();
+    if (resident <= budget_bytes_) {
+        return;
+    }
+
+    std::vector<Block *> candidates;
+    for (auto &entry : blocks_) {
+        if (!entry.second.spilled) {
+            candidates.push_back(&entry.second);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Block *a, const Block *b) { return a->last_use < b->last_use; });
+
+    for (Block *block : candidates) {
+        if (resident <= budget_bytes_) {
+            break;
+        }
+        std::size_t bytes = block_bytes(*block);
+        if (bytes == 0) {
+            continue; // Consumed or not produced yet: nothing to spill
+        }
+        spill(*block);
+        resident -= bytes;
+    }
+}
+
+std::size_t MemoryBudget::resident_bytes() const
+{
+    std::size_t bytes = 0;
+    for (const auto &entry : blocks_) {
+        if (!entry.second.spilled) {
+            bytes += block_bytes(entry.second);
+        }
+    }
+    return bytes;
+}
+
+std::size_t MemoryBudget::block_bytes(const Block &block)
+{
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < block.count; i++) {
+        const seal::Ciphertext &ct = block.first[i];
+        bytes += ct.size() * ct.poly_modulus_degree() * ct.coeff_modulus_size() * sizeof(std::uint64_t);
+    }
+    return bytes;
+}
+
+void MemoryBudget::spill(Block &block)
+{
+    // Extents are carved first: allocate() may remap the file under the writers
+    block.extents.assign(block.count, SpillFile::Extent{});
+    for (std::size_t i = 0; i < block.count; i++) {
+        if (block.first[i].size() > 0) {
+            block.extents[i] = file_.allocate(block.first[i].save_size(seal::compr_mode_type::none));
+        }
+    }
+
+    TaskScheduler::instance().parallel_for(block.count, [&](std::size_t i) {
+        const SpillFile::Extent &extent = block.extents[i];
+        if (extent.size == 0) return;
+        block.first[i].save(file_.data(extent), extent.size, seal::compr_mode_type::none);
+        block.first[i].release();
+    });
+    block.spilled = true;
+    spills_++;
+}
+
+void MemoryBudget::page_in(Block &block)
+{
+    TaskScheduler::instance().parallel_for(block.count, [&](std::size_t i) {
+        const SpillFile::Extent &extent = block.extents[i];
+        if (extent.size == 0) return;
+        block.first[i].load(he_.context(), file_.data(extent), extent.size);
+    });
+
+    for (const auto &extent : block.extents) {
+        file_.free(extent);
+    }
+    block.extents.clear();
+    block.spilled = false;
+    page_ins_++;
+}
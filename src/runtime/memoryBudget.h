@@ -0,0 +1,80 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "runtime/spillFile.h"
+
+/**
+ * Caps the resident ciphertext bytes of a set of tensors by spilling cold blocks to a SpillFile.
+ * - A block is one (image, channel) plane of a 4D tensor, or one image of any other tensor.
+ * - Spilled ciphertexts are saved in SEAL's binary format (uncompressed) and released; use()
+ *   loads them back. enforce() spills least recently used blocks until the budget holds.
+ * - Tensors are tracked by address: they must be contiguous and stay alive (and keep their store)
+ *   while tracked. Tracking is counted, so two views of one store can be tracked and untracked
+ *   independently. Not thread-safe: one budget per forward pass.
+ */
+class MemoryBudget {
+public:
+    /**
+     * @param he           Context the spilled ciphertexts are loaded back into
+     * @param budget_bytes Resident bytes allowed for the tracked tensors
+     * @param spill_dir    Directory of the (unlinked) spill file
+     */
+    MemoryBudget(const CKKSPyfhel &he, std::size_t budget_bytes, const std::string &spill_dir);
+
+    // Start tracking every block of tensor (no-op for blocks tracked already, besides the count)
+    void track(CipherTensor &tensor);
+
+    // Stop tracking tensor. Blocks no longer tracked by anyone are forgotten; if spilled, their
+    // data is dropped, so use_all() first when the tensor lives on
+    void untrack(CipherTensor &tensor);
+
+    // Page in the blocks of image img (first axis) of a tracked tensor and mark them recently used
+    void use(CipherTensor &tensor, std::size_t img);
+
+    // Page in every block of a tracked tensor
+    void use_all(CipherTensor &tensor);
+
+    // Spill least recently used blocks until the resident bytes fit in the budget
+    void enforce();
+
+    std::size_t resident_bytes() const;
+    std::size_t spilled_bytes() const { return file_.used(); }
+    std::size_t spills() const { return spills_; }
+    std::size_t page_ins() const { return page_ins_; }
+
+private:
+    struct Block {
+        seal::Ciphertext *first = nullptr;
+        std::size_t count = 0;
+        std::size_t tracked = 0;          // Number of track() calls not yet untracked
+        std::uint64_t last_use = 0;
+        bool spilled = false;
+        std::vector<SpillFile::Extent> extents;  // One per ciphertext while spilled
+    };
+
+    const CKKSPyfhel &he_;
+    std::size_t budget_bytes_;
+    SpillFile file_;
+    std::map<const seal::Ciphertext *, Block> blocks_;  // Keyed by the block's first ciphertext
+    std::uint64_t clock_ = 0;
+    std::size_t spills_ = 0;
+    std::size_t page_ins_ = 0;
+
+    // (first ciphertext, count) of each block of image img
+    static std::vector<std::pair<seal::Ciphertext *, std::size_t>> image_blocks(CipherTensor &tensor, std::size_t img);
+
+    // First block that contains begin or starts after it
+    std::map<const seal::Ciphertext *, Block>::iterator first_block(const seal::Ciphertext *begin);
+
+    static std::size_t block_bytes(const Block &block);
+    void spill(Block &block);
+    void page_in(Block &block);
+};
+
+#endif // MEMORY_BUDGET_H
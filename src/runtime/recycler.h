@@ -0,0 +1,61 @@
+#ifndef RECYCLER_H
+#define RECYCLER_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * Lease of a scratch object from the calling thread's free list, returned on destruction.
+ * - Objects keep their capacity between leases, so a loop body that leases its temporaries
+ *   allocates on the first iterations only. The layers lease their per-pixel pointer lists
+ *   (std::vector<const seal::Ciphertext *> and the like); ciphertext temporaries come from
+ *   CKKSPyfhel::pool(), whose per-thread SEAL pool already recycles their buffers.
+ * - Leases nest: a task that runs inside another task's lease gets a different object.
+ * - The object is handed out as it was left; clear() it before use.
+ */
+template <typename T>
+class Recycled {
+public:
+    // Constructor arguments are only used when the free list is empty and a new object is made
+    template <typename... Args>
+    explicit Recycled(Args &&...args)
+    {
+        auto &list = free_list();
+        if (list.empty()) {
+            item_ = std::make_unique<T>(std::forward<Args>(args)...);
+        } else {
+            item_ = std::move(list.back());
+            list.pop_back();
+        }
+    }
+
+    ~Recycled()
+    {
+        auto &list = free_list();
+        if (list.size() < max_free) {
+            list.push_back(std::move(item_));
+        }
+    }
+
+    Recycled(const Recycled &) = delete;
+    Recycled &operator=(const Recycled &) = delete;
+
+    T &operator*() { return *item_; }
+    T *operator->() { return item_.get(); }
+
+private:
+    // Bounds the memory a thread keeps parked in one free list
+    static constexpr std::size_t max_free = 64;
+
+    std::unique_ptr<T> item_;
+
+    static std::vector<std::unique_ptr<T>> &free_list()
+    {
+        thread_local std::vector<std::unique_ptr<T>> list;
+        return list;
+    }
+};
+
+#endif // RECYCLER_H
@@ -0,0 +1,160 @@
+#include "rowPipeline.h"
+#include "taskScheduler.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Progress of one image through the stages, guarded by its mutex
+struct ImageProgress {
+    std::mutex mutex;
+    std::vector<std::vector<char>> done;  // [stage][out_row]
+    std::vector<std::size_t> done_prefix; // [stage] output rows [0, prefix) are all complete
+    std::vector<std::size_t> next_row;    // [stage] next output row to spawn
+    std::vector<std::size_t> released;    // [stage] input rows [0, released) have been freed
+};
+
+class RowPipelineRun {
+public:
+    RowPipelineRun(const std::vector<RowStage> &stages, CipherTensor input, bool release_input)
+        : stages_(stages), group_(TaskScheduler::instance()), release_input_(release_input)
+    {
+        if (stages_.empty()) {
+            throw std::runtime_error("Row pipeline: no stages.");
+        }
+        if (input.ndim() != 4) {
+            throw std::runtime_error("Row pipeline expects a 4D input [n_images, channels, height, width].");
+        }
+        n_images_ = input.dim(0);
+        heights_.push_back(input.dim(2));
+        std::vector<std::size_t> shape(input.shape().begin() + 1, input.shape().end());
+        tensors_.push_back(std::move(input));
+
+        // Shapes are planned (and validated by each layer) before any task runs
+        for (const auto &stage : stages_) {
+            shape = stage.output_shape(shape);
+            if (shape.size() != 3) {
+                throw std::runtime_error("Row pipeline: stages must produce [channels, height, width].");
+            }
+            tensors_.emplace_back(std::vector<std::size_t>{ n_images_, shape[0], shape[1], shape[2] });
+            heights_.push_back(shape[1]);
+        }
+
+        for (std::size_t img = 0; img < n_images_; img++) {
+            auto progress = std::make_unique<ImageProgress>();
+            for (std::size_t s = 0; s < stages_.size(); s++) {
+                progress->done.emplace_back(heights_[s + 1], 0);
+            }
+            progress->done_prefix.assign(stages_.size(), 0);
+            progress->next_row.assign(stages_.size(), 0);
+            progress->released.assign(stages_.size(), 0);
+            progress_.push_back(std::move(progress));
+        }
+    }
+
+    std::vector<CipherTensor> run()
+    {
+        // The whole input is ready: seed the first stage of every image. Later images are seeded
+        // first so that image 0 ends up on top of the deques.
+        for (std::size_t img = n_images_; img-- > 0;) {
+            spawn_ready(img, 0);
+        }
+        group_.wait();
+        return std::vector<CipherTensor>(tensors_.begin() + 1, tensors_.end());
+    }
+
+private:
+    const std::vector<RowStage> &stages_;
+    TaskGroup group_;
+    bool release_input_;                  // The pipeline owns its input and frees consumed rows
+    std::size_t n_images_ = 0;
+    std::vector<CipherTensor> tensors_;   // [0] input, [s + 1] output of stage s
+    std::vector<std::size_t> heights_;    // Row count of each tensor
+    std::vector<std::unique_ptr<ImageProgress>> progress_;
+
+    // Spawn every row of stage s whose receptive field is complete
+    void spawn_ready(std::size_t img, std::size_t s)
+    {
+        std::vector<std::size_t> rows;
+        {
+            ImageProgress &p = *progress_[img];
+            std::lock_guard<std::mutex> lock(p.mutex);
+            std::size_t ready = (s == 0) ? heights_[0] : p.done_prefix[s - 1];
+            while (p.next_row[s] < heights_[s + 1] &&
+                   stages_[s].input_rows(p.next_row[s], heights_[s]).second <= ready) {
+                rows.push_back(p.next_row[s]++);
+            }
+        }
+
+        // Spawned in reverse: the owner pops its newest task first, so the topmost row runs first
+        // and thieves take the rows furthest from the pipeline front
+        for (auto row = rows.rbegin(); row != rows.rend(); ++row) {
+            std::size_t r = *row;
+            group_.spawn([this, img, s, r] { run_row(img, s, r); });
+        }
+    }
+
+    void run_row(std::size_t img, std::size_t s, std::size_t row)
+    {
+        CipherTensor input = tensors_[s].slice(img);
+        CipherTensor output = tensors_[s + 1].slice(img);
+        stages_[s].forward_row(input, output, row);
+        if (stages_[s].finish) {
+            for (std::size_t c = 0; c < output.dim(0); c++) {
+                for (std::size_t x = 0; x < output.dim(2); x++) {
+                    stages_[s].finish(output(c, row, x));
+                }
+            }
+        }
+
+        // Input rows above the receptive field of the first unfinished row are no longer read.
+        // Kept outputs are returned, and the pipeline input is freed only when it was handed over.
+        std::size_t release_from = 0, release_to = 0;
+        {
+            ImageProgress &p = *progress_[img];
+            std::lock_guard<std::mutex> lock(p.mutex);
+            p.done[s][row] = 1;
+            while (p.done_prefix[s] < heights_[s + 1] && p.done[s][p.done_prefix[s]]) {
+                p.done_prefix[s]++;
+            }
+            if (s == 0 ? release_input_ : !stages_[s - 1].keep_output) {
+                std::size_t needed = (p.done_prefix[s] < heights_[s + 1])
+                    ? stages_[s].input_rows(p.done_prefix[s], heights_[s]).first
+                    : heights_[s];
+                release_from = p.released[s];
+                release_to = std::max(needed, release_from);
+                p.released[s] = release_to;
+            }
+        }
+        for (std::size_t r = release_from; r < release_to; r++) {
+            for (std::size_t c = 0; c < input.dim(0); c++) {
+                for (std::size_t x = 0; x < input.dim(2); x++) {
+                    input(c, r, x).release();
+                }
+            }
+        }
+
+        if (s + 1 < stages_.size()) {
+            spawn_ready(img, s + 1);
+        }
+    }
+};
+
+} // namespace
+
+std::vector<CipherTensor> run_row_pipeline(const std::vector<RowStage> &stages, const CipherTensor &input)
+{
+    RowPipelineRun pipeline(stages, input, false);
+    return pipeline.run();
+}
+
+std::vector<CipherTensor> run_row_pipeline(const std::vector<RowStage> &stages, CipherTensor &&input)
+{
+    // Decided before the pipeline takes its own views of the input
+    bool owned = !input.is_shared();
+    RowPipelineRun pipeline(stages, std::move(input), owned);
+    return pipeline.run();
+}
@@ -0,0 +1,70 @@
+#ifndef ROW_PIPELINE_H
+#define ROW_PIPELINE_H
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "tensor/cipherTensor.h"
+
+/**
+ * One layer of a row pipeline, seen one output row at a time.
+ * Shapes are per image: [channels, height, width].
+ */
+struct RowStage {
+    // Output shape for a given input shape (throws if the layer does not accept it)
+    std::function<std::vector<std::size_t>(const std::vector<std::size_t> &input_shape)> output_shape;
+
+    // Input rows [first, last) read by output row out_row; first must not decrease with out_row
+    std::function<std::pair<std::size_t, std::size_t>(std::size_t out_row, std::size_t in_height)> input_rows;
+
+    // Compute output row out_row of one image: image [C, H, W] -> output [C', H', W']
+    std::function<void(const CipherTensor &image, CipherTensor &output, std::size_t out_row)> forward_row;
+
+    // Keep every row of this stage's output; otherwise rows are released once the next stage has read them
+    bool keep_output = false;
+
+    // Applied to every ciphertext of an output row as soon as the row is computed (optional),
+    // e.g. to drop the levels later stages do not need
+    std::function<void(seal::Ciphertext &ct)> finish;
+};
+
+/**
+ * @brief Row stage of a layer with the row interface (output_shape, input_rows, forward_row).
+ * @param layer Pointer or shared_ptr to the layer, copied into the stage (a raw pointer must outlive it)
+ */
+template <typename LayerPtr>
+RowStage make_row_stage(LayerPtr layer)
+{
+    RowStage stage;
+    stage.output_shape = [layer](const std::vector<std::size_t> &shape) { return layer->output_shape(shape); };
+    stage.input_rows = [layer](std::size_t out_row, std::size_t in_height) { return layer->input_rows(out_row, in_height); };
+    stage.forward_row = [layer](const CipherTensor &image, CipherTensor &output, std::size_t out_row) {
+        layer->forward_row(image, output, out_row);
+    };
+    return stage;
+}
+
+/**
+ * @brief Run consecutive layers as a dataflow pipeline on the TaskScheduler.
+ *
+ * Each output row of each stage (per image) is a task, spawned as soon as the input rows of its
+ * receptive field are complete, so a downstream layer starts on the first rows while the upstream
+ * layer is still producing the rest. Rows of intermediate outputs are released as soon as no
+ * remaining downstream row reads them, which bounds the live ciphertexts to a band of rows per stage.
+ *
+ * @param stages Layers in execution order (at least one)
+ * @param input  CipherTensor [n_images, channels, height, width]; left untouched
+ * @return One tensor [n_images, C', H', W'] per stage. The last is complete, as are those with
+ *         keep_output; released rows of the others hold empty ciphertexts.
+ */
+std::vector<CipherTensor> run_row_pipeline(const std::vector<RowStage> &stages, const CipherTensor &input);
+
+/**
+ * @brief Same pipeline, consuming its input: rows of the input are released as soon as the first
+ *        stage no longer reads them, so a single layer run this way never holds its whole input and
+ *        output at once. If other tensors share the input's store, it is left untouched instead.
+ */
+std::vector<CipherTensor> run_row_pipeline(const std::vector<RowStage> &stages, CipherTensor &&input);
+
+#endif // ROW_PIPELINE_H
@@ -0,0 +1,101 @@
+#include "spillFile.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+// Extents start on cache-line boundaries
+constexpr std::size_t extent_alignment = 64;
+
+std::runtime_error system_error(const std::string &what)
+{
+    return std::runtime_error("Spill file: " + what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+SpillFile::SpillFile(const std::string &directory)
+{
+    std::string name = directory + "/he_spill_XXXXXX";
+    std::vector<char> path(name.begin(), name.end());
+    path.push_back('\0');
+    fd_ = mkstemp(path.data());
+    if (fd_ < 0) {
+        throw system_error("cannot create a file in " + directory);
+    }
+    unlink(path.data());
+}
+
+SpillFile::~SpillFile()
+{
+    if (map_) {
+        munmap(map_, capacity_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+SpillFile::Extent SpillFile::allocate(std::size_t size)
+{
+    size = (size + extent_alignment - 1) / extent_alignment * extent_alignment;
+
+    Extent extent;
+    extent.size = size;
+    auto fit = free_.lower_bound(size);
+    if (fit != free_.end()) {
+        extent.offset = fit->second;
+        if (fit->first > size) {
+            free_.emplace(fit->first - size, fit->second + size);
+        }
+        free_.erase(fit);
+    } else {
+        if (end_ + size > capacity_) {
+            grow(end_ + size);
+        }
+        extent.offset = end_;
+        end_ += size;
+    }
+    used_ += size;
+    return extent;
+}
+
+void SpillFile::free(const Extent &extent)
+{
+    if (extent.size == 0) {
+        return;
+    }
+    used_ -= extent.size;
+    if (extent.offset + extent.size == end_) {
+        end_ = extent.offset;
+    } else {
+        free_.emplace(extent.size, extent.offset);
+    }
+}
+
+void SpillFile::grow(std::size_t min_capacity)
+{
+    // Doubling keeps the number of remaps logarithmic in the spilled volume
+    std::size_t capacity = capacity_ ? capacity_ : (std::size_t{ 1 } << 24);
+    while (capacity < min_capacity) {
+        capacity *= 2;
+    }
+    if (ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+        throw system_error("cannot grow to " + std::to_string(capacity) + " bytes");
+    }
+    void *map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        throw system_error("cannot map " + std::to_string(capacity) + " bytes");
+    }
+    if (map_) {
+        munmap(map_, capacity_);
+    }
+    map_ = static_cast<std::byte *>(map);
+    capacity_ = capacity;
+}
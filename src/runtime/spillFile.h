@@ -0,0 +1,50 @@
+#ifndef SPILL_FILE_H
+#define SPILL_FILE_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+/**
+ * Growable scratch file mapped into memory, handing out byte extents.
+ * - The file is created in a directory and unlinked at once: it never outlives the process.
+ * - Pages are file-backed (MAP_SHARED), so the kernel writes them out and drops them under
+ *   memory pressure instead of counting them against anonymous memory.
+ * - Freed extents are reused (best fit). Not thread-safe; data() pointers are invalidated by
+ *   the next allocate(), which may remap the file.
+ */
+class SpillFile {
+public:
+    struct Extent {
+        std::size_t offset = 0;
+        std::size_t size = 0;
+    };
+
+    // Create the backing file in directory (e.g. "/tmp")
+    explicit SpillFile(const std::string &directory);
+    ~SpillFile();
+
+    SpillFile(const SpillFile &) = delete;
+    SpillFile &operator=(const SpillFile &) = delete;
+
+    Extent allocate(std::size_t size);
+    void free(const Extent &extent);
+
+    std::byte *data(const Extent &extent) { return map_ + extent.offset; }
+
+    // Bytes of the file in use by live extents
+    std::size_t used() const { return used_; }
+
+private:
+    int fd_ = -1;
+    std::byte *map_ = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t end_ = 0;   // Extents are carved from [end_, capacity_) when no free one fits
+    std::size_t used_ = 0;
+    std::multimap<std::size_t, std::size_t> free_;  // size -> offset
+
+    // Grow the file and the mapping to at least min_capacity bytes
+    void grow(std::size_t min_capacity);
+};
+
+#endif // SPILL_FILE_H
@@ -0,0 +1,252 @@
+#include "taskScheduler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+// Identifies the scheduler (and deque) owned by the current worker thread
+static thread_local TaskScheduler *tls_scheduler = nullptr;
+static thread_local std::size_t tls_queue = 0;
+
+/******************************************************
+ * TaskGroup
+ *****************************************************/
+TaskGroup::TaskGroup(TaskScheduler &scheduler) : scheduler_(scheduler) {}
+
+TaskGroup::~TaskGroup()
+{
+    // Tasks reference the group, so they must finish before it goes away
+    bool pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending = pending_ > 0;
+    }
+    if (pending) {
+        try {
+            wait();
+        } catch (...) {
+        }
+    }
+}
+
+void TaskGroup::spawn(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_++;
+    }
+    scheduler_.push({ std::move(task), this });
+
+    // Counted once queued, so a sleeping waiter that wakes for it can pop it (tasks that spawn
+    // into their own group, like the row pipeline, keep the waiter busy)
+    std::lock_guard<std::mutex> lock(mutex_);
+    spawned_++;
+    done_.notify_all();
+}
+
+void TaskGroup::run(const std::function<void()> &task)
+{
+    std::exception_ptr error;
+    try {
+        task();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    // Last touch of the group: the waiter may destroy it once the lock is released
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error && !error_) {
+        error_ = error;
+    }
+    if (--pending_ == 0) {
+        done_.notify_all();
+    }
+}
+
+void TaskGroup::wait()
+{
+    std::exception_ptr error;
+    while (true) {
+        std::size_t seen;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            seen = spawned_;
+        }
+        // Help with this group's queued tasks only; the rest of them are running elsewhere
+        TaskScheduler::Task task;
+        while (scheduler_.try_pop_group(this, task)) {
+            run(task.fn);
+        }
+
+        // Sleep until the group is done or one of its running tasks queues another
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this, seen] { return pending_ == 0 || spawned_ != seen; });
+        if (pending_ == 0) {
+            std::swap(error, error_);
+            break;
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/******************************************************
+ * TaskScheduler
+ *****************************************************/
+TaskScheduler::TaskScheduler(std::size_t n_threads)
+{
+    // The waiting caller runs tasks too, so one thread fewer is spawned (at least one worker)
+    std::size_t n_workers = std::max<std::size_t>(1, n_threads > 0 ? n_threads - 1 : 0);
+    for (std::size_t i = 0; i < n_workers; i++) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (std::size_t i = 0; i < n_workers; i++) {
+        workers_.emplace_back(&TaskScheduler::worker_loop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+TaskScheduler &TaskScheduler::instance()
+{
+    static TaskScheduler scheduler([] {
+        const char *env = std::getenv("HE_NUM_THREADS");
+        if (env != nullptr && std::atoi(env) > 0) {
+            return static_cast<std::size_t>(std::atoi(env));
+        }
+        return static_cast<std::size_t>(std::max(1u, std::thread::hardware_concurrency()));
+    }());
+    return scheduler;
+}
+
+void TaskScheduler::push(Task task)
+{
+    // Workers push onto their own deque; outside threads spread their tasks round-robin
+    std::size_t index = (tls_scheduler == this)
+        ? tls_queue
+        : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+
+    // A sleeper counts itself before checking queued_, and this reads sleepers_ after bumping
+    // queued_ (both seq_cst): either it sees the task or we see it. Taking the lock then orders
+    // the notify after its predicate check (no lost wake-up).
+    if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+        { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+        wake_.notify_one();
+    }
+}
+
+bool TaskScheduler::try_pop(Task &task)
+{
+    std::size_t n = queues_.size();
+    bool is_worker = (tls_scheduler == this);
+    std::size_t own = is_worker ? tls_queue : next_queue_.load(std::memory_order_relaxed) % n;
+
+    // Own deque: newest task first (its data is still warm in cache)
+    if (is_worker) {
+        std::lock_guard<std::mutex> lock(queues_[own]->mutex);
+        if (!queues_[own]->tasks.empty()) {
+            task = std::move(queues_[own]->tasks.back());
+            queues_[own]->tasks.pop_back();
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another deque
+    for (std::size_t k = is_worker ? 1 : 0; k < n; k++) {
+        WorkerQueue &victim = *queues_[(own + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::try_pop_group(const TaskGroup *group, Task &task)
+{
+    std::size_t n = queues_.size();
+    std::size_t own = (tls_scheduler == this) ? tls_queue : 0;
+    for (std::size_t k = 0; k < n; k++) {
+        WorkerQueue &queue = *queues_[(own + k) % n];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        auto it = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(),
+                               [group](const Task &queued) { return queued.group == group; });
+        if (it != queue.tasks.rend()) {
+            task = std::move(*it);
+            queue.tasks.erase(std::next(it).base());
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::worker_loop(std::size_t index)
+{
+    tls_scheduler = this;
+    tls_queue = index;
+
+    while (true) {
+        Task task;
+        if (try_pop(task)) {
+            task.group->run(task.fn);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        wake_.wait(lock, [this] { return stop_ || queued_.load(std::memory_order_seq_cst) > 0; });
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        if (stop_) {
+            return;
+        }
+    }
+}
+
+void TaskScheduler::parallel_for(std::size_t n, const std::function<void(std::size_t)> &body)
+{
+    if (n == 0) {
+        return;
+    }
+    if (n == 1) {
+        body(0);
+        return;
+    }
+    // Contiguous blocks of nearly equal size, one task each
+    std::size_t n_chunks = std::min(n, n_threads() * chunks_per_thread);
+    TaskGroup group(*this);
+    for (std::size_t c = 0; c < n_chunks; c++) {
+        std::size_t begin = n * c / n_chunks;
+        std::size_t end = n * (c + 1) / n_chunks;
+        group.spawn([&body, begin, end] {
+            for (std::size_t i = begin; i < end; i++) {
+                body(i);
+            }
+        });
+    }
+    group.wait();
+}
+
+void TaskScheduler::parallel_for(std::size_t n0, std::size_t n1,
+                                 const std::function<void(std::size_t, std::size_t)> &body)
+{
+    parallel_for(n0 * n1, [&body, n1](std::size_t k) { body(k / n1, k % n1); });
+}
@@ -0,0 +1,128 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskScheduler;
+
+/**
+ * A set of tasks spawned together and waited on together.
+ * - The waiter runs the group's own queued tasks, and only those, so nested waits never stack an
+ *   unrelated task on top of a waiting one. Once none is left in the queues it sleeps until the
+ *   tasks other threads took have finished. Every queued task can still be run by its own waiter,
+ *   so nested groups cannot deadlock.
+ * - The first exception thrown by a task is rethrown by wait(); later tasks still run.
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskScheduler &scheduler);
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    // Queue a task on the calling thread's deque (LIFO for the owner, FIFO for thieves)
+    void spawn(std::function<void()> task);
+
+    // Help run tasks until every task of this group has finished
+    void wait();
+
+private:
+    friend class TaskScheduler;
+
+    TaskScheduler &scheduler_;
+
+    // Guards pending_ and error_. A task's last touch of the group is under it, so the waiter,
+    // which reads pending_ under it too, never destroys the group while a task still uses it.
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::size_t pending_ = 0;
+    std::size_t spawned_ = 0;  // Tasks queued so far, to wake the waiter for new ones
+    std::exception_ptr error_;
+
+    void run(const std::function<void()> &task);
+};
+
+/**
+ * Work-stealing task scheduler shared by all layers.
+ * - One deque per worker; a worker pops its own newest task and, when empty, steals the oldest
+ *   task of another worker (the largest remaining piece of work).
+ * - Threads outside the pool (e.g. main) queue onto the workers round-robin and help while waiting.
+ * - A push only touches the sleep lock when a worker is actually asleep.
+ * - The pool size is HE_NUM_THREADS, or std::thread::hardware_concurrency() if unset.
+ */
+class TaskScheduler {
+public:
+    explicit TaskScheduler(std::size_t n_threads);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler &) = delete;
+    TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+    // Process-wide scheduler used by the layer kernels
+    static TaskScheduler &instance();
+
+    // Number of threads that run tasks (workers plus the waiting caller)
+    std::size_t n_threads() const { return workers_.size() + 1; }
+
+    /**
+     * @brief Run body(i) for every i in [0, n) and wait for all of them.
+     *        The range is split into at most chunks_per_thread tasks per thread, each running a
+     *        contiguous block of indices, so large ranges do not flood the deques.
+     *        Safe to call from inside a task: the inner loop is stolen by idle threads.
+     */
+    void parallel_for(std::size_t n, const std::function<void(std::size_t)> &body);
+
+    /**
+     * @brief Run body(i, j) over the [0, n0) x [0, n1) grid and wait for all of them.
+     *        The grid is flattened row-major into the 1-D loop above, so it is chunked the same way:
+     *        each task runs a contiguous block of cells.
+     */
+    void parallel_for(std::size_t n0, std::size_t n1, const std::function<void(std::size_t, std::size_t)> &body);
+
+    // Tasks per thread a parallel_for is split into: enough to balance uneven iterations
+    static constexpr std::size_t chunks_per_thread = 4;
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup *group;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<std::size_t> queued_{ 0 };
+    std::atomic<std::size_t> next_queue_{ 0 };
+    std::atomic<std::size_t> sleepers_{ 0 };
+    std::atomic<bool> stop_{ false };
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+
+    void push(Task task);
+
+    // Pop from the calling worker's own deque, else steal; false if every deque is empty
+    bool try_pop(Task &task);
+
+    // Pop a queued task of group (own deque first, newest first); false if none is queued
+    bool try_pop_group(const TaskGroup *group, Task &task);
+
+    void worker_loop(std::size_t index);
+};
+
+#endif // TASK_SCHEDULER_H
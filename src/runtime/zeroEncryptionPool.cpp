@@ -0,0 +1,93 @@
+#include "zeroEncryptionPool.h"
+#include <utility>
+
+ZeroEncryptionPool::ZeroEncryptionPool(const seal::SEALContext &context,
+                                       const seal::PublicKey &public_key,
+                                       std::size_t capacity,
+                                       bool background,
+                                       seal::MemoryPoolHandle pool)
+    : encryptor_(context, public_key), pool_(std::move(pool)), capacity_(capacity)
+{
+    stock_.reserve(capacity_);
+    if (background) {
+        filler_ = std::thread(&ZeroEncryptionPool::filler_loop, this);
+    }
+}
+
+ZeroEncryptionPool::~ZeroEncryptionPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    refill_.notify_all();
+    if (filler_.joinable()) {
+        filler_.join();
+    }
+}
+
+seal::Ciphertext ZeroEncryptionPool::take()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stock_.empty()) {
+            seal::Ciphertext zero = std::move(stock_.back());
+            stock_.pop_back();
+            stats_.served++;
+            refill_.notify_one();
+            return zero;
+        }
+        stats_.misses++;
+    }
+    return encrypt_zero();
+}
+
+void ZeroEncryptionPool::fill()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (stock_.size() + in_flight_ < capacity_) {
+        produce(lock);
+    }
+}
+
+ZeroPoolStats ZeroEncryptionPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ZeroPoolStats stats = stats_;
+    stats.available = stock_.size();
+    return stats;
+}
+
+seal::Ciphertext ZeroEncryptionPool::encrypt_zero() const
+{
+    // Encryptor is thread-safe for encryption: every call seeds its own PRNG
+    seal::Ciphertext zero(pool_);
+    encryptor_.encrypt_zero(zero, pool_);
+    return zero;
+}
+
+void ZeroEncryptionPool::filler_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        refill_.wait(lock, [this] { return stop_ || stock_.size() + in_flight_ < capacity_; });
+        if (stop_) {
+            return;
+        }
+        produce(lock);
+    }
+}
+
+void ZeroEncryptionPool::produce(std::unique_lock<std::mutex> &lock)
+{
+    // The slot is reserved under the lock, so concurrent fill() calls and the filler together
+    // never stock more than capacity
+    in_flight_++;
+    // Encrypt without the lock, so take() is never held up by the sampling
+    lock.unlock();
+    seal::Ciphertext zero = encrypt_zero();
+    lock.lock();
+    in_flight_--;
+    stock_.push_back(std::move(zero));
+    stats_.produced++;
+}
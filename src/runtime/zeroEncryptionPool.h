@@ -0,0 +1,86 @@
+#ifndef ZERO_ENCRYPTION_POOL_H
+#define ZERO_ENCRYPTION_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <seal/seal.h>
+
+/**
+ * Counters of a ZeroEncryptionPool.
+ */
+struct ZeroPoolStats {
+    std::size_t available = 0;  // Encryptions of zero in stock now
+    std::size_t produced = 0;   // Encrypted ahead of time (background thread or fill())
+    std::size_t served = 0;     // Taken from the stock
+    std::size_t misses = 0;     // Encrypted inline by take() because the stock was empty
+};
+
+/**
+ * Stock of fresh public-key encryptions of zero, for offline/online encryption.
+ * - A public-key encryption of m is an encryption of zero plus m: the sampling and NTTs do not
+ *   depend on the message, so they run ahead of time and encrypting is one plaintext addition.
+ * - Every encryption of zero is handed out once. Two ciphertexts sharing one would reveal the
+ *   difference of their messages.
+ * - With background, a thread keeps the stock at capacity, refilling as ciphertexts are taken;
+ *   otherwise fill() tops it up on the calling thread (e.g. while the client is idle).
+ * - take() never waits: on an empty stock it encrypts zero inline and counts a miss.
+ * - A ciphertext takes 2 * primes * N * 8 bytes, so capacity is bounded by memory, not by time.
+ */
+class ZeroEncryptionPool {
+public:
+    /**
+     * @param context    Context of the public key; ciphertexts are at its first data level
+     * @param public_key Key every encryption of zero is made with
+     * @param capacity   Encryptions of zero kept in stock
+     * @param background Refill from a dedicated thread as the stock is taken from
+     * @param pool       Memory pool the stocked ciphertexts are allocated from (thread-safe)
+     */
+    ZeroEncryptionPool(const seal::SEALContext &context,
+                       const seal::PublicKey &public_key,
+                       std::size_t capacity,
+                       bool background = true,
+                       seal::MemoryPoolHandle pool = seal::MemoryPoolHandle::New());
+    ~ZeroEncryptionPool();
+
+    ZeroEncryptionPool(const ZeroEncryptionPool &) = delete;
+    ZeroEncryptionPool &operator=(const ZeroEncryptionPool &) = delete;
+
+    // A fresh encryption of zero (scale 1, NTT form, first data level), never handed out before
+    seal::Ciphertext take();
+
+    // Encrypt zeros on the calling thread until the stock is at capacity
+    void fill();
+
+    std::size_t capacity() const { return capacity_; }
+    bool background() const { return filler_.joinable(); }
+
+    // Snapshot of the counters
+    ZeroPoolStats stats() const;
+
+private:
+    seal::Encryptor encryptor_;
+    seal::MemoryPoolHandle pool_;
+    std::size_t capacity_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable refill_;  // Wakes the filler when the stock drops below capacity
+    std::vector<seal::Ciphertext> stock_;
+    std::size_t in_flight_ = 0;  // Slots reserved by encryptions running outside the lock
+    ZeroPoolStats stats_;
+    bool stop_ = false;
+
+    // Declared last: started once everything above is initialized
+    std::thread filler_;
+
+    seal::Ciphertext encrypt_zero() const;
+
+    void filler_loop();
+
+    // Reserve a slot, encrypt a zero with the lock released and stock it; lock is held on entry and exit
+    void produce(std::unique_lock<std::mutex> &lock);
+};
+
+#endif // ZERO_ENCRYPTION_POOL_H
@@ -1,54 +1,242 @@
 #include "sequential.h"
-#include "../pooling/avgPooling.h"  
-#include "../functions/square.h"  
+#include "../runtime/taskScheduler.h"
 
 // Constructor
-Sequential::Sequential(CKKSPyfhel &he) : he_(he), feature_map_(nullptr), embedding_(nullptr) {}
+Sequential::Sequential(const CKKSPyfhel &he) : he_(he) {}
+
+void Sequential::setPipelined(bool pipelined) {
+    pipelined_ = pipelined;
+}
+
+void Sequential::setLevelDropping(bool drop_levels) {
+    drop_levels_ = drop_levels;
+}
+
+void Sequential::setMemoryBudget(size_t budget_bytes, const std::string &spill_dir) {
+    memory_budget_ = budget_bytes;
+    spill_dir_ = spill_dir;
+}
 
 // Add a layer to the sequential model
-void Sequential::addLayer(std::shared_ptr<void> layer) {
-    layers_.push_back(layer);
+void Sequential::addLayer(std::shared_ptr<const Layer> layer) {
+    if (!layer) {
+        throw std::invalid_argument("Sequential Error: Layer is null.");
+    }
+    Kind kind = Kind::Other;
+    if (std::dynamic_pointer_cast<const Conv2d>(layer)) {
+        kind = Kind::Conv;
+    } else if (std::dynamic_pointer_cast<const FlattenLayer>(layer)) {
+        kind = Kind::Flatten;
+    }
+    RowStage rows;
+    if (auto row_layer = std::dynamic_pointer_cast<const RowLayer>(layer)) {
+        rows = make_row_stage(row_layer);
+    }
+    size_t depth = layer->depth();
+    layers_.push_back({ kind, std::move(layer), std::move(rows), depth });
+}
+
+GraphExecutor Sequential::compile(const std::vector<size_t> &input_shape) const {
+    std::vector<std::shared_ptr<const Layer>> layers;
+    for (const auto &step : layers_) {
+        layers.push_back(step.layer);
+    }
+    return GraphExecutor(he_, std::move(layers), input_shape);
+}
+
+// Forward propagation through all layers, keeping the feature map and embedding
+CipherTensor Sequential::operator()(CipherTensor x) {
+    x = forward(std::move(x), &feature_map_, &embedding_);
+    for (const auto &layer : layers_) {
+        has_feature_map_ = has_feature_map_ || layer.kind == Kind::Conv;
+        has_embedding_ = has_embedding_ || layer.kind == Kind::Flatten;
+    }
+    return x;
+}
+
+// Forward propagation through all layers (const: the model is only read)
+CipherTensor Sequential::forward(CipherTensor x, CipherTensor *feature_map, CipherTensor *embedding) const {
+    if (layers_.empty()) {
+        throw std::runtime_error("Sequential Error: Model has no layers.");
+    }
+
+    // Static shape check: a chain that does not fit the input fails before any ciphertext work
+    std::vector<size_t> shape = x.shape();
+    for (const auto &layer : layers_) {
+        shape = layer.layer->infer_shape(shape);
+    }
+
+    // The output of the last Conv2d is kept whole as the feature map
+    size_t last_conv = layers_.size();
+    for (size_t i = 0; i < layers_.size(); i++) {
+        if (layers_[i].kind == Kind::Conv) last_conv = i;
+    }
+
+    // Levels still needed after layer i - 1: the depth of layers i and onwards
+    std::vector<size_t> remaining(layers_.size() + 1, 0);
+    for (size_t i = layers_.size(); i-- > 0;) {
+        remaining[i] = remaining[i + 1] + layers_[i].depth;
+    }
+    if (drop_levels_) {
+        x = drop_levels(std::move(x), remaining[0]);
+    }
+
+    // Memory budget: tensors held only by this pass are tracked (an input the caller still shares
+    // is never spilled) and cold blocks are spilled between images
+    std::unique_ptr<MemoryBudget> budget;
+    bool x_tracked = false, feature_map_tracked = false, embedding_tracked = false;
+    if (memory_budget_ > 0) {
+        budget = std::make_unique<MemoryBudget>(he_, memory_budget_, spill_dir_);
+        if (!x.is_shared()) {
+            budget->track(x);
+            x_tracked = true;
+        }
+    }
+
+    for (size_t i = 0; i < layers_.size();) {
+        // Dataflow mode: the longest run of row-capable layers becomes one pipeline
+        size_t end = i;
+        if (pipelined_ && x.ndim() == 4) {
+            while (end < layers_.size() && layers_[end].rows.forward_row) end++;
+        }
+        if (end - i < 2) {
+            end = i + 1;
+        }
+
+        std::vector<CipherTensor> outputs;
+        if (budget) {
+            outputs = run_budgeted(*budget, i, end, remaining, last_conv, x, x_tracked);
+        } else {
+            outputs = run_segment(i, end, remaining, last_conv, std::move(x));
+        }
+
+        // Outputs of this segment kept past it: the feature map, the embedding and the new x.
+        // With a budget, run_budgeted tracked each output once; that count goes to whichever
+        // holder is not the new x, and the new x is tracked again
+        if (feature_map && last_conv >= i && last_conv < end) {
+            if (feature_map_tracked) budget->untrack(*feature_map);
+            *feature_map = outputs[last_conv - i];
+            if (budget && last_conv + 1 == end) budget->track(*feature_map);
+            feature_map_tracked = static_cast<bool>(budget);
+        } else if (budget && last_conv >= i && last_conv + 1 < end) {
+            budget->untrack(outputs[last_conv - i]);
+        }
+        if (embedding && layers_[end - 1].kind == Kind::Flatten) {
+            if (embedding_tracked) budget->untrack(*embedding);
+            *embedding = outputs.back();
+            if (budget) budget->track(*embedding);
+            embedding_tracked = static_cast<bool>(budget);
+        }
+        if (x_tracked) {
+            budget->untrack(x);
+        }
+        x = outputs.back();
+        x_tracked = static_cast<bool>(budget);
+        i = end;
+    }
+
+    // Whatever the caller gets back is paged in
+    if (budget) {
+        budget->use_all(x);
+        if (feature_map_tracked) budget->use_all(*feature_map);
+        if (embedding_tracked) budget->use_all(*embedding);
+    }
+    return x;
 }
 
-// Forward propagation through convolutional, pooling, flatten, and square layers
-std::vector<std::vector<seal::Ciphertext>>  
-Sequential::operator()(std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &x) {
-    for (auto &layer : layers_) {
-        if (auto conv = std::dynamic_pointer_cast<Conv2d>(layer)) {
-            x = (*conv)(x);
-            feature_map_ = &x; // Store the feature map after the last Conv2d layer
-        } else if (auto pool = std::dynamic_pointer_cast<AvgPoolLayer>(layer)) {
-            x = (*pool)(x);
-        // } else if (auto adaptive_pool = std::dynamic_pointer_cast<AvgPoolLayer>(layer)) {
-        //     x = (*adaptive_pool)(x);
-        } else if (auto square = std::dynamic_pointer_cast<SquareLayer>(layer)) {
-            x = (*square)(x); // Apply element-wise squaring
-        } else if (auto flatten = std::dynamic_pointer_cast<FlattenLayer>(layer)) {
-            
-            auto flat_output = (*flatten)(x);
-            embedding_ = &flat_output;
-            return flat_output;
+std::vector<CipherTensor> Sequential::run_segment(size_t first, size_t end, const std::vector<size_t> &remaining,
+                                                  size_t last_conv, CipherTensor x) const {
+    if (end - first >= 2) {
+        std::vector<RowStage> stages;
+        for (size_t j = first; j < end; j++) {
+            stages.push_back(layers_[j].rows);
+            stages.back().keep_output = (j == last_conv);
+            if (drop_levels_) {
+                size_t depth = remaining[j + 1];
+                stages.back().finish = [this, depth](seal::Ciphertext &ct) { he_.drop_to_depth_inplace(ct, depth); };
+            }
         }
+        return run_row_pipeline(stages, std::move(x));
+    }
+
+    x = (*layers_[first].layer)(std::move(x));
+    if (drop_levels_ && layers_[first].depth > 0) {
+        x = drop_levels(std::move(x), remaining[end]);
     }
-    throw std::runtime_error("Sequential Error: Model did not produce a valid flattened output.");
+    return { x };
 }
 
-// Forward propagation for linear layers (takes a vector instead of a 4D tensor)
-std::vector<std::vector<seal::Ciphertext>> Sequential::operator()(std::vector<std::vector<seal::Ciphertext>> &x) {
-    for (auto &layer : layers_) {
-        if (auto linear = std::dynamic_pointer_cast<LinearLayer>(layer)) {
-            return (*linear)(x);
+std::vector<CipherTensor> Sequential::run_budgeted(MemoryBudget &budget, size_t first, size_t end,
+                                                   const std::vector<size_t> &remaining, size_t last_conv,
+                                                   CipherTensor &x, bool x_tracked) const {
+    // A reshape moves no data: it runs on the whole tensor, whose blocks stay tracked under the new view
+    if (end - first == 1 && layers_[first].kind == Kind::Flatten) {
+        std::vector<CipherTensor> outputs = run_segment(first, end, remaining, last_conv, x);
+        budget.track(outputs.back());
+        return outputs;
+    }
+
+    // One image at a time: only its input blocks are paged in, and its outputs join the tracked
+    // tensors before the budget is enforced again. Images run one after the other (each still in
+    // parallel inside), which is the price of a bounded footprint.
+    size_t n_images = x.dim(0);
+    std::vector<size_t> shape = x.shape();
+    shape[0] = 1;
+
+    // Consumed input blocks are freed, unless the input is the caller's or a kept tensor shares it
+    bool consume = x_tracked && !x.is_shared();
+
+    std::vector<CipherTensor> outputs;
+    for (size_t img = 0; img < n_images; img++) {
+        if (x_tracked) budget.use(x, img);
+        std::vector<CipherTensor> image_outputs = run_segment(first, end, remaining, last_conv, x.slice(img).reshape(shape));
+        if (consume) {
+            CipherTensor consumed = x.slice(img);
+            for (auto &ct : consumed) ct.release();
         }
+
+        for (size_t k = 0; k < image_outputs.size(); k++) {
+            // Only the segment output and the feature map are read after the segment
+            if (k + 1 != image_outputs.size() && first + k != last_conv) continue;
+            if (outputs.empty()) outputs.resize(image_outputs.size());
+            if (outputs[k].ndim() == 0) {
+                std::vector<size_t> out_shape = image_outputs[k].shape();
+                out_shape[0] = n_images;
+                outputs[k] = CipherTensor(out_shape);
+                budget.track(outputs[k]);
+            }
+            CipherTensor destination = outputs[k].slice(img);
+            for (size_t e = 0; e < destination.size(); e++) {
+                destination[e] = std::move(image_outputs[k][e]);
+            }
+            budget.use(outputs[k], img);
+        }
+        budget.enforce();
+    }
+    return outputs;
+}
+
+CipherTensor Sequential::drop_levels(CipherTensor x, size_t depth) const {
+    if (!x.is_shared()) {
+        TaskScheduler::instance().parallel_for(x.size(), [&](size_t i) {
+            he_.drop_to_depth_inplace(x[i], depth);
+        });
+        return x;
     }
-    throw std::runtime_error("Sequential Error: No Linear Layer found to process input.");
+    CipherTensor dropped(x.shape());
+    TaskScheduler::instance().parallel_for(x.size(), [&](size_t i) {
+        dropped[i] = x[i];
+        he_.drop_to_depth_inplace(dropped[i], depth);
+    });
+    return dropped;
 }
 
 // Get the last feature map (output of the last Conv2d layer)
-std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>* Sequential::getFeatureMap() {
-    return feature_map_;
+const CipherTensor *Sequential::getFeatureMap() const {
+    return has_feature_map_ ? &feature_map_ : nullptr;
 }
 
-// // Get the last embedding vector (output of the Flatten layer)
-// std::vector<std::vector<seal::Ciphertext>>* Sequential::getEmbedding() {
-//     return embedding_;
-// }
+// Get the last embedding vector (output of the Flatten layer)
+const CipherTensor *Sequential::getEmbedding() const {
+    return has_embedding_ ? &embedding_ : nullptr;
+}
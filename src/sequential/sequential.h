@@ -3,40 +3,106 @@
 
 #include "../he/he.h"
 #include "../convolution/convolution.h"
-#include "../pooling/avgpooling.h"
+#include "../pooling/avgPooling.h"
+#include "../pooling/adaptiveAvgPooling.h"
+#include "../functions/square.h"
 #include "../flatten/flatten.h"
 #include "../linear/linear.h"
-// #include "../pooling/adaptiveAvgPooling.h"
+#include "../layer/layer.h"
+#include "../runtime/rowPipeline.h"
+#include "../runtime/memoryBudget.h"
+#include "../runtime/graphExecutor.h"
 #include <vector>
 #include <iostream>
 #include <memory>
+#include <functional>
 #include <stdexcept>
+#include <string>
 
 // Sequential model container to hold and process different layers
 class Sequential {
 public:
-    explicit Sequential(CKKSPyfhel &he);
+    explicit Sequential(const CKKSPyfhel &he);
 
-    // Add a layer to the sequential model
-    void addLayer(std::shared_ptr<void> layer);
+    // Add a layer to the sequential model (layers run in insertion order). RowLayers can join
+    // row pipelines; the last Conv2d output is the feature map, the Flatten output the embedding.
+    void addLayer(std::shared_ptr<const Layer> layer);
 
-    // Forward propagation through convolutional, pooling, and flatten layers
-    std::vector<std::vector<seal::Ciphertext>>  operator()(std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>> &x);
+    // Forward propagation through all layers. Each output is moved into the next layer, which
+    // frees its input ciphertexts as it consumes them (unless the feature map or embedding shares
+    // them); Flatten is a zero-copy reshape. Pass the input with std::move to free it too.
+    // Keeps the feature map and embedding for the getters below.
+    CipherTensor operator()(CipherTensor x);
 
-    // Forward propagation through linear layers
-    std::vector<std::vector<seal::Ciphertext>> operator()(std::vector<std::vector<seal::Ciphertext>>  &x);
+    // Same forward pass, but const and reentrant: one model serves concurrent requests. The
+    // feature map and embedding of this pass are written to the optional outputs instead.
+    CipherTensor forward(CipherTensor x, CipherTensor *feature_map = nullptr, CipherTensor *embedding = nullptr) const;
 
-    // Retrieve the last feature map (output of last Conv2d layer)
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>* getFeatureMap();
+    // Dataflow mode: consecutive Conv2d / SquareLayer / AvgPoolLayer layers run as one row
+    // pipeline (run_row_pipeline), so a layer starts on the first rows of its input while the
+    // previous layer is still computing the rest, and consumed intermediate rows are freed early.
+    // Other layers remain barriers. Off by default.
+    void setPipelined(bool pipelined);
 
-    // Retrieve the last embedding vector (output of Flatten layer)
-    // std::vector<std::vector<seal::Ciphertext>>* getEmbedding();
+    // Eager level dropping: the input and every layer output are mod-switched, as soon as they are
+    // produced, down to exactly the depth the remaining layers consume (the sum of their depth()).
+    // Later multiplies, rescales and the stored tensors then carry fewer RNS limbs. The feature map
+    // and embedding keep only the levels the rest of the model needs. Off by default.
+    void setLevelDropping(bool drop_levels);
+
+    // Memory-budgeted execution: each layer (or pipeline) runs one image at a time, and whenever
+    // the ciphertexts of the tensors held by the pass exceed budget_bytes, the least recently used
+    // (image, channel) blocks are spilled to an mmap'ed file in spill_dir (SEAL binary format) and
+    // paged back in when their image is next read. The returned output, feature map and embedding
+    // are paged in before forward returns. 0 disables the budget (the default).
+    void setMemoryBudget(size_t budget_bytes, const std::string &spill_dir = "/tmp");
+
+    // Static plan for inputs of input_shape: every layer output shape is inferred (throwing if a
+    // layer does not accept its input) and preallocated once. See GraphExecutor.
+    GraphExecutor compile(const std::vector<size_t> &input_shape) const;
+
+    // Retrieve the last feature map (output of last Conv2d layer), or nullptr before a forward pass
+    const CipherTensor *getFeatureMap() const;
+
+    // Retrieve the last embedding vector (output of Flatten layer), or nullptr before a forward pass
+    const CipherTensor *getEmbedding() const;
 
 private:
-    CKKSPyfhel &he_;
-    std::vector<std::shared_ptr<void>> layers_;
-    std::vector<std::vector<std::vector<std::vector<seal::Ciphertext>>>>* feature_map_;
-    std::vector<std::vector<seal::Ciphertext>>* embedding_;
+    enum class Kind { Conv, Flatten, Other };
+    struct Step {
+        Kind kind;
+        std::shared_ptr<const Layer> layer;
+        RowStage rows;  // Row interface; empty for layers that need their whole input
+        size_t depth;   // Levels the layer consumes
+    };
+
+    const CKKSPyfhel &he_;
+    std::vector<Step> layers_;
+    bool pipelined_ = false;
+    bool drop_levels_ = false;
+    size_t memory_budget_ = 0;
+    std::string spill_dir_;
+
+    // x with every ciphertext left with exactly `depth` levels: in place, or into a new tensor
+    // if x is shared (the other holders keep their levels)
+    CipherTensor drop_levels(CipherTensor x, size_t depth) const;
+
+    // Run layers [first, end) on x: one layer, or a row pipeline when end - first >= 2. Returns
+    // the output of each layer (the last one is the segment output)
+    std::vector<CipherTensor> run_segment(size_t first, size_t end, const std::vector<size_t> &remaining,
+                                          size_t last_conv, CipherTensor x) const;
+
+    // Same segment one image at a time under the budget; outputs that outlive the segment (the
+    // last one and the feature map) are assembled whole and returned tracked once each
+    std::vector<CipherTensor> run_budgeted(MemoryBudget &budget, size_t first, size_t end,
+                                           const std::vector<size_t> &remaining, size_t last_conv,
+                                           CipherTensor &x, bool x_tracked) const;
+
+    // Views that share the ciphertexts of the stored outputs (no copies)
+    CipherTensor feature_map_;
+    CipherTensor embedding_;
+    bool has_feature_map_ = false;
+    bool has_embedding_ = false;
 };
 
 #endif // SEQUENTIAL_H
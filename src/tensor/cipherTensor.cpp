@@ -0,0 +1,91 @@
+#include "cipherTensor.h"
+#include <stdexcept>
+#include <string>
+#include <functional>
+#include <numeric>
+
+static std::size_t element_count(const std::vector<std::size_t> &shape)
+{
+    return std::accumulate(shape.begin(), shape.end(), std::size_t{ 1 }, std::multiplies<std::size_t>());
+}
+
+CipherTensor::CipherTensor(std::vector<std::size_t> shape)
+    : store_(std::make_shared<std::vector<seal::Ciphertext>>(element_count(shape))),
+      shape_(std::move(shape))
+{
+    set_contiguous_strides();
+}
+
+CipherTensor::CipherTensor(std::vector<std::size_t> shape, std::vector<seal::Ciphertext> &&data)
+    : shape_(std::move(shape))
+{
+    if (data.size() != element_count(shape_)) {
+        throw std::invalid_argument("CipherTensor: " + std::to_string(data.size()) +
+                                    " ciphertexts do not match the shape.");
+    }
+    store_ = std::make_shared<std::vector<seal::Ciphertext>>(std::move(data));
+    set_contiguous_strides();
+}
+
+std::size_t CipherTensor::size() const
+{
+    return store_ ? element_count(shape_) : 0;
+}
+
+void CipherTensor::set_contiguous_strides()
+{
+    strides_.assign(shape_.size(), 1);
+    for (std::size_t d = shape_.size(); d-- > 1;) {
+        strides_[d - 1] = strides_[d] * shape_[d];
+    }
+}
+
+std::size_t CipherTensor::offset_of(std::initializer_list<std::size_t> index) const
+{
+    if (index.size() != shape_.size()) {
+        throw std::invalid_argument("CipherTensor: index of rank " + std::to_string(index.size()) +
+                                    " on a tensor of rank " + std::to_string(shape_.size()) + ".");
+    }
+    std::size_t offset = offset_;
+    std::size_t d = 0;
+    for (std::size_t i : index) {
+        if (i >= shape_[d]) {
+            throw std::out_of_range("CipherTensor: index " + std::to_string(i) + " out of range on axis " +
+                                    std::to_string(d) + ".");
+        }
+        offset += i * strides_[d++];
+    }
+    return offset;
+}
+
+CipherTensor CipherTensor::slice(std::size_t index) const
+{
+    if (shape_.empty() || index >= shape_[0]) {
+        throw std::out_of_range("CipherTensor: slice index out of range.");
+    }
+    CipherTensor view;
+    view.store_ = store_;
+    view.offset_ = offset_ + index * strides_[0];
+    view.shape_.assign(shape_.begin() + 1, shape_.end());
+    view.strides_.assign(strides_.begin() + 1, strides_.end());
+    return view;
+}
+
+CipherTensor CipherTensor::reshape(std::vector<std::size_t> shape) const
+{
+    if (element_count(shape) != size()) {
+        throw std::invalid_argument("CipherTensor: reshape must keep the number of elements.");
+    }
+    // Slices of a row-major tensor stay row-major, so every view can be reshaped in place
+    CipherTensor view;
+    view.store_ = store_;
+    view.offset_ = offset_;
+    view.shape_ = std::move(shape);
+    view.set_contiguous_strides();
+    return view;
+}
+
+CipherTensor CipherTensor::clone() const
+{
+    return CipherTensor(shape_, std::vector<seal::Ciphertext>(begin(), end()));
+}
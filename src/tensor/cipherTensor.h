@@ -0,0 +1,88 @@
+#ifndef CIPHER_TENSOR_H
+#define CIPHER_TENSOR_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <initializer_list>
+#include <seal/seal.h>
+
+/**
+ * N-dimensional array of ciphertexts over one contiguous backing store.
+ * - Row-major: element (i0, ..., ik) lives at offset + sum(i_d * strides[d]) in the store.
+ * - The store is shared: copies, slices and reshapes are views (a few words of metadata),
+ *   so layer outputs are moved or aliased instead of deep-copied. Use clone() for a deep copy.
+ * - Writing through a view writes into the tensor it was taken from.
+ */
+class CipherTensor {
+public:
+    CipherTensor() = default;
+
+    // New tensor of default-constructed ciphertexts
+    explicit CipherTensor(std::vector<std::size_t> shape);
+
+    // Adopt existing ciphertexts (row-major, moved in) under the given shape
+    CipherTensor(std::vector<std::size_t> shape, std::vector<seal::Ciphertext> &&data);
+
+    const std::vector<std::size_t> &shape() const { return shape_; }
+    const std::vector<std::size_t> &strides() const { return strides_; }
+    std::size_t dim(std::size_t axis) const { return shape_.at(axis); }
+    std::size_t ndim() const { return shape_.size(); }
+
+    // Number of elements
+    std::size_t size() const;
+    bool empty() const { return size() == 0; }
+
+    // True if other tensors or views share this store (in-place writes would be visible there)
+    bool is_shared() const { return store_ && store_.use_count() > 1; }
+
+    // Element access by multi-index, e.g. t(img, c, y, x)
+    template <typename... Index>
+    seal::Ciphertext &operator()(Index... index) {
+        return store_->at(offset_of({ static_cast<std::size_t>(index)... }));
+    }
+    template <typename... Index>
+    const seal::Ciphertext &operator()(Index... index) const {
+        return store_->at(offset_of({ static_cast<std::size_t>(index)... }));
+    }
+
+    // Element access by row-major flat index
+    seal::Ciphertext &operator[](std::size_t i) { return (*store_)[offset_ + i]; }
+    const seal::Ciphertext &operator[](std::size_t i) const { return (*store_)[offset_ + i]; }
+
+    // Contiguous iteration over all elements
+    seal::Ciphertext *begin() { return store_ ? store_->data() + offset_ : nullptr; }
+    seal::Ciphertext *end() { return begin() + size(); }
+    const seal::Ciphertext *begin() const { return store_ ? store_->data() + offset_ : nullptr; }
+    const seal::Ciphertext *end() const { return begin() + size(); }
+
+    /**
+     * @brief View of the sub-tensor at `index` along the first axis (e.g. one image of a batch).
+     *        Shares the store; the result has one dimension less.
+     */
+    CipherTensor slice(std::size_t index) const;
+
+    /**
+     * @brief Zero-copy reshape to a shape with the same number of elements.
+     */
+    CipherTensor reshape(std::vector<std::size_t> shape) const;
+
+    /**
+     * @brief Deep copy into a new store.
+     */
+    CipherTensor clone() const;
+
+private:
+    std::shared_ptr<std::vector<seal::Ciphertext>> store_;
+    std::size_t offset_ = 0;
+    std::vector<std::size_t> shape_;
+    std::vector<std::size_t> strides_;
+
+    // Row-major strides for shape_
+    void set_contiguous_strides();
+
+    // Store offset of a multi-index (rank and bounds are checked)
+    std::size_t offset_of(std::initializer_list<std::size_t> index) const;
+};
+
+#endif // CIPHER_TENSOR_H
@@ -0,0 +1,32 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <iostream>
+#include <string>
+
+// Harness of the behavior-check drivers (test*.cpp, run with ctest): every check prints one line,
+// and the driver exits non-zero if any of them failed
+
+inline int &check_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+inline void report(const std::string &name, bool ok)
+{
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << name << std::endl;
+    if (!ok) {
+        check_failures()++;
+    }
+}
+
+// Summary line and exit code of a driver; what names its checks ("decode", "tensor view", ...)
+inline int finish(const std::string &what)
+{
+    bool passed = check_failures() == 0;
+    std::cout << (passed ? "All " + what + " checks passed" : "Some " + what + " checks failed") << std::endl;
+    return passed ? 0 : 1;
+}
+
+#endif // TEST_CHECK_H
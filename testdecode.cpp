@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "testCheck.h"
+
+// Checks CKKSPyfhel::decode (slot 0 evaluated in O(N)) against CKKSEncoder::decode (full FFT)
+// on plaintexts of one and several primes, at the encoding scale and at a product scale.
+
+static void check(const std::string &name, double fast, double reference)
+{
+    // Both decode the same integer coefficients: only floating-point rounding may differ
+    bool ok = std::fabs(fast - reference) <= 1e-6 * std::max(1.0, std::fabs(reference));
+    report(name + ": decode " + std::to_string(fast) + ", encoder " + std::to_string(reference), ok);
+}
+
+int main()
+{
+    CKKSPyfhel he(8192, std::pow(2.0, 30), { 50, 30, 30, 50 });
+    he.generate_keys();
+
+    const std::vector<double> values = { 0.0, 1.0, -1.0, 3.14159, -271.828, 1e-3, 500.25 };
+
+    for (double v : values) {
+        // Constant broadcast, every prime of the top level
+        seal::Plaintext pt = he.encode(v);
+        check("encode(" + std::to_string(v) + ")", he.decode(pt), he.decodeVectorPacked(pt, 1)[0]);
+
+        // Decrypted at the top level (several primes composed). Decryption is deterministic, so
+        // decrypt() and decryptVectorPacked() decode the same plaintext.
+        seal::Ciphertext ct = he.encrypt(v);
+        check("top level " + std::to_string(v), he.decrypt(ct), he.decryptVectorPacked(ct, 1)[0]);
+
+        // Un-rescaled product: scale 2^60, wider than the first prime
+        seal::Ciphertext product = ct;
+        he.evaluator().multiply_plain_inplace(product, he.encode(0.5));
+        check("product scale " + std::to_string(v), he.decrypt(product), he.decryptVectorPacked(product, 1)[0]);
+
+        // Last level: a single prime
+        he.evaluator().rescale_to_next_inplace(product);
+        he.evaluator().mod_switch_to_next_inplace(product);
+        check("last level " + std::to_string(v), he.decrypt(product), he.decryptVectorPacked(product, 1)[0]);
+
+        // And the value itself, within CKKS noise
+        double error = std::fabs(he.decrypt(product) - v * 0.5);
+        report("value " + std::to_string(v * 0.5) + ": error " + std::to_string(error), error <= 1e-3 * std::max(1.0, std::fabs(v)));
+    }
+
+    // Packed plaintext: only slot 0 is read, the other slots must not leak into it
+    std::vector<double> packed = { 7.5, -2.0, 100.0, 0.125 };
+    seal::Plaintext pt = he.encodeVectorPacked(packed);
+    check("packed slot 0", he.decode(pt), he.decodeVectorPacked(pt, packed.size())[0]);
+
+    return finish("decode");
+}
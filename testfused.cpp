@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "testCheck.h"
+
+// Checks the fused dot products (multiply_plain_accumulate, multiply_const_accumulate) against the
+// unfused evaluator sequence multiply_plain + add. Both are exact modular arithmetic, so the
+// resulting ciphertexts must be identical word for word, not just decrypt to close values.
+
+static bool identical(const seal::Ciphertext &a, const seal::Ciphertext &b)
+{
+    if (a.parms_id() != b.parms_id() || a.size() != b.size() || a.scale() != b.scale()) {
+        return false;
+    }
+    std::size_t words = a.size() * a.poly_modulus_degree() * a.coeff_modulus_size();
+    return std::equal(a.data(), a.data() + words, b.data());
+}
+
+// sum_i cts[i] * pts[i] with the plain evaluator; plaintexts are switched down to each ciphertext's level
+static seal::Ciphertext unfused(const CKKSPyfhel &he, const std::vector<const seal::Ciphertext *> &cts,
+                                const std::vector<seal::Plaintext> &pts)
+{
+    seal::Ciphertext sum;
+    for (std::size_t i = 0; i < cts.size(); i++) {
+        seal::Ciphertext product = *cts[i];
+        seal::Plaintext pt = pts[i];
+        if (pt.parms_id() != product.parms_id()) {
+            he.evaluator().mod_switch_to_inplace(pt, product.parms_id());
+        }
+        he.evaluator().multiply_plain_inplace(product, pt);
+        if (i == 0) {
+            sum = product;
+        } else {
+            he.evaluator().add_inplace(sum, product);
+        }
+    }
+    return sum;
+}
+
+static void check_case(CKKSPyfhel &he, const std::string &name, const std::vector<const seal::Ciphertext *> &cts,
+                       const std::vector<double> &weights, const std::vector<double> &expected)
+{
+    std::vector<seal::Plaintext> pts;
+    std::vector<ScalarConstant> consts;
+    for (double w : weights) {
+        pts.push_back(he.encode(w));
+        consts.push_back(he.encodeScalar(w));
+    }
+    std::vector<const seal::Plaintext *> pt_ptrs;
+    std::vector<const ScalarConstant *> const_ptrs;
+    for (std::size_t i = 0; i < weights.size(); i++) {
+        pt_ptrs.push_back(&pts[i]);
+        const_ptrs.push_back(&consts[i]);
+    }
+
+    seal::Ciphertext reference = unfused(he, cts, pts);
+
+    seal::Ciphertext fused_plain;
+    he.multiply_plain_accumulate(cts, pt_ptrs, fused_plain);
+    report(name + ": multiply_plain_accumulate matches the evaluator", identical(fused_plain, reference));
+
+    seal::Ciphertext fused_const;
+    he.multiply_const_accumulate(cts, const_ptrs, fused_const);
+    report(name + ": multiply_const_accumulate matches the evaluator", identical(fused_const, reference));
+
+    // A reused (non-empty) destination must be overwritten, not accumulated into
+    he.multiply_const_accumulate(cts, const_ptrs, fused_const);
+    report(name + ": reused destination", identical(fused_const, reference));
+
+    if (!expected.empty()) {
+        double value = 0.0;
+        for (std::size_t i = 0; i < weights.size(); i++) {
+            value += expected[i] * weights[i];
+        }
+        he.evaluator().rescale_to_next_inplace(fused_const);
+        double error = std::fabs(he.decrypt(fused_const) - value);
+        report(name + ": decrypts to " + std::to_string(value) + " (error " + std::to_string(error) + ")", error < 1e-3);
+    }
+}
+
+int main()
+{
+    CKKSPyfhel he(8192, std::pow(2.0, 30), { 50, 30, 30, 50 });
+    he.generate_keys();
+    he.generate_relin_keys();
+
+    std::vector<double> inputs = { 0.5, -1.25, 2.0, 0.0, 3.75, -0.125 };
+    std::vector<double> weights = { 0.3, -0.7, 1.5, 2.0, -0.05, 0.9 };
+
+    // Fresh ciphertexts at the top level
+    std::vector<seal::Ciphertext> top;
+    for (double x : inputs) {
+        top.push_back(he.encrypt(x));
+    }
+    std::vector<const seal::Ciphertext *> top_ptrs;
+    for (const auto &ct : top) {
+        top_ptrs.push_back(&ct);
+    }
+    check_case(he, "top level", top_ptrs, weights, inputs);
+
+    // One level down: the top-level plaintexts/constants are read as a prefix of their limbs
+    std::vector<seal::Ciphertext> lower = top;
+    for (auto &ct : lower) {
+        he.evaluator().mod_switch_to_next_inplace(ct);
+    }
+    std::vector<const seal::Ciphertext *> lower_ptrs;
+    for (const auto &ct : lower) {
+        lower_ptrs.push_back(&ct);
+    }
+    check_case(he, "lower level", lower_ptrs, weights, inputs);
+
+    // Mixed sizes: lazily squared (size 3, not relinearized) next to size-2 ciphertexts at the
+    // same scale, as Square feeds the next layer
+    seal::Ciphertext squared;
+    he.evaluator().square(top[0], squared);
+    seal::Ciphertext scaled = top[1];
+    he.evaluator().multiply_plain_inplace(scaled, he.encode(1.0));
+    std::vector<const seal::Ciphertext *> mixed = { &squared, &scaled };
+    check_case(he, "mixed sizes", mixed, { weights[0], weights[1] }, {});
+
+    return finish("fused kernel");
+}
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "he/he.h"
+#include "convolution/convolution.h"
+#include "functions/square.h"
+#include "pooling/avgPooling.h"
+#include "testCheck.h"
+
+// Checks the rotation-based packed kernels against the one-ciphertext-per-pixel path: a
+// Conv2d -> Square -> AvgPool -> Conv2d chain with padding, strides and two channels per
+// ciphertext decrypts to the same feature maps, and both match a plaintext reference.
+
+using Tensor4 = std::vector<std::vector<std::vector<std::vector<double>>>>;
+
+static Tensor4 zeros(std::size_t n, std::size_t c, std::size_t h, std::size_t w)
+{
+    return Tensor4(n, std::vector<std::vector<std::vector<double>>>(c, std::vector<std::vector<double>>(h, std::vector<double>(w, 0.0))));
+}
+
+static std::size_t output_size(int input, int kernel, int stride, int padding)
+{
+    return static_cast<std::size_t>((input + 2 * padding - kernel) / stride + 1);
+}
+
+// Plaintext sliding window: convolution with weights [filters][channels][kh][kw] (zero padding)
+static Tensor4 conv_reference(const Tensor4 &input, const Tensor4 &weights, std::pair<int, int> stride,
+                              std::pair<int, int> padding, const std::vector<double> &bias)
+{
+    int h = static_cast<int>(input[0][0].size());
+    int w = static_cast<int>(input[0][0][0].size());
+    int kh = static_cast<int>(weights[0][0].size());
+    int kw = static_cast<int>(weights[0][0][0].size());
+    std::size_t oh = output_size(h, kh, stride.first, padding.first);
+    std::size_t ow = output_size(w, kw, stride.second, padding.second);
+    Tensor4 output = zeros(input.size(), weights.size(), oh, ow);
+    for (std::size_t n = 0; n < input.size(); n++) {
+        for (std::size_t f = 0; f < weights.size(); f++) {
+            for (std::size_t y = 0; y < oh; y++) {
+                for (std::size_t x = 0; x < ow; x++) {
+                    double sum = bias.empty() ? 0.0 : bias[f];
+                    for (std::size_t c = 0; c < weights[f].size(); c++) {
+                        for (int fy = 0; fy < kh; fy++) {
+                            for (int fx = 0; fx < kw; fx++) {
+                                int iy = static_cast<int>(y) * stride.first + fy - padding.first;
+                                int ix = static_cast<int>(x) * stride.second + fx - padding.second;
+                                if (iy >= 0 && iy < h && ix >= 0 && ix < w) {
+                                    sum += weights[f][c][fy][fx] * input[n][c][iy][ix];
+                                }
+                            }
+                        }
+                    }
+                    output[n][f][y][x] = sum;
+                }
+            }
+        }
+    }
+    return output;
+}
+
+static Tensor4 square_reference(Tensor4 tensor)
+{
+    for (auto &image : tensor)
+        for (auto &channel : image)
+            for (auto &row : channel)
+                for (double &v : row) v *= v;
+    return tensor;
+}
+
+// Average pooling as a depthwise convolution with every tap 1 / (k * k)
+static Tensor4 pool_reference(const Tensor4 &input, int kernel, int stride)
+{
+    std::size_t channels = input[0].size();
+    Tensor4 taps = zeros(channels, channels, kernel, kernel);
+    for (std::size_t c = 0; c < channels; c++) {
+        for (auto &row : taps[c][c]) {
+            std::fill(row.begin(), row.end(), 1.0 / (kernel * kernel));
+        }
+    }
+    return conv_reference(input, taps, { stride, stride }, { 0, 0 }, {});
+}
+
+static std::vector<double> flatten(const Tensor4 &tensor)
+{
+    std::vector<double> flat;
+    for (const auto &image : tensor)
+        for (const auto &channel : image)
+            for (const auto &row : channel) flat.insert(flat.end(), row.begin(), row.end());
+    return flat;
+}
+
+static double max_error(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if (a.size() != b.size()) {
+        return INFINITY;
+    }
+    double error = 0.0;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        error = std::max(error, std::fabs(a[i] - b[i]));
+    }
+    return error;
+}
+
+static Tensor4 ramp_weights(std::size_t filters, std::size_t channels, std::size_t k, double step)
+{
+    Tensor4 weights = zeros(filters, channels, k, k);
+    std::size_t i = 0;
+    for (auto &filter : weights)
+        for (auto &channel : filter)
+            for (auto &row : channel)
+                for (double &v : row) v = step * (static_cast<double>(i++ % 9) - 4.0);
+    return weights;
+}
+
+int main()
+{
+    CKKSPyfhel he(8192, std::pow(2.0, 30), { 40, 30, 30, 30, 30, 40 });
+    he.generate_keys();
+    he.generate_relin_keys();
+
+    // One image, 4 channels of 8 x 8, packed two channels per ciphertext
+    Tensor4 image = zeros(1, 4, 8, 8);
+    for (std::size_t c = 0; c < 4; c++)
+        for (std::size_t y = 0; y < 8; y++)
+            for (std::size_t x = 0; x < 8; x++)
+                image[0][c][y][x] = 0.1 * static_cast<double>(c) + 0.05 * static_cast<double>(y) - 0.03 * static_cast<double>(x);
+
+    Tensor4 w1 = ramp_weights(4, 4, 3, 0.04);
+    Tensor4 w2 = ramp_weights(2, 4, 3, -0.05);
+    std::vector<double> b1 = { 0.1, -0.1, 0.05, 0.0 };
+    Conv2d conv1(he, w1, { 1, 1 }, { 1, 1 }, b1);      // padding
+    SquareLayer square(he);
+    AvgPoolLayer pool(he, { 2, 2 }, { 2, 2 }, { 0, 0 });
+    Conv2d conv2(he, w2, { 2, 2 }, { 1, 1 });          // stride and padding
+
+    Tensor4 expected_conv1 = conv_reference(image, w1, { 1, 1 }, { 1, 1 }, b1);
+    Tensor4 expected_pool = pool_reference(square_reference(expected_conv1), 2, 2);
+    Tensor4 expected = conv_reference(expected_pool, w2, { 2, 2 }, { 1, 1 }, {});
+
+    // Packed path: rotation keys for every layout the chain goes through
+    PackedTensor packed = he.encryptTensorPacked(image, 2);
+    PackedLayout l1 = conv1.output_layout(packed.layout);
+    PackedLayout l2 = pool.output_layout(l1);
+    std::vector<int> steps = conv1.rotation_steps(packed.layout);
+    for (const std::vector<int> &more : { pool.rotation_steps(l1), conv2.rotation_steps(l2) }) {
+        steps.insert(steps.end(), more.begin(), more.end());
+    }
+    he.generate_rotation_keys(steps);
+
+    PackedTensor packed_conv1 = conv1(packed);
+    report("packed layout keeps two channels per ciphertext",
+           packed_conv1.layout.channels_per_ct == 2 && packed_conv1.data.dim(1) == 2);
+    std::vector<double> packed_first = flatten(he.decryptTensorPacked(packed_conv1));
+    square(packed_conv1);
+    PackedTensor packed_out = conv2(pool(packed_conv1));
+    std::vector<double> packed_result = flatten(he.decryptTensorPacked(packed_out));
+
+    // Scalar path: one ciphertext per pixel
+    CipherTensor scalar_conv1 = conv1(he.encryptTensor(image));
+    std::vector<double> scalar_first = he.decryptTensor(scalar_conv1);
+    square(scalar_conv1);
+    std::vector<double> scalar_result = he.decryptTensor(conv2(pool(scalar_conv1)));
+
+    double padded = max_error(packed_first, scalar_first);
+    report("padded conv: packed matches scalar (error " + std::to_string(padded) + ")", padded < 1e-3);
+    double chain = max_error(packed_result, scalar_result);
+    report("strided chain: packed matches scalar (error " + std::to_string(chain) + ")", chain < 1e-3);
+    double reference = std::max(max_error(packed_result, flatten(expected)), max_error(scalar_first, flatten(expected_conv1)));
+    report("both match the plaintext reference (error " + std::to_string(reference) + ")", reference < 1e-3);
+    report("output shape [1, 2, 2, 2]", packed_out.layout.channels == 2 && packed_out.layout.height == 2 &&
+                                            packed_out.layout.width == 2 && scalar_result.size() == 8);
+
+    return finish("packed kernel");
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "sequential/sequential.h"
+#include "testCheck.h"
+
+// Checks the row-pipelined dataflow mode and eager level dropping of Sequential: every
+// combination decrypts to the plain forward pass on a multi-row, multi-image input, every
+// intermediate reaches the next layer at the depth the remaining layers consume, and an input
+// shared with the caller is left untouched.
+
+using Tensor4 = std::vector<std::vector<std::vector<std::vector<double>>>>;
+
+// Identity row layer that records the depth left on the ciphertexts it reads. It consumes no
+// level, so it joins row pipelines without changing the schedule around it.
+class DepthProbe : public RowLayer {
+public:
+    explicit DepthProbe(const CKKSPyfhel &he) : he_(he) {}
+
+    std::vector<size_t> output_shape(const std::vector<size_t> &input_shape) const override { return input_shape; }
+    std::pair<size_t, size_t> input_rows(size_t out_row, size_t /*in_height*/) const override { return { out_row, out_row + 1 }; }
+    size_t depth() const override { return 0; }
+
+    void forward_row(const CipherTensor &image, CipherTensor &output, size_t out_row) const override
+    {
+        for (size_t c = 0; c < image.dim(0); c++) {
+            for (size_t x = 0; x < image.dim(2); x++) {
+                record(image(c, out_row, x));
+                output(c, out_row, x) = image(c, out_row, x);
+            }
+        }
+    }
+
+    void forward(const CipherTensor &input, CipherTensor &output) const override
+    {
+        for (size_t i = 0; i < input.size(); i++) {
+            record(input[i]);
+            output[i] = input[i];
+        }
+    }
+
+    // Depths seen since construction
+    std::set<size_t> seen() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return seen_;
+    }
+
+private:
+    void record(const seal::Ciphertext &ct) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        seen_.insert(he_.depth_left(ct));
+    }
+
+    const CKKSPyfhel &he_;
+    mutable std::mutex mutex_;
+    mutable std::set<size_t> seen_;
+};
+
+struct Run {
+    std::vector<double> output;
+    size_t output_depth = 0;
+    size_t feature_map_depth = 0;
+    size_t embedding_depth = 0;
+    std::vector<std::set<size_t>> probes;  // Depths read after conv1, square, pool, conv2
+};
+
+static Tensor4 filled(size_t n, size_t c, size_t h, size_t w, double step)
+{
+    Tensor4 tensor(n, std::vector<std::vector<std::vector<double>>>(c, std::vector<std::vector<double>>(h, std::vector<double>(w))));
+    size_t i = 0;
+    for (auto &image : tensor)
+        for (auto &channel : image)
+            for (auto &row : channel)
+                for (double &v : row) v = step * (static_cast<double>(i++ % 11) - 5.0);
+    return tensor;
+}
+
+static std::vector<double> ramp(size_t n, double step)
+{
+    std::vector<double> values(n);
+    for (size_t i = 0; i < n; i++) {
+        values[i] = step * (static_cast<double>(i % 5) - 2.0);
+    }
+    return values;
+}
+
+// [n, 2, 8, 8] -> Conv2d 3x3 pad 1 -> Square -> AvgPool 2x2 -> Conv2d 3x3 -> Flatten -> Linear (8 -> 3),
+// with a probe after each of the first four layers
+static Run run(CKKSPyfhel &he, const CipherTensor &input, bool pipelined, bool drop_levels)
+{
+    std::vector<std::shared_ptr<DepthProbe>> probes;
+    for (int p = 0; p < 4; p++) {
+        probes.push_back(std::make_shared<DepthProbe>(he));
+    }
+    Sequential model(he);
+    model.addLayer(std::make_shared<Conv2d>(he, filled(2, 2, 3, 3, 0.05), std::make_pair(1, 1), std::make_pair(1, 1), std::vector<double>{ 0.1, -0.2 }));
+    model.addLayer(probes[0]);
+    model.addLayer(std::make_shared<SquareLayer>(he));
+    model.addLayer(probes[1]);
+    model.addLayer(std::make_shared<AvgPoolLayer>(he, std::make_pair(2, 2), std::make_pair(2, 2), std::make_pair(0, 0)));
+    model.addLayer(probes[2]);
+    model.addLayer(std::make_shared<Conv2d>(he, filled(2, 2, 3, 3, -0.04)));
+    model.addLayer(probes[3]);
+    model.addLayer(std::make_shared<FlattenLayer>());
+    std::vector<std::vector<double>> weights(3);
+    for (size_t o = 0; o < 3; o++) {
+        weights[o] = ramp(8, 0.1 * static_cast<double>(o + 1));
+    }
+    model.addLayer(std::make_shared<LinearLayer>(he, weights, std::vector<double>{ 0.5, 0.0, -0.5 }));
+    model.setPipelined(pipelined);
+    model.setLevelDropping(drop_levels);
+
+    Run result;
+    CipherTensor output = model(input);
+    result.output = he.decryptTensor(output);
+    result.output_depth = he.depth_left(output[0]);
+    result.feature_map_depth = he.depth_left((*model.getFeatureMap())[0]);
+    result.embedding_depth = he.depth_left((*model.getEmbedding())[0]);
+    for (const auto &probe : probes) {
+        result.probes.push_back(probe->seen());
+    }
+    return result;
+}
+
+static double max_error(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if (a.size() != b.size()) {
+        return INFINITY;
+    }
+    double error = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+        error = std::max(error, std::fabs(a[i] - b[i]));
+    }
+    return error;
+}
+
+int main()
+{
+    // Two levels more than the model consumes, so dropping has something to drop
+    CKKSPyfhel he(16384, std::pow(2.0, 30), { 50, 30, 30, 30, 30, 30, 30, 30, 50 });
+    he.generate_keys();
+    he.generate_relin_keys();
+    const size_t fresh = 7;
+
+    Tensor4 images = filled(2, 2, 8, 8, 0.1);
+    CipherTensor input = he.encryptTensor(images);
+
+    Run plain = run(he, input, false, false);
+    report("plain pass: output shape [2, 3]", plain.output.size() == 6);
+    bool natural = true;
+    for (size_t p = 0; p < 4; p++) {
+        natural = natural && plain.probes[p] == std::set<size_t>{ fresh - 1 - p };
+    }
+    report("plain pass: each layer consumes one level", natural && plain.output_depth == fresh - 5);
+
+    // Depths left by the layers after each probe: Square, AvgPool, Conv2d, Linear
+    std::vector<size_t> scheduled = { 4, 3, 2, 1 };
+    for (bool pipelined : { false, true }) {
+        for (bool drop_levels : { false, true }) {
+            if (!pipelined && !drop_levels) {
+                continue;
+            }
+            std::string mode = std::string(pipelined ? "pipelined" : "sequential") + (drop_levels ? " + dropping" : "");
+            Run r = run(he, input, pipelined, drop_levels);
+            double error = max_error(r.output, plain.output);
+            report(mode + ": same outputs as the plain pass (error " + std::to_string(error) + ")", error < 1e-3);
+            if (!drop_levels) {
+                report(mode + ": same levels as the plain pass", r.probes == plain.probes && r.output_depth == plain.output_depth);
+                continue;
+            }
+            bool on_schedule = true;
+            for (size_t p = 0; p < 4; p++) {
+                on_schedule = on_schedule && r.probes[p] == std::set<size_t>{ scheduled[p] };
+            }
+            report(mode + ": every intermediate at its scheduled depth", on_schedule);
+            report(mode + ": output at the last level", r.output_depth == 0);
+            report(mode + ": feature map and embedding keep one level for Linear",
+                   r.feature_map_depth == 1 && r.embedding_depth == 1);
+        }
+    }
+
+    // The runs above shared the caller's input: it keeps its values and levels
+    std::vector<double> values = he.decryptTensor(input);
+    std::vector<double> original;
+    for (const auto &image : images)
+        for (const auto &channel : image)
+            for (const auto &row : channel) original.insert(original.end(), row.begin(), row.end());
+    report("shared input left untouched", max_error(values, original) < 1e-3 && he.depth_left(input[0]) == fresh);
+
+    return finish("pipeline");
+}
@@ -0,0 +1,189 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "functions/square.h"
+#include "plan/modelPlan.h"
+#include "sequential/sequential.h"
+#include "testCheck.h"
+
+// Checks ModelPlan: a compiled plan saved and loaded back has the same parameters, schedule and
+// encoded weights and computes the same outputs, and malformed plan files are rejected.
+
+static const std::string plan_path = "/tmp/testplan.heplan";
+
+static std::string read_file(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string &path, const std::string &bytes)
+{
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+// True if ModelPlan::load rejects the file with a runtime_error
+static bool rejected(const std::string &bytes)
+{
+    write_file(plan_path, bytes);
+    try {
+        ModelPlan::load(plan_path);
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+static std::vector<double> ramp(std::size_t n, double step, double offset)
+{
+    std::vector<double> values(n);
+    for (std::size_t i = 0; i < n; i++) {
+        values[i] = offset + step * static_cast<double>(i % 7) - step * static_cast<double>(i % 3);
+    }
+    return values;
+}
+
+static bool same_layers(const ModelPlan &a, const ModelPlan &b)
+{
+    if (a.layers().size() != b.layers().size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.layers().size(); i++) {
+        const PlanLayer &x = a.layers()[i];
+        const PlanLayer &y = b.layers()[i];
+        bool same = x.kind == y.kind && x.kernel == y.kernel && x.stride == y.stride && x.padding == y.padding &&
+                    x.weight_shape == y.weight_shape && x.weights == y.weights && x.bias == y.bias &&
+                    x.depth_in == y.depth_in && x.scale_in == y.scale_in && x.encoded.size() == y.encoded.size();
+        for (std::size_t w = 0; same && w < x.encoded.size(); w++) {
+            same = x.encoded[w].residues == y.encoded[w].residues && x.encoded[w].scale == y.encoded[w].scale;
+        }
+        if (!same) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<double> run(CKKSPyfhel &he, const ModelPlan &plan, const CipherTensor &input)
+{
+    Sequential model(he);
+    for (const auto &layer : plan.build(he)) {
+        model.addLayer(layer);
+    }
+    model.setLevelDropping(true);
+    return he.decryptTensor(model(input.clone()));
+}
+
+int main()
+{
+    // [1, 1, 6, 6] -> Conv2d 3x3 (2 filters, padding 1) -> Square -> AvgPool 2x2 -> Flatten -> Linear (18 -> 3)
+    ModelPlan plan(8192, std::pow(2.0, 30), { 40, 30, 30, 30, 30, 40 }, { 1, 1, 6, 6 });
+    PlanLayer conv;
+    conv.kind = PlanLayerKind::Conv2d;
+    conv.padding = { 1, 1 };
+    conv.weight_shape = { 2, 1, 3, 3 };
+    conv.weights = ramp(18, 0.05, -0.1);
+    conv.bias = { 0.1, -0.2 };
+    plan.add_layer(conv);
+    PlanLayer square;
+    square.kind = PlanLayerKind::Square;
+    plan.add_layer(square);
+    PlanLayer pool;
+    pool.kind = PlanLayerKind::AvgPool;
+    pool.kernel = { 2, 2 };
+    pool.stride = { 2, 2 };
+    plan.add_layer(pool);
+    PlanLayer flatten;
+    flatten.kind = PlanLayerKind::Flatten;
+    plan.add_layer(flatten);
+    PlanLayer linear;
+    linear.kind = PlanLayerKind::Linear;
+    linear.weight_shape = { 3, 18 };
+    linear.weights = ramp(54, 0.1, 0.05);
+    linear.bias = { 0.5, 0.0, -0.5 };
+    plan.add_layer(linear);
+
+    CKKSPyfhel he(plan.poly_modulus_degree(), plan.scale(), plan.bit_sizes());
+    he.generate_keys();
+    he.generate_relin_keys();
+    plan.compile(he);
+    report("schedule: the model consumes four levels", plan.depth() == 4 && plan.layers().back().depth_in == 1);
+
+    // Round trip
+    plan.save(plan_path);
+    ModelPlan loaded = ModelPlan::load(plan_path);
+    report("parameters survive the round trip",
+           loaded.poly_modulus_degree() == plan.poly_modulus_degree() && loaded.scale() == plan.scale() &&
+               loaded.bit_sizes() == plan.bit_sizes() && loaded.input_shape() == plan.input_shape() &&
+               loaded.output_scale() == plan.output_scale());
+    report("layers, schedule and residues survive the round trip", same_layers(plan, loaded));
+
+    std::vector<std::vector<std::vector<std::vector<double>>>> image(
+        1, std::vector<std::vector<std::vector<double>>>(1, std::vector<std::vector<double>>(6, std::vector<double>(6))));
+    for (std::size_t y = 0; y < 6; y++) {
+        for (std::size_t x = 0; x < 6; x++) {
+            image[0][0][y][x] = 0.1 * static_cast<double>(y) - 0.05 * static_cast<double>(x);
+        }
+    }
+    CipherTensor input = he.encryptTensor(image);
+    std::vector<double> compiled_out = run(he, plan, input);
+    std::vector<double> loaded_out = run(he, loaded, input);
+    bool same_outputs = compiled_out.size() == 3 && loaded_out == compiled_out;
+    report("loaded plan computes the compiled plan's outputs", same_outputs);
+
+    // A context with another coefficient modulus cannot use the encoded weights
+    CKKSPyfhel other(8192, std::pow(2.0, 30), { 40, 30, 30, 30, 31, 40 });
+    bool wrong_modulus = false;
+    try {
+        loaded.build(other);
+    } catch (const std::invalid_argument &) {
+        wrong_modulus = true;
+    }
+    report("build rejects another coefficient modulus", wrong_modulus);
+
+    // Two squares in a row: only the one feeding Linear may stay unrelinearized, or the second
+    // would square a size-3 ciphertext into size 5
+    ModelPlan squares(8192, std::pow(2.0, 30), { 40, 30, 30, 30, 30, 40 }, { 1, 1, 2, 2 });
+    squares.add_layer(square);
+    squares.add_layer(square);
+    squares.add_layer(flatten);
+    PlanLayer sum;
+    sum.kind = PlanLayerKind::Linear;
+    sum.weight_shape = { 1, 4 };
+    sum.weights = { 1.0, 1.0, 1.0, 1.0 };
+    squares.add_layer(sum);
+    squares.compile(he);
+    std::vector<std::shared_ptr<const Layer>> built = squares.build(he);
+    auto first = std::dynamic_pointer_cast<const SquareLayer>(built[0]);
+    auto second = std::dynamic_pointer_cast<const SquareLayer>(built[1]);
+    report("square feeding a square is relinearized, square feeding Linear is lazy",
+           first && second && !first->lazy_relinearize() && second->lazy_relinearize());
+    std::vector<std::vector<std::vector<std::vector<double>>>> pixels = { { { { 0.5, -1.0 }, { 1.5, 0.25 } } } };
+    double fourth_powers = std::pow(0.5, 4) + 1.0 + std::pow(1.5, 4) + std::pow(0.25, 4);
+    std::vector<double> squared = run(he, squares, he.encryptTensor(pixels));
+    report("x^4 summed through two squares", squared.size() == 1 && std::fabs(squared[0] - fourth_powers) < 1e-3);
+
+    // Malformed files
+    std::string bytes = read_file(plan_path);
+    report("trailing data is rejected", rejected(bytes + std::string(8, '\0')));
+    report("truncated file is rejected", rejected(bytes.substr(0, bytes.size() - 1)));
+    report("truncated header is rejected", rejected(bytes.substr(0, 10)));
+    std::string bad_magic = bytes;
+    bad_magic[0] = 'X';
+    report("bad magic is rejected", rejected(bad_magic));
+
+    // Residues must match the weights: a plan saved without compile() has none
+    ModelPlan uncompiled(8192, std::pow(2.0, 30), { 40, 30, 30, 30, 30, 40 }, { 1, 18 });
+    uncompiled.add_layer(linear);
+    uncompiled.save(plan_path);
+    report("residues that do not match the weights are rejected", rejected(read_file(plan_path)));
+
+    std::remove(plan_path.c_str());
+    return finish("model plan");
+}
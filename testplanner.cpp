@@ -0,0 +1,125 @@
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "plan/modelPlan.h"
+#include "plan/parameterPlanner.h"
+#include "testCheck.h"
+
+// Checks plan_ckks_parameters: the chain has one scale-sized prime per rescale, the degree is the
+// smallest that fits, targets it cannot meet are rejected, and the planned parameters evaluate a
+// model of that depth.
+
+static int total_bits(const CkksParameters &parameters)
+{
+    return std::accumulate(parameters.bit_sizes.begin(), parameters.bit_sizes.end(), 0);
+}
+
+template <typename Exception>
+static bool throws(const ModelDepth &depth, const PrecisionTarget &target)
+{
+    try {
+        plan_ckks_parameters(depth, target);
+    } catch (const Exception &) {
+        return true;
+    }
+    return false;
+}
+
+int main()
+{
+    PrecisionTarget target;
+
+    // Chain shape: output prime, one scale prime per rescale, special prime
+    ModelDepth depth;
+    depth.products = 2;
+    depth.squarings = 1;
+    depth.pool_scalings = 1;
+    CkksParameters parameters = plan_ckks_parameters(depth, target);
+    int output_bits = target.scale_bits + target.integer_bits;
+    int s = target.scale_bits;
+    std::vector<int> expected_bits = { output_bits, s, s, s, s, output_bits };
+    report("chain: output prime, one prime per rescale, special prime", parameters.bit_sizes == expected_bits);
+    report("scale is 2^scale_bits", parameters.scale == std::ldexp(1.0, target.scale_bits));
+
+    // Smallest degree: the chain fits it, and not the next smaller one the planner considers
+    bool smallest = true;
+    for (std::size_t rescales : { 0, 1, 3, 6, 10, 20 }) {
+        ModelDepth d;
+        d.products = rescales;
+        CkksParameters p = plan_ckks_parameters(d, target);
+        std::size_t n = p.poly_modulus_degree;
+        bool fits = total_bits(p) <= seal::CoeffModulus::MaxBitCount(n, target.security);
+        bool minimal = n == target.min_degree || total_bits(p) > seal::CoeffModulus::MaxBitCount(n / 2, target.security);
+        smallest = smallest && fits && minimal;
+    }
+    report("degree is the smallest that fits the chain", smallest);
+
+    // A 50-bit chain would fit N = 2048, whose single small prime leaves no useful precision
+    PrecisionTarget small = target;
+    small.scale_bits = 20;
+    small.integer_bits = 5;
+    report("the search starts at 4096", plan_ckks_parameters(ModelDepth{}, small).poly_modulus_degree == 4096);
+
+    PrecisionTarget large = target;
+    large.min_degree = 16384;
+    report("min_degree raises the degree", plan_ckks_parameters(ModelDepth{}, large).poly_modulus_degree == 16384);
+
+    PrecisionTarget wide = target;
+    wide.min_slots = 8192;
+    report("min_slots raises the degree", plan_ckks_parameters(ModelDepth{}, wide).poly_modulus_degree == 16384);
+
+    // Targets no parameter set meets
+    ModelDepth too_deep;
+    too_deep.products = 40;
+    report("too deep for 32768 is rejected", throws<std::runtime_error>(too_deep, target));
+    PrecisionTarget coarse = target;
+    coarse.scale_bits = 16;
+    report("scale below 2^20 is rejected", throws<std::invalid_argument>(depth, coarse));
+    PrecisionTarget wide_output = target;
+    wide_output.integer_bits = 40;
+    report("output prime above 60 bits is rejected", throws<std::invalid_argument>(depth, wide_output));
+    PrecisionTarget odd_degree = target;
+    odd_degree.min_degree = 3000;
+    report("min_degree that is not a power of two is rejected", throws<std::invalid_argument>(depth, odd_degree));
+
+    // Depth of a plan's layers, by kind of rescale
+    std::vector<PlanLayer> layers(6);
+    layers[0].kind = PlanLayerKind::Conv2d;
+    layers[1].kind = PlanLayerKind::Square;
+    layers[2].kind = PlanLayerKind::AvgPool;
+    layers[3].kind = PlanLayerKind::Flatten;
+    layers[4].kind = PlanLayerKind::Linear;
+    layers[5].kind = PlanLayerKind::AdaptiveAvgPool;
+    ModelDepth counted = count_depth(layers);
+    report("count_depth classifies the rescales",
+           counted.products == 2 && counted.squarings == 1 && counted.pool_scalings == 2 && counted.rescales() == 5);
+
+    // The planned parameters evaluate that many rescales
+    CKKSPyfhel he(parameters.poly_modulus_degree, parameters.scale, parameters.bit_sizes);
+    he.generate_keys();
+    he.generate_relin_keys();
+    ScalarConstant weight = he.encodeScalar(0.75);
+    seal::Ciphertext ct = he.encrypt(1.5);
+    double expected = 1.5;
+    for (std::size_t r = 0; r < depth.rescales(); r++) {
+        if (r == 1) {
+            he.evaluator().square_inplace(ct);
+            he.relinearize_inplace(ct);
+            expected *= expected;
+        } else {
+            seal::Ciphertext product;
+            he.multiply_const_accumulate({ &ct }, { &weight }, product);
+            ct = std::move(product);
+            expected *= 0.75;
+        }
+        he.evaluator().rescale_to_next_inplace(ct);
+    }
+    double error = std::fabs(he.decrypt(ct) - expected);
+    report("planned parameters evaluate the depth (error " + std::to_string(error) + ")",
+           he.depth_left(ct) == 0 && error < 1e-3);
+
+    return finish("parameter planner");
+}
@@ -0,0 +1,164 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "runtime/taskScheduler.h"
+#include "testCheck.h"
+
+// Checks the work-stealing TaskScheduler: every index of a (chunked, nested) parallel_for runs
+// exactly once, exceptions reach the waiter, and a TaskGroup's waiter only runs its own tasks.
+
+// Runs check on its own thread; a deadlock fails the driver instead of hanging ctest
+static void within_deadline(const std::string &name, const std::function<bool()> &check)
+{
+    std::packaged_task<bool()> task(check);
+    std::future<bool> result = task.get_future();
+    std::thread(std::move(task)).detach();
+    if (result.wait_for(std::chrono::seconds(60)) != std::future_status::ready) {
+        report(name + " (deadlocked)", false);
+        std::_Exit(finish("scheduler"));
+    }
+    report(name, result.get());
+}
+
+static bool each_index_once(TaskScheduler &scheduler, std::size_t n)
+{
+    std::vector<std::atomic<int>> visits(n);
+    for (auto &v : visits) {
+        v.store(0);
+    }
+    scheduler.parallel_for(n, [&](std::size_t i) { visits[i]++; });
+    for (auto &v : visits) {
+        if (v.load() != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    TaskScheduler scheduler(4);
+    std::size_t chunks = scheduler.n_threads() * TaskScheduler::chunks_per_thread;
+
+    // Chunked ranges: smaller than, equal to and larger than the number of chunks
+    bool once = true;
+    for (std::size_t n : { std::size_t{ 0 }, std::size_t{ 1 }, std::size_t{ 2 }, chunks - 1, chunks, chunks + 1, std::size_t{ 1000 } }) {
+        once = once && each_index_once(scheduler, n);
+    }
+    report("parallel_for runs every index exactly once", once);
+
+    std::vector<std::atomic<int>> cells(7 * 13);
+    for (auto &c : cells) {
+        c.store(0);
+    }
+    scheduler.parallel_for(7, 13, [&](std::size_t i, std::size_t j) { cells[i * 13 + j] += static_cast<int>(i * 13 + j + 1); });
+    bool grid = true;
+    for (std::size_t k = 0; k < cells.size(); k++) {
+        grid = grid && cells[k].load() == static_cast<int>(k + 1);
+    }
+    report("2-D parallel_for covers the grid once", grid);
+
+    // Nested parallel_for inside tasks, three deep, as layers call each other's kernels
+    within_deadline("nested parallel_for", [&] {
+        for (int rep = 0; rep < 20; rep++) {
+            std::atomic<long> sum{ 0 };
+            scheduler.parallel_for(40, [&](std::size_t i) {
+                scheduler.parallel_for(9, 5, [&](std::size_t j, std::size_t k) {
+                    scheduler.parallel_for(3, [&](std::size_t l) { sum += static_cast<long>(i * j + k + l); });
+                });
+            });
+            long expected = 0;
+            for (long i = 0; i < 40; i++)
+                for (long j = 0; j < 9; j++)
+                    for (long k = 0; k < 5; k++)
+                        for (long l = 0; l < 3; l++) expected += i * j + k + l;
+            if (sum != expected) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    // A group whose tasks spawn more tasks into it (as the row pipeline does)
+    within_deadline("self-spawning group", [&] {
+        TaskGroup group(scheduler);
+        std::atomic<int> count{ 0 };
+        std::function<void(int)> grow = [&](int d) {
+            count++;
+            if (d < 10) {
+                group.spawn([&, d] { grow(d + 1); });
+                group.spawn([&, d] { grow(d + 1); });
+            }
+        };
+        group.spawn([&] { grow(0); });
+        group.wait();
+        return count == (1 << 11) - 1;
+    });
+
+    // The first exception reaches the waiter; the other tasks still run
+    std::atomic<int> ran{ 0 };
+    bool thrown = false;
+    try {
+        TaskGroup group(scheduler);
+        for (int t = 0; t < 100; t++) {
+            group.spawn([&, t] {
+                ran++;
+                if (t % 10 == 7) {
+                    throw std::runtime_error("task failed");
+                }
+            });
+        }
+        group.wait();
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    report("exception rethrown by wait, other tasks run", thrown && ran == 100);
+
+    // Two groups waited on by two threads never run each other's tasks. Group b holds a task that
+    // blocks until a has finished: if a's waiter ran it, a would never finish.
+    within_deadline("waiters run only their own group", [&] {
+        std::promise<void> a_done;
+        std::shared_future<void> a_finished = a_done.get_future().share();
+        std::mutex mutex;
+        std::set<std::thread::id> a_threads, b_threads;
+        std::thread::id a_waiter, b_waiter;
+
+        std::thread b_thread([&] {
+            b_waiter = std::this_thread::get_id();
+            TaskGroup b(scheduler);
+            b.spawn([&] { a_finished.wait(); });
+            for (int t = 0; t < 200; t++) {
+                b.spawn([&] {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    b_threads.insert(std::this_thread::get_id());
+                });
+            }
+            b.wait();
+        });
+        std::thread a_thread([&] {
+            a_waiter = std::this_thread::get_id();
+            TaskGroup a(scheduler);
+            for (int t = 0; t < 200; t++) {
+                a.spawn([&] {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    std::lock_guard<std::mutex> lock(mutex);
+                    a_threads.insert(std::this_thread::get_id());
+                });
+            }
+            a.wait();
+            a_done.set_value();
+        });
+        a_thread.join();
+        b_thread.join();
+        return a_threads.count(b_waiter) == 0 && b_threads.count(a_waiter) == 0;
+    });
+
+    return finish("scheduler");
+}
@@ -0,0 +1,125 @@
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "runtime/memoryBudget.h"
+#include "runtime/spillFile.h"
+#include "tensor/cipherTensor.h"
+#include "testCheck.h"
+
+// Checks that data written to a SpillFile reads back unchanged (across growth and extent reuse),
+// and that MemoryBudget spills ciphertexts and pages them back in intact.
+
+// Deterministic byte pattern per extent
+static void fill(std::byte *data, std::size_t size, unsigned seed)
+{
+    for (std::size_t i = 0; i < size; i++) {
+        data[i] = static_cast<std::byte>((i * 131 + seed * 7) & 0xff);
+    }
+}
+
+static bool matches(const std::byte *data, std::size_t size, unsigned seed)
+{
+    for (std::size_t i = 0; i < size; i++) {
+        if (data[i] != static_cast<std::byte>((i * 131 + seed * 7) & 0xff)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_spill_file()
+{
+    SpillFile file("/tmp");
+
+    // Enough extents that the file grows (and is remapped) several times while they are live
+    std::vector<SpillFile::Extent> extents;
+    std::vector<std::size_t> sizes;
+    for (unsigned k = 0; k < 64; k++) {
+        std::size_t size = 1000 + k * 4099;
+        extents.push_back(file.allocate(size));
+        sizes.push_back(size);
+    }
+    for (unsigned k = 0; k < extents.size(); k++) {
+        fill(file.data(extents[k]), sizes[k], k);
+    }
+    bool intact = true;
+    for (unsigned k = 0; k < extents.size(); k++) {
+        intact = intact && matches(file.data(extents[k]), sizes[k], k);
+    }
+    report("spill file: extents read back after growth", intact);
+
+    // Free every other extent and reuse the space; the remaining extents must be untouched
+    for (unsigned k = 0; k < extents.size(); k += 2) {
+        file.free(extents[k]);
+    }
+    std::vector<SpillFile::Extent> reused;
+    for (unsigned k = 0; k < extents.size(); k += 2) {
+        reused.push_back(file.allocate(sizes[k] / 2));
+        fill(file.data(reused.back()), sizes[k] / 2, 1000 + k);
+    }
+    intact = true;
+    for (unsigned k = 1; k < extents.size(); k += 2) {
+        intact = intact && matches(file.data(extents[k]), sizes[k], k);
+    }
+    for (unsigned k = 0, r = 0; k < extents.size(); k += 2, r++) {
+        intact = intact && matches(file.data(reused[r]), sizes[k] / 2, 1000 + k);
+    }
+    report("spill file: reused extents do not overlap live ones", intact);
+
+    for (const auto &extent : reused) {
+        file.free(extent);
+    }
+    for (unsigned k = 1; k < extents.size(); k += 2) {
+        file.free(extents[k]);
+    }
+    report("spill file: everything freed", file.used() == 0);
+}
+
+static void check_memory_budget()
+{
+    CKKSPyfhel he(8192, std::pow(2.0, 30), { 50, 30, 50 });
+    he.generate_keys();
+
+    // [n_images, channels, height, width]: one block per (image, channel) plane
+    CipherTensor tensor({ 2, 2, 2, 3 });
+    for (std::size_t i = 0; i < tensor.size(); i++) {
+        tensor[i] = he.encrypt(0.25 * static_cast<double>(i) - 1.0);
+    }
+    seal::Ciphertext original = tensor[5];
+
+    // A budget of zero bytes spills every block
+    MemoryBudget budget(he, 0, "/tmp");
+    budget.track(tensor);
+    std::size_t resident = budget.resident_bytes();
+    budget.enforce();
+    report("budget: every block spilled", budget.resident_bytes() == 0 && budget.spills() == 4 && budget.spilled_bytes() >= resident);
+
+    // Page one image back in, then everything
+    budget.use(tensor, 1);
+    report("budget: one image paged in", budget.resident_bytes() == resident / 2);
+    budget.use_all(tensor);
+    report("budget: all paged in", budget.resident_bytes() == resident && budget.spilled_bytes() == 0);
+
+    bool values = true;
+    for (std::size_t i = 0; i < tensor.size(); i++) {
+        values = values && std::fabs(he.decrypt(tensor[i]) - (0.25 * static_cast<double>(i) - 1.0)) < 1e-3;
+    }
+    report("budget: paged-in ciphertexts decrypt to their values", values);
+
+    std::size_t words = original.size() * original.poly_modulus_degree() * original.coeff_modulus_size();
+    report("budget: paged-in ciphertext is bit-identical",
+           tensor[5].parms_id() == original.parms_id() && tensor[5].scale() == original.scale() &&
+               std::memcmp(tensor[5].data(), original.data(), words * sizeof(std::uint64_t)) == 0);
+
+    budget.untrack(tensor);
+}
+
+int main()
+{
+    check_spill_file();
+    check_memory_budget();
+
+    return finish("spill");
+}
@@ -0,0 +1,107 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "testCheck.h"
+
+// Checks the seeded upload path: encryptTensorSymmetric on the client, loadTensor on a server that
+// has the parameters but no keys, and that malformed or truncated uploads are rejected.
+
+// True if loadTensor rejects the upload with std::invalid_argument
+static bool rejected(const CKKSPyfhel &server, const std::string &upload)
+{
+    try {
+        server.loadTensor(upload);
+    } catch (const std::invalid_argument &) {
+        return true;
+    } catch (const std::exception &e) {
+        std::cout << "       unexpected exception: " << e.what() << std::endl;
+        return false;
+    }
+    return false;
+}
+
+static std::string header(const std::vector<std::uint64_t> &words)
+{
+    return std::string(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(std::uint64_t));
+}
+
+int main()
+{
+    const std::vector<int> bit_sizes = { 50, 30, 50 };
+    CKKSPyfhel client(8192, std::pow(2.0, 30), bit_sizes);
+    client.generate_keys();
+    CKKSPyfhel server(8192, std::pow(2.0, 30), bit_sizes);  // Same parameters, its own (unused) keys
+
+    // [1, 2, 3, 3]
+    std::vector<std::vector<std::vector<std::vector<double>>>> image(
+        1, std::vector<std::vector<std::vector<double>>>(2, std::vector<std::vector<double>>(3, std::vector<double>(3))));
+    std::vector<double> expected;
+    for (std::size_t c = 0; c < 2; c++) {
+        for (std::size_t y = 0; y < 3; y++) {
+            for (std::size_t x = 0; x < 3; x++) {
+                image[0][c][y][x] = 0.1 * static_cast<double>(c * 9 + y * 3 + x) - 0.5;
+                expected.push_back(image[0][c][y][x]);
+            }
+        }
+    }
+
+    // Round trip
+    std::string upload = client.encryptTensorSymmetric(image);
+    CipherTensor loaded = server.loadTensor(upload);
+    report("shape survives the round trip", loaded.shape() == std::vector<std::size_t>{ 1, 2, 3, 3 });
+    std::vector<double> decrypted = client.decryptTensor(loaded);
+    bool values = decrypted.size() == expected.size();
+    for (std::size_t i = 0; values && i < expected.size(); i++) {
+        values = std::fabs(decrypted[i] - expected[i]) < 1e-3;
+    }
+    report("loaded ciphertexts decrypt to the image", values);
+
+    // Seeded ciphertexts carry a seed instead of their second polynomial
+    std::size_t full = 0;
+    for (const auto &ct : loaded) {
+        full += ct.save_size();
+    }
+    std::cout << "       upload " << upload.size() << " bytes, expanded " << full << " bytes" << std::endl;
+    report("upload is about half the expanded size", upload.size() < full * 6 / 10);
+
+    // Truncated uploads: inside the header, inside the size table, inside the ciphertexts
+    std::size_t table_end = (1 + 4 + loaded.size()) * sizeof(std::uint64_t);
+    for (std::size_t length : { std::size_t{ 0 }, std::size_t{ 7 }, std::size_t{ 8 }, std::size_t{ 40 }, table_end - 1,
+                                table_end, table_end + 100, upload.size() - 1 }) {
+        report("truncated to " + std::to_string(length) + " bytes is rejected", rejected(server, upload.substr(0, length)));
+    }
+    report("trailing bytes are rejected", rejected(server, upload + "x"));
+
+    // Malformed headers are rejected before anything is allocated
+    std::string bad_rank = upload;
+    std::uint64_t rank = 3;
+    std::memcpy(&bad_rank[0], &rank, sizeof(rank));
+    report("rank other than 4 is rejected", rejected(server, bad_rank));
+    report("huge rank is rejected", rejected(server, header({ std::uint64_t{ 1 } << 62 })));
+    report("overflowing shape is rejected",
+           rejected(server, header({ 4, std::uint64_t{ 1 } << 40, std::uint64_t{ 1 } << 40, 1, 1 })));
+    report("shape larger than the upload is rejected",
+           rejected(server, header({ 4, std::uint64_t{ 1 } << 20, std::uint64_t{ 1 } << 20, 1, 1 })));
+    report("ciphertext size past the end is rejected",
+           rejected(server, header({ 4, 1, 1, 1, 1, std::uint64_t{ 1 } << 63 })));
+
+    // A consistent header over corrupted ciphertext bytes is still rejected (by SEAL's load)
+    std::string corrupted = upload;
+    for (std::size_t i = table_end; i < table_end + 16 && i < corrupted.size(); i++) {
+        corrupted[i] = static_cast<char>(~corrupted[i]);
+    }
+    bool corrupt_rejected = false;
+    try {
+        server.loadTensor(corrupted);
+    } catch (const std::exception &) {
+        corrupt_rejected = true;
+    }
+    report("corrupted ciphertext is rejected", corrupt_rejected);
+
+    return finish("upload");
+}
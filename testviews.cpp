@@ -0,0 +1,67 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include "he/he.h"
+#include "tensor/cipherTensor.h"
+#include "testCheck.h"
+
+// Checks that CipherTensor slices and reshapes alias their tensor's store (no copies) and that
+// clone() does not.
+
+int main()
+{
+    CKKSPyfhel he(8192, std::pow(2.0, 30), { 50, 30, 50 });
+    he.generate_keys();
+
+    CipherTensor tensor({ 2, 3, 4, 5 });
+    report("fresh tensor is not shared", !tensor.is_shared());
+
+    // Slices address the same ciphertexts as the multi-index into the tensor
+    CipherTensor image = tensor.slice(1);
+    CipherTensor channel = image.slice(2);
+    report("slice shapes", image.shape() == std::vector<size_t>{ 3, 4, 5 } && channel.shape() == std::vector<size_t>{ 4, 5 });
+    report("tensor is shared once sliced", tensor.is_shared());
+    bool same_elements = true;
+    for (size_t y = 0; y < 4; y++) {
+        for (size_t x = 0; x < 5; x++) {
+            same_elements = same_elements && &channel(y, x) == &tensor(1, 2, y, x);
+        }
+    }
+    report("slice elements alias the tensor", same_elements);
+    report("flat index of a slice", &channel[7] == &tensor(1, 2, 1, 2));
+
+    // A write through a view is seen by the tensor
+    channel(3, 4) = he.encrypt(5.0);
+    report("write through a slice", std::fabs(he.decrypt(tensor(1, 2, 3, 4)) - 5.0) < 1e-3);
+
+    // Reshape is a view of the same store too
+    CipherTensor flat = tensor.reshape({ 2, 60 });
+    report("reshape aliases", &flat(1, 2 * 20 + 3 * 5 + 4) == &tensor(1, 2, 3, 4));
+    flat(0, 0) = he.encrypt(-2.5);
+    report("write through a reshape", std::fabs(he.decrypt(tensor(0, 0, 0, 0)) + 2.5) < 1e-3);
+
+    bool rejected = false;
+    try {
+        tensor.reshape({ 7, 7 });
+    } catch (const std::exception &) {
+        rejected = true;
+    }
+    report("reshape to another element count is rejected", rejected);
+
+    // clone() is a deep copy: writes to it stay there
+    CipherTensor copy = tensor.clone();
+    report("clone has its own store", &copy(1, 2, 3, 4) != &tensor(1, 2, 3, 4) && !copy.is_shared());
+    copy(1, 2, 3, 4) = he.encrypt(9.0);
+    report("clone keeps the values", std::fabs(he.decrypt(copy(0, 0, 0, 0)) + 2.5) < 1e-3);
+    report("write to a clone is not seen by the tensor", std::fabs(he.decrypt(tensor(1, 2, 3, 4)) - 5.0) < 1e-3);
+
+    // Views keep the store alive after the tensor is gone
+    CipherTensor survivor = tensor.slice(1).slice(2);
+    tensor = CipherTensor();
+    image = CipherTensor();
+    channel = CipherTensor();
+    flat = CipherTensor();
+    report("view outlives its tensor", std::fabs(he.decrypt(survivor(3, 4)) - 5.0) < 1e-3 && !survivor.is_shared());
+
+    return finish("tensor view");
+}
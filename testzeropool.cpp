@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "he/he.h"
+#include "runtime/zeroEncryptionPool.h"
+#include "testCheck.h"
+
+// Checks the pool of encryptions of zero: the stock never exceeds its capacity (background filler
+// and concurrent fill() calls included), every ciphertext is handed out once, and encryptions
+// made from the pool decrypt to their values.
+
+// Wait (up to a few seconds) for the background filler to reach the stock level
+static bool wait_for_stock(const ZeroEncryptionPool &pool, std::size_t level)
+{
+    for (int i = 0; i < 500 && pool.stats().available < level; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return pool.stats().available == level;
+}
+
+static bool same_data(const seal::Ciphertext &a, const seal::Ciphertext &b)
+{
+    std::size_t words = a.size() * a.poly_modulus_degree() * a.coeff_modulus_size();
+    return a.size() == b.size() && std::equal(a.data(), a.data() + words, b.data());
+}
+
+int main()
+{
+    CKKSPyfhel he(8192, std::pow(2.0, 30), { 50, 30, 50 });
+    he.generate_keys();
+    seal::KeyGenerator keygen(he.context());
+    seal::PublicKey public_key;
+    keygen.create_public_key(public_key);
+
+    // Background filler alone: it stops at capacity
+    {
+        ZeroEncryptionPool pool(he.context(), public_key, 8, true);
+        bool full = wait_for_stock(pool, 8);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ZeroPoolStats stats = pool.stats();
+        report("background filler fills to capacity", full);
+        report("background filler stops at capacity", stats.available == 8 && stats.produced == 8);
+    }
+
+    // Concurrent fill() calls, with and without the filler: slots are reserved before encrypting,
+    // so together they never stock more than capacity
+    for (bool background : { false, true }) {
+        ZeroEncryptionPool pool(he.context(), public_key, 6, background);
+        std::vector<std::thread> fillers;
+        for (int t = 0; t < 4; t++) {
+            fillers.emplace_back([&pool] { pool.fill(); });
+        }
+        for (auto &filler : fillers) {
+            filler.join();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ZeroPoolStats stats = pool.stats();
+        report(std::string("concurrent fill()") + (background ? " with the filler" : "") + " stays within capacity",
+               stats.available == 6 && stats.produced == 6);
+    }
+
+    // Taking refills in the background, and each ciphertext is handed out once
+    {
+        ZeroEncryptionPool pool(he.context(), public_key, 4, true);
+        wait_for_stock(pool, 4);
+        std::vector<seal::Ciphertext> taken;
+        for (int i = 0; i < 3; i++) {
+            taken.push_back(pool.take());
+        }
+        bool distinct = !same_data(taken[0], taken[1]) && !same_data(taken[1], taken[2]) && !same_data(taken[0], taken[2]);
+        report("taken encryptions of zero are distinct", distinct);
+        bool refilled = wait_for_stock(pool, 4);
+        ZeroPoolStats stats = pool.stats();
+        report("taken ciphertexts are replaced", refilled && stats.served == 3 && stats.produced == 7 && stats.misses == 0);
+    }
+
+    // An empty stock without a filler encrypts inline and counts a miss
+    {
+        ZeroEncryptionPool pool(he.context(), public_key, 2, false);
+        seal::Ciphertext zero = pool.take();
+        ZeroPoolStats stats = pool.stats();
+        report("empty stock: take() encrypts inline", zero.size() == 2 && stats.misses == 1 && stats.available == 0);
+    }
+
+    // Encryptions made from the pool decrypt to their values
+    he.start_encryption_pool(4, false);
+    he.fill_encryption_pool();
+    bool values = true;
+    for (double v : { 1.5, -2.25, 0.0, 100.125, -0.001, 7.0 }) {
+        values = values && std::fabs(he.decrypt(he.encrypt(v)) - v) < 1e-3;
+    }
+    ZeroPoolStats stats = he.encryption_pool_stats();
+    report("pool encryptions decrypt to their values", values);
+    report("the pool served the first encryptions", stats.served == 4 && stats.misses == 2);
+
+    return finish("zero pool");
+}
@@ -0,0 +1,295 @@
+// Offline model compiler: TorchScript module -> serialized HE execution plan (ModelPlan).
+//
+// Usage: NativeSealCompile <model.pt> <plan.heplan> [--input 1,1,28,28] [--scale-bits 30]
+//                          [--integer-bits 10] [--min-slots 1] [--security 128]
+//                          [--poly 16384 --bits 40,30,30,30,30,30,30,30,40]
+//
+// Without --poly / --bits, the CKKS parameters are planned from the model's depth
+// (plan_ckks_parameters): the smallest degree and the shortest chain meeting the precision
+// (--scale-bits, --integer-bits) and security targets.
+//
+// The layer graph is read from the frozen forward graph (aten::conv2d, avg_pool2d, linear, ...),
+// so layer ids and hyperparameters come from the model itself. This is the only LibTorch user:
+// the server loads the plan with ModelPlan::load.
+#include <torch/script.h>
+#include <torch/csrc/jit/ir/constants.h>  // toIValue
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <he/he.h>
+#include <plan/modelPlan.h>
+#include <plan/parameterPlanner.h>
+
+namespace {
+
+std::vector<long> parse_list(const std::string &text)
+{
+    std::vector<long> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(std::stol(item));
+    }
+    return values;
+}
+
+// Constant argument i of node (weights are constants once the module is frozen)
+c10::IValue constant(const torch::jit::Node *node, size_t i)
+{
+    c10::optional<c10::IValue> value = torch::jit::toIValue(node->input(i));
+    if (!value) {
+        throw std::runtime_error(std::string(node->kind().toQualString()) + ": argument " + std::to_string(i) + " is not a constant.");
+    }
+    return *value;
+}
+
+std::pair<int, int> int_pair(const c10::IValue &value, std::pair<int, int> fallback)
+{
+    std::vector<int64_t> list = value.toIntVector();
+    if (list.empty()) return fallback;
+    if (list.size() == 1) return { static_cast<int>(list[0]), static_cast<int>(list[0]) };
+    return { static_cast<int>(list[0]), static_cast<int>(list[1]) };
+}
+
+void copy_tensor(const torch::Tensor &tensor, std::vector<size_t> &shape, std::vector<double> &values)
+{
+    torch::Tensor contiguous = tensor.detach().to(torch::kDouble).contiguous();
+    shape.assign(contiguous.sizes().begin(), contiguous.sizes().end());
+    values.assign(contiguous.data_ptr<double>(), contiguous.data_ptr<double>() + contiguous.numel());
+}
+
+void copy_bias(const c10::IValue &value, std::vector<double> &bias)
+{
+    if (value.isNone()) return;
+    std::vector<size_t> shape;
+    copy_tensor(value.toTensor(), shape, bias);
+}
+
+PlanLayer convolution(const torch::jit::Node *node, bool underscore)
+{
+    // aten::conv2d(input, weight, bias, stride, padding, dilation, groups)
+    // aten::_convolution(input, weight, bias, stride, padding, dilation, transposed, output_padding, groups, ...)
+    PlanLayer layer;
+    layer.kind = PlanLayerKind::Conv2d;
+    copy_tensor(constant(node, 1).toTensor(), layer.weight_shape, layer.weights);
+    copy_bias(constant(node, 2), layer.bias);
+    layer.stride = int_pair(constant(node, 3), { 1, 1 });
+    if (!constant(node, 4).isIntList()) {
+        throw std::runtime_error("Conv2d: only explicit integer padding is supported.");
+    }
+    layer.padding = int_pair(constant(node, 4), { 0, 0 });
+    std::pair<int, int> dilation = int_pair(constant(node, 5), { 1, 1 });
+    int64_t groups = constant(node, underscore ? 8 : 6).toInt();
+    if (dilation != std::make_pair(1, 1) || groups != 1 || (underscore && constant(node, 6).toBool())) {
+        throw std::runtime_error("Conv2d: dilation, groups and transposed convolutions are not supported.");
+    }
+    if (layer.weight_shape.size() != 4) {
+        throw std::runtime_error("Conv2d: expected 4D weights.");
+    }
+    return layer;
+}
+
+PlanLayer avg_pool(const torch::jit::Node *node)
+{
+    // aten::avg_pool2d(self, kernel_size, stride, padding, ceil_mode, count_include_pad, divisor_override)
+    PlanLayer layer;
+    layer.kind = PlanLayerKind::AvgPool;
+    layer.kernel = int_pair(constant(node, 1), { 1, 1 });
+    layer.stride = int_pair(constant(node, 2), layer.kernel);
+    layer.padding = int_pair(constant(node, 3), { 0, 0 });
+    bool ceil_mode = constant(node, 4).toBool();
+    bool count_include_pad = constant(node, 5).toBool();
+    bool divisor = !constant(node, 6).isNone();
+    // AvgPoolLayer always divides by the kernel area
+    if (ceil_mode || divisor || (!count_include_pad && layer.padding != std::make_pair(0, 0))) {
+        throw std::runtime_error("AvgPool2d: ceil_mode, divisor_override and count_include_pad=False are not supported.");
+    }
+    return layer;
+}
+
+PlanLayer linear(const torch::jit::Node *node)
+{
+    // aten::linear(input, weight, bias)
+    PlanLayer layer;
+    layer.kind = PlanLayerKind::Linear;
+    copy_tensor(constant(node, 1).toTensor(), layer.weight_shape, layer.weights);
+    copy_bias(constant(node, 2), layer.bias);
+    return layer;
+}
+
+// x.flatten(1) or x.view(n, -1) / x.reshape(n, -1): a reshape to [n, features]
+bool flattens(const torch::jit::Node *node)
+{
+    if (node->kind() == c10::aten::flatten) {
+        return constant(node, 1).toInt() == 1 && constant(node, 2).toInt() == -1;
+    }
+    const torch::jit::Node *shape = node->input(1)->node();
+    if (shape->kind() == c10::prim::ListConstruct) {
+        return shape->inputs().size() == 2;
+    }
+    return constant(node, 1).toIntVector().size() == 2;
+}
+
+bool produces_tensor(const torch::jit::Node *node)
+{
+    for (const torch::jit::Value *output : node->outputs()) {
+        if (output->type()->isSubtypeOf(*c10::TensorType::get())) return true;
+    }
+    return false;
+}
+
+bool reads(const torch::jit::Node *node, const torch::jit::Value *value)
+{
+    for (const torch::jit::Value *input : node->inputs()) {
+        if (input == value) return true;
+    }
+    return false;
+}
+
+// Map the frozen forward graph, which must be a chain of supported ops on the input, to plan layers
+std::vector<PlanLayer> read_layers(torch::jit::Module module)
+{
+    std::vector<PlanLayer> layers;
+    module.eval();
+    torch::jit::Module frozen = torch::jit::freeze(module, {}, /*optimize_numerics=*/false);
+    std::shared_ptr<torch::jit::Graph> graph = frozen.get_method("forward").graph();
+
+    // Input 0 is the module itself
+    if (graph->inputs().size() != 2) {
+        throw std::runtime_error("forward must take exactly one tensor.");
+    }
+    const torch::jit::Value *current = graph->inputs()[1];
+
+    for (const torch::jit::Node *node : graph->nodes()) {
+        // Constants, attribute reads and shape queries (x.size(0) in a view) are not layers
+        if (!reads(node, current) || !produces_tensor(node)) {
+            continue;
+        }
+
+        c10::Symbol kind = node->kind();
+        if (kind == c10::aten::conv2d || kind == c10::aten::_convolution) {
+            layers.push_back(convolution(node, kind == c10::aten::_convolution));
+        } else if (kind == c10::aten::avg_pool2d) {
+            layers.push_back(avg_pool(node));
+        } else if (kind == c10::aten::adaptive_avg_pool2d) {
+            PlanLayer layer;
+            layer.kind = PlanLayerKind::AdaptiveAvgPool;
+            layer.kernel = int_pair(constant(node, 1), { 1, 1 });
+            layers.push_back(std::move(layer));
+        } else if (kind == c10::aten::square ||
+                   (kind == c10::aten::mul && node->input(0) == node->input(1)) ||
+                   (kind == c10::aten::pow && constant(node, 1).isScalar() && constant(node, 1).toScalar().toDouble() == 2.0)) {
+            PlanLayer layer;
+            layer.kind = PlanLayerKind::Square;
+            layers.push_back(std::move(layer));
+        } else if (kind == c10::aten::flatten || kind == c10::aten::view || kind == c10::aten::reshape) {
+            if (!flattens(node)) {
+                throw std::runtime_error(std::string(kind.toQualString()) + ": only flattening to [n, features] is supported.");
+            }
+            PlanLayer layer;
+            layer.kind = PlanLayerKind::Flatten;
+            layers.push_back(std::move(layer));
+        } else if (kind == c10::aten::linear) {
+            layers.push_back(linear(node));
+        } else {
+            throw std::runtime_error(std::string("Unsupported op on the encrypted path: ") + kind.toQualString());
+        }
+        current = node->output();
+    }
+
+    if (graph->outputs().size() != 1 || graph->outputs()[0] != current) {
+        throw std::runtime_error("forward must return the output of its last layer.");
+    }
+    return layers;
+}
+
+const char *kind_name(PlanLayerKind kind)
+{
+    switch (kind) {
+    case PlanLayerKind::Conv2d: return "Conv2d";
+    case PlanLayerKind::AvgPool: return "AvgPool";
+    case PlanLayerKind::AdaptiveAvgPool: return "AdaptiveAvgPool";
+    case PlanLayerKind::Square: return "Square";
+    case PlanLayerKind::Flatten: return "Flatten";
+    case PlanLayerKind::Linear: return "Linear";
+    }
+    return "?";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <model.pt> <plan.heplan> [--input 1,1,28,28] [--scale-bits 30]"
+                  << " [--integer-bits 10] [--min-slots 1] [--security 128|192|256]"
+                  << " [--poly 16384 --bits 40,30,30,30,30,30,30,30,40]" << std::endl;
+        return 2;
+    }
+    std::string model_path = argv[1];
+    std::string plan_path = argv[2];
+
+    std::vector<long> input_shape = { 1, 1, 28, 28 };
+    PrecisionTarget target;
+    size_t poly_modulus_degree = 0;  // 0: planned
+    std::vector<long> bits;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--input") input_shape = parse_list(argv[i + 1]);
+        else if (option == "--poly") poly_modulus_degree = std::stoul(argv[i + 1]);
+        else if (option == "--scale-bits") target.scale_bits = std::stoi(argv[i + 1]);
+        else if (option == "--integer-bits") target.integer_bits = std::stoi(argv[i + 1]);
+        else if (option == "--min-slots") target.min_slots = std::stoul(argv[i + 1]);
+        else if (option == "--security") target.security = static_cast<seal::sec_level_type>(std::stoi(argv[i + 1]));
+        else if (option == "--bits") bits = parse_list(argv[i + 1]);
+        else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 2;
+        }
+    }
+
+    if ((poly_modulus_degree == 0) != bits.empty()) {
+        std::cerr << "--poly and --bits go together" << std::endl;
+        return 2;
+    }
+
+    try {
+        std::vector<PlanLayer> layers = read_layers(torch::jit::load(model_path));
+
+        CkksParameters parameters;
+        if (poly_modulus_degree == 0) {
+            ModelDepth depth = count_depth(layers);
+            parameters = plan_ckks_parameters(depth, target);
+            std::cout << "Depth " << depth.rescales() << " (" << depth.products << " products, " << depth.squarings
+                      << " squarings, " << depth.pool_scalings << " pool scalings): N = " << parameters.poly_modulus_degree
+                      << ", " << parameters.bit_sizes.size() << " primes" << std::endl;
+        } else {
+            parameters.poly_modulus_degree = poly_modulus_degree;
+            parameters.scale = std::ldexp(1.0, target.scale_bits);
+            parameters.bit_sizes.assign(bits.begin(), bits.end());
+        }
+
+        ModelPlan plan(parameters.poly_modulus_degree, parameters.scale, parameters.bit_sizes,
+                       std::vector<size_t>(input_shape.begin(), input_shape.end()));
+        for (PlanLayer &layer : layers) {
+            plan.add_layer(std::move(layer));
+        }
+
+        // Weights are encoded under exactly the context the server will create from the plan
+        CKKSPyfhel he(parameters.poly_modulus_degree, parameters.scale, parameters.bit_sizes);
+        plan.compile(he);
+        plan.save(plan_path);
+
+        for (const PlanLayer &layer : plan.layers()) {
+            std::cout << kind_name(layer.kind) << ": input with " << layer.depth_in << " levels at scale 2^"
+                      << std::log2(layer.scale_in) << std::endl;
+        }
+        std::cout << "Output scale 2^" << std::log2(plan.output_scale()) << ". Plan written to " << plan_path << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error compiling " << model_path << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}